@@ -0,0 +1,383 @@
+/*
+ * Copyright 2026 Contemporary Software
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+/*
+ * Boot read benchmark. Times the JFFS2 and FatFs read paths the loader uses
+ * against filesystem images and reports the throughput with the flash or
+ * card traffic it took. The JFFS2 read is timed without the DDR page cache,
+ * with a cold cache, with a warm cache and with a warm cache that checks
+ * the cached blocks' CRC. The index mode times the mount's index scan and
+ * the read with a cold cache.
+ *
+ * Built for the host board and run by `./waf bench`:
+ *
+ *  flare_bench --jffs2 jffs2.img --file /boot/app.img
+ *  flare_bench --fat fat.img --file app.img
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <board.h>
+#include <datasafe.h>
+#include <fs/boot-filesystem.h>
+
+#include <driver/flash/flash.h>
+#include <driver/jffs2/jffs2-boot.h>
+#include <driver/sdhci/sdhci.h>
+#include <driver/timer/board-timer.h>
+
+#define BENCH_PASSES    (5)
+#define BENCH_DEST_SIZE (256UL * 1024 * 1024)
+
+typedef enum {
+    BENCH_JFFS2_NO_CACHE,
+    BENCH_JFFS2_COLD_CACHE,
+    BENCH_JFFS2_WARM_CACHE,
+    BENCH_JFFS2_WARM_CRC_CACHE,
+    BENCH_JFFS2_INDEX,
+    BENCH_FATFS
+} bench_mode;
+
+static const char* const mode_names[] = {
+    "no-cache",
+    "cold-cache",
+    "warm-cache",
+    "warm-crc",
+    "index",
+    "fatfs"
+};
+
+typedef struct {
+    uint64_t usecs;
+    size_t   size;
+    uint32_t nodes;
+    uint32_t reads;
+    uint64_t bytes;
+    uint32_t cache_hit;
+    uint32_t cache_miss;
+    uint32_t inflates;
+    uint64_t inflate_usecs;
+} bench_result;
+
+static const struct option options[] = {
+    { "jffs2", required_argument, NULL, 'j' },
+    { "fat", required_argument, NULL, 'F' },
+    { "file", required_argument, NULL, 'f' },
+    { "erase-size", required_argument, NULL, 'E' },
+    { "passes", required_argument, NULL, 'p' },
+    { "name", required_argument, NULL, 'n' },
+    { "csv", no_argument, NULL, 'c' },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+};
+
+static jffs2_control jffs2;
+
+static void usage(const char* argv0) {
+    printf("usage: %s [options]\n", argv0);
+    printf(" -j, --jffs2 FILE       JFFS2 flash image\n");
+    printf(" -F, --fat FILE         FAT SD card image\n");
+    printf(" -f, --file PATH        file to read\n");
+    printf(" -E, --erase-size SIZE  flash erase block size (default %lu)\n",
+        HOST_FLASH_ERASE_SIZE);
+    printf(" -p, --passes COUNT     passes per mode, the best is reported "
+        "(default %d)\n", BENCH_PASSES);
+    printf(" -n, --name NAME        name reported for the image\n");
+    printf(" -c, --csv              report as CSV\n");
+    printf(" -h, --help             this help\n");
+}
+
+static uint64_t bench_now(void) {
+    uint64_t now;
+    board_timer_get(&now);
+    return now;
+}
+
+static int bench_jffs2(bench_mode mode, uint8_t* cache, size_t cache_size,
+    void* index, const char* file, uint8_t* dest, bench_result* result) {
+    const uint32_t flash_size = flash_device_size();
+    const bool crc = mode == BENCH_JFFS2_WARM_CRC_CACHE;
+    uint8_t* buffer_cache = NULL;
+    /*
+     * The reads without a mount use the index memory for the fragment map.
+     */
+    jffs2_frag* frags = (jffs2_frag*) index;
+    const uint32_t frag_slots = JFFS2_INDEX_NODES(flash_size);
+    size_t size = BENCH_DEST_SIZE;
+    uint64_t start;
+    jffs2_error je;
+
+    if (mode != BENCH_JFFS2_NO_CACHE) {
+        buffer_cache = cache;
+        /*
+         * A cold cache has no valid pages. A warm cache is loaded by an
+         * untimed read.
+         */
+        memset(cache, 0, cache_size);
+        if ((mode != BENCH_JFFS2_COLD_CACHE) && (mode != BENCH_JFFS2_INDEX)) {
+            je = jffs2_boot_read(&jffs2, 0, flash_size,
+                flash_device_sector_erase_size(), buffer_cache, crc, frags,
+                frag_slots, file, dest, &size, NULL, NULL);
+            if (je != JFFS2_NO_ERROR) {
+                return je;
+            }
+            size = BENCH_DEST_SIZE;
+        }
+    }
+
+    start = bench_now();
+    if (mode == BENCH_JFFS2_INDEX) {
+        je = jffs2_boot_mount(&jffs2, 0, flash_size,
+            flash_device_sector_erase_size(), buffer_cache, crc, index);
+        if (je == JFFS2_NO_ERROR) {
+            je = jffs2_boot_read_file(&jffs2, file, dest, &size, NULL, NULL);
+        }
+    } else {
+        je = jffs2_boot_read(&jffs2, 0, flash_size,
+            flash_device_sector_erase_size(), buffer_cache, crc, frags,
+            frag_slots, file, dest, &size, NULL, NULL);
+    }
+    result->usecs = bench_now() - start;
+    if (je != JFFS2_NO_ERROR) {
+        return je;
+    }
+
+    result->size = size;
+    result->nodes = jffs2.buffer.nodes_scanned;
+    result->reads = jffs2.buffer.flash_reads;
+    result->bytes = jffs2.buffer.flash_bytes;
+    result->cache_hit = jffs2.buffer.cache_hit;
+    result->cache_miss = jffs2.buffer.cache_miss;
+    result->inflates = jffs2.buffer.inflate_count;
+    result->inflate_usecs = jffs2.buffer.inflate_usecs;
+
+    return 0;
+}
+
+static int bench_fatfs(const char* file, uint8_t* dest,
+    bench_result* result) {
+    uint32_t size = BENCH_DEST_SIZE;
+    uint64_t start;
+    int rc;
+
+    /*
+     * Mounting is lazy so the FAT is read again in the timed read.
+     */
+    rc = flare_filesystem_mount(FILESYSTEM_SD_FATFS);
+    if (rc != 0) {
+        return rc;
+    }
+
+    host_sdhci_stats(SDHCI_CTLR_SD, &result->reads, &result->bytes, true);
+
+    start = bench_now();
+    rc = flare_read_file(FILESYSTEM_SD_FATFS, file, dest, &size, NULL);
+    result->usecs = bench_now() - start;
+    if (rc != 0) {
+        return rc;
+    }
+
+    result->size = size;
+    host_sdhci_stats(SDHCI_CTLR_SD, &result->reads, &result->bytes, true);
+
+    return 0;
+}
+
+static double bench_mbps(const bench_result* result) {
+    if (result->usecs == 0) {
+        return 0;
+    }
+    return ((double) result->size) / result->usecs;
+}
+
+static void bench_report(const char* name, bench_mode mode,
+    const bench_result* result, bool csv) {
+    if (csv) {
+        printf("%s,%s,%zu,%llu,%.2f,%u,%u,%llu,%u,%u,%u,%llu\n",
+            name, mode_names[mode], result->size,
+            (unsigned long long) result->usecs, bench_mbps(result),
+            result->nodes, result->reads,
+            (unsigned long long) result->bytes,
+            result->cache_hit, result->cache_miss, result->inflates,
+            (unsigned long long) result->inflate_usecs);
+    } else {
+        printf("%-24s %-10s %9zu %9.3f %8.2f %7u %7u %10llu %7u %7u %7u %9.3f\n",
+            name, mode_names[mode], result->size, result->usecs / 1000.0,
+            bench_mbps(result), result->nodes, result->reads,
+            (unsigned long long) result->bytes,
+            result->cache_hit, result->cache_miss, result->inflates,
+            result->inflate_usecs / 1000.0);
+    }
+}
+
+static void bench_header(bool csv) {
+    if (csv) {
+        printf("image,mode,size,usecs,mbps,nodes,reads,bytes,"
+            "cache-hit,cache-miss,inflates,inflate-usecs\n");
+    } else {
+        printf("%-24s %-10s %9s %9s %8s %7s %7s %10s %7s %7s %7s %9s\n",
+            "image", "mode", "size", "msecs", "MB/s", "nodes", "reads",
+            "bytes", "hit", "miss", "inflate", "inf-msecs");
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const char* jffs2_image = NULL;
+    const char* fat_image = NULL;
+    const char* file = NULL;
+    const char* name = NULL;
+    size_t erase_size = HOST_FLASH_ERASE_SIZE;
+    int passes = BENCH_PASSES;
+    bool csv = false;
+    bench_mode first;
+    bench_mode last;
+    bench_mode mode;
+    uint8_t* cache = NULL;
+    size_t cache_size = 0;
+    void* index = NULL;
+    uint8_t* dest;
+    int opt;
+    int rc;
+
+    board_hardware_setup();
+
+    while ((opt = getopt_long(argc, argv, "j:F:f:E:p:n:ch", options,
+                NULL)) != -1) {
+        switch (opt) {
+        case 'j':
+            jffs2_image = optarg;
+            break;
+        case 'F':
+            fat_image = optarg;
+            break;
+        case 'f':
+            file = optarg;
+            break;
+        case 'E':
+            erase_size = strtoul(optarg, NULL, 0);
+            break;
+        case 'p':
+            passes = strtol(optarg, NULL, 0);
+            break;
+        case 'n':
+            name = optarg;
+            break;
+        case 'c':
+            csv = true;
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if ((jffs2_image == NULL) == (fat_image == NULL) || file == NULL ||
+        passes < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (name == NULL) {
+        name = jffs2_image != NULL ? jffs2_image : fat_image;
+    }
+
+    dest = malloc(BENCH_DEST_SIZE);
+    if (dest == NULL) {
+        printf("error: no memory for the destination\n");
+        return 1;
+    }
+
+    if (jffs2_image != NULL) {
+        const char* label;
+        rc = host_flash_attach(jffs2_image, erase_size);
+        if (rc != 0) {
+            printf("error: flash: %s: %s\n", jffs2_image, strerror(rc));
+            return 1;
+        }
+        if (flash_open(&label) != FLASH_NO_ERROR) {
+            printf("error: flash: open failed\n");
+            return 1;
+        }
+        cache_size = JFFS2_BUFFER_CACHE_SIZE(flash_device_size(), true);
+        cache = malloc(cache_size);
+        if (cache == NULL) {
+            printf("error: no memory for the cache\n");
+            return 1;
+        }
+        index = malloc(JFFS2_INDEX_SIZE(flash_device_size()));
+        if (index == NULL) {
+            printf("error: no memory for the index\n");
+            return 1;
+        }
+        first = BENCH_JFFS2_NO_CACHE;
+        last = BENCH_JFFS2_INDEX;
+    } else {
+        rc = host_sdhci_attach(SDHCI_CTLR_SD, fat_image);
+        if (rc != 0) {
+            printf("error: sd: %s: %s\n", fat_image, strerror(rc));
+            return 1;
+        }
+        if (sdhci_open(SDHCI_CTLR_SD) != SDHCI_NO_ERROR) {
+            printf("error: sd: open failed\n");
+            return 1;
+        }
+        first = BENCH_FATFS;
+        last = BENCH_FATFS;
+    }
+
+    board_timer_reset();
+
+    bench_header(csv);
+
+    for (mode = first; mode <= last; ++mode) {
+        bench_result best;
+        int pass;
+
+        memset(&best, 0, sizeof(best));
+
+        for (pass = 0; pass < passes; ++pass) {
+            bench_result result;
+
+            memset(&result, 0, sizeof(result));
+
+            if (mode == BENCH_FATFS) {
+                rc = bench_fatfs(file, dest, &result);
+            } else {
+                rc = bench_jffs2(mode, cache, cache_size, index, file, dest,
+                    &result);
+            }
+            if (rc != 0) {
+                printf("error: %s: %s: %s: %d\n",
+                    name, mode_names[mode], file, rc);
+                return 1;
+            }
+
+            if (pass == 0 || result.usecs < best.usecs) {
+                best = result;
+            }
+        }
+
+        bench_report(name, mode, &best, csv);
+    }
+
+    return 0;
+}
@@ -0,0 +1,181 @@
+/*
+ * Copyright 2026 Contemporary Software
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+
+/*
+ * CRC32 engine benchmark. Checks each engine against the byte table engine
+ * and reports the throughput. Build and run on the host:
+ *
+ *  cc -O2 -I bootloader -o crc-bench bench/crc-bench.c
+ *  ./crc-bench [size-MB] [passes]
+ *
+ * The ARMv8 CRC32 instruction engine is checked by cross building for
+ * aarch64 with the CRC extension and running under qemu user mode:
+ *
+ *  aarch64-linux-gnu-gcc -O2 -march=armv8-a+crc -static -I bootloader \
+ *    -o crc-bench bench/crc-bench.c
+ *  qemu-aarch64 ./crc-bench
+ *
+ * On other hosts the instruction engine's streams, stream shifts, heads and
+ * tails are checked against a bitwise model of the instructions:
+ *
+ *  cc -O2 -DCRC32_ARMV8=1 -I bootloader -o crc-bench bench/crc-bench.c
+ *  ./crc-bench 8 1
+ */
+
+#define CRC32_ALL_ENGINES 1
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(CRC32_ARMV8) && CRC32_ARMV8 && !defined(__aarch64__)
+/*
+ * The ARMv8 CRC32 instructions: the reflected CRC32 polynomial with no pre
+ * or post conditioning and the data taken least significant bit first.
+ */
+static uint32_t crc32_model(uint32_t crc, uint64_t data, int bits) {
+    int b;
+    for (b = 0; b < bits; ++b) {
+        const uint32_t bit = (crc ^ (uint32_t) (data >> b)) & 1;
+        crc = (crc >> 1) ^ (bit != 0 ? 0xedb88320 : 0);
+    }
+    return crc;
+}
+
+static uint32_t __crc32b(uint32_t crc, uint8_t data) {
+    return crc32_model(crc, data, 8);
+}
+
+static uint32_t __crc32w(uint32_t crc, uint32_t data) {
+    return crc32_model(crc, data, 32);
+}
+
+static uint32_t __crc32d(uint32_t crc, uint64_t data) {
+    return crc32_model(crc, data, 64);
+}
+#endif
+
+#include "driver/crc/crc.c"
+
+typedef uint32_t (*crc_engine)(uint32_t crc, const uint8_t* p, size_t len);
+
+static const struct {
+    const char* name;
+    crc_engine  engine;
+} engines[] = {
+    { "byte", crc32_bytes },
+    { "slice-8", crc32_slice8 },
+    { "slice-16", crc32_slice16 },
+#if CRC32_ARMV8
+    { "armv8", crc32_armv8 },
+#endif
+};
+
+#define ENGINES (sizeof(engines) / sizeof(engines[0]))
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static int check(const uint8_t* data, size_t size) {
+    const uint8_t check_data[] = "123456789";
+    int errors = 0;
+    size_t e;
+    int i;
+    for (e = 0; e < ENGINES; ++e) {
+        uint32_t crc = ~engines[e].engine(~0U, check_data, 9);
+        if (crc != 0xcbf43926) {
+            printf("error: %s: check value: %08x\n", engines[e].name, crc);
+            ++errors;
+        }
+    }
+    /*
+     * Random alignments and lengths so the heads and tails are covered.
+     */
+    for (i = 0; i < 10000; ++i) {
+        size_t offset = rand() % 64;
+        size_t len = rand() % ((i & 1) ? 64 : 4096);
+        uint32_t seed = rand();
+        uint32_t ref;
+        if (offset + len > size) {
+            continue;
+        }
+        ref = crc32_bytes(seed, data + offset, len);
+        for (e = 1; e < ENGINES; ++e) {
+            uint32_t crc = engines[e].engine(seed, data + offset, len);
+            if (crc != ref) {
+                printf("error: %s: offset=%zu len=%zu: %08x != %08x\n",
+                       engines[e].name, offset, len, crc, ref);
+                ++errors;
+                break;
+            }
+        }
+    }
+    return errors;
+}
+
+int main(int argc, char* argv[]) {
+    size_t   size = 64;
+    int      passes = 4;
+    uint8_t* data;
+    size_t   i;
+    size_t   e;
+
+    if (argc > 1) {
+        size = strtoul(argv[1], NULL, 0);
+    }
+    if (argc > 2) {
+        passes = strtoul(argv[2], NULL, 0);
+    }
+    size *= 1024 * 1024;
+
+    data = malloc(size);
+    if (data == NULL) {
+        printf("error: no memory\n");
+        return 1;
+    }
+    srand(1);
+    for (i = 0; i < size; ++i) {
+        data[i] = rand();
+    }
+
+    if (check(data, size) != 0) {
+        return 1;
+    }
+
+    printf("%-10s %10s %10s\n", "engine", "crc", "MB/s");
+    for (e = 0; e < ENGINES; ++e) {
+        uint32_t crc = 0;
+        double start;
+        double elapsed;
+        int p;
+        start = now();
+        for (p = 0; p < passes; ++p) {
+            crc = engines[e].engine(crc, data, size);
+        }
+        elapsed = now() - start;
+        printf("%-10s   %08x %10.1f\n", engines[e].name, crc,
+               ((double) size * passes) / (1024 * 1024) / elapsed);
+    }
+
+    free(data);
+    return 0;
+}
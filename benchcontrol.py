@@ -0,0 +1,179 @@
+#
+# Flare Benchmark Control
+#
+# The bench command builds the host board, generates the filesystem images
+# and runs the boot read benchmark against each image. The results are
+# written as CSV to bench/results.csv in the build directory and can be
+# checked against a baseline so a boot time regression fails the command.
+#
+
+import csv
+import os
+import subprocess
+import sys
+
+import builditems
+import flareimage
+
+MB = 1024 * 1024
+
+#
+# The benchmark images. The name, the image type and the generator options.
+#
+images = [
+    ('jffs2-zlib-8m-25', 'jffs2', ['--size', 8 * MB, '--fill', 25]),
+    ('jffs2-zlib-32m-75', 'jffs2', ['--size', 32 * MB, '--fill', 75]),
+    ('jffs2-none-16m-50', 'jffs2',
+     ['--size', 16 * MB, '--fill', 50, '--compression', 'none']),
+    ('jffs2-zero-16m-50', 'jffs2', ['--size', 16 * MB, '--fill', 50,
+                                    '--zero', 50]),
+    ('jffs2-deep-16m-25', 'jffs2', ['--size', 16 * MB, '--fill', 25,
+                                    '--depth', 12, '--dirs', 128]),
+    ('jffs2-obsolete-32m', 'jffs2', ['--size', 32 * MB, '--obsolete', 16,
+                                     '--exe-size', 1 * MB]),
+    ('jffs2-summary-32m-75', 'jffs2', ['--size', 32 * MB, '--fill', 75,
+                                       '--summary']),
+    ('fat-16m-25', 'fat', ['--size', 16 * MB, '--fill', 25]),
+    ('fat-64m-75', 'fat', ['--size', 64 * MB, '--fill', 75]),
+]
+
+includes = {'default': ['bootloader'], 'host': []}
+
+defines = {'default': [], 'host': []}
+
+cflags = {'default': [], 'host': []}
+
+#
+# The default executable size and the JFFS2 boot path.
+#
+exe_size = 2 * MB
+jffs2_path = '/boot'
+
+
+def options(opt):
+    opt.add_option_group('bench options')
+    bopts = opt.get_option_group('bench options')
+    bopts.add_option('--bench-passes',
+                     default=5,
+                     type=int,
+                     dest='flare_bench_passes',
+                     help='Passes for each benchmark, the best is reported')
+    bopts.add_option('--bench-baseline',
+                     default=None,
+                     dest='flare_bench_baseline',
+                     help='Results CSV to check for regressions')
+    bopts.add_option('--bench-tolerance',
+                     default=20,
+                     type=int,
+                     dest='flare_bench_tolerance',
+                     help='Percentage slower than the baseline allowed')
+
+
+def build(bld):
+    if bld.env.FLARE_BOARD != 'host':
+        if bld.cmd == 'bench':
+            bld.fatal('The benchmarks need the host board')
+        return
+    bld.program(target='flare_bench',
+                features='c cprogram',
+                cflags=builditems.get_cflags(bld, cflags),
+                includes=builditems.get_includes(bld, includes),
+                defines=builditems.get_defines(bld, defines),
+                source=['bench/boot-bench.c',
+                        'bootloader/flare-build-id.c'],
+                use=['flare', 'flare_drivers'],
+                install_path=None)
+    bld.program(target='crc_bench',
+                features='c cprogram',
+                cflags=builditems.get_cflags(bld, cflags),
+                includes=builditems.get_includes(bld, includes),
+                source=['bench/crc-bench.c'],
+                install_path=None)
+    if bld.cmd == 'bench':
+        bld.add_post_fun(run)
+
+
+def generate(out, name, fs, args):
+    ''' Generate the image if its options have changed. Returns the path of
+    the executable in the image. '''
+    image = os.path.join(out, name + '.img')
+    stamp = image + '.args'
+    args = ['--type', fs, '--output', image, '--exe-size', exe_size] + args
+    if fs == 'jffs2':
+        args = ['--path', jffs2_path] + args
+    args = [str(a) for a in args]
+    opts = flareimage.arguments().parse_args(args)
+    boot, dirs = flareimage.tree_dirs(opts)
+    exe_path = os.path.join(boot, opts.name)
+    if os.path.exists(image) and os.path.exists(stamp):
+        with open(stamp) as f:
+            if f.read() == ' '.join(args):
+                return image, exe_path
+    flareimage.generate(opts)
+    with open(stamp, 'w') as f:
+        f.write(' '.join(args))
+    return image, exe_path
+
+
+def check(results, baseline, tolerance):
+    ''' Check the results against the baseline. Returns the regressions. '''
+    base = {}
+    with open(baseline) as f:
+        for r in csv.DictReader(f):
+            base[(r['image'], r['mode'])] = float(r['mbps'])
+    regressions = []
+    for r in results:
+        key = (r['image'], r['mode'])
+        if key in base:
+            limit = base[key] * (100 - tolerance) / 100
+            if float(r['mbps']) < limit:
+                regressions += ['%s %s: %s MB/s, baseline %.2f MB/s' %
+                                (key[0], key[1], r['mbps'], base[key])]
+    return regressions
+
+
+def run(bld):
+    out = bld.bldnode.make_node('bench').abspath()
+    os.makedirs(out, exist_ok=True)
+    flare_bench = bld.bldnode.find_node('flare_bench').abspath()
+    crc_bench = bld.bldnode.find_node('crc_bench').abspath()
+    passes = str(bld.options.flare_bench_passes)
+
+    subprocess.run([crc_bench, '16', passes], check=True)
+
+    results = []
+    for name, fs, args in images:
+        image, exe_path = generate(out, name, fs, args)
+        if fs == 'jffs2':
+            cmd = [flare_bench, '--jffs2', image, '--file', exe_path]
+        else:
+            cmd = [flare_bench, '--fat', image, '--file', exe_path.lstrip('/')]
+        cmd += ['--name', name, '--passes', passes, '--csv']
+        p = subprocess.run(cmd, capture_output=True, text=True)
+        if p.returncode != 0:
+            bld.fatal('bench: %s: %s' % (name, p.stdout + p.stderr))
+        results += list(csv.DictReader(p.stdout.splitlines()))
+
+    fields = list(results[0].keys())
+    with open(os.path.join(out, 'results.csv'), 'w', newline='') as f:
+        w = csv.DictWriter(f, fieldnames=fields)
+        w.writeheader()
+        w.writerows(results)
+
+    print('%-20s %-10s %8s %8s %6s %6s %9s %6s %6s %7s %9s' %
+          ('image', 'mode', 'msecs', 'MB/s', 'nodes', 'reads', 'bytes',
+           'hit', 'miss', 'inflate', 'inf-msecs'))
+    for r in results:
+        print('%-20s %-10s %8.3f %8s %6s %6s %9s %6s %6s %7s %9.3f' %
+              (r['image'], r['mode'], int(r['usecs']) / 1000.0, r['mbps'],
+               r['nodes'], r['reads'], r['bytes'], r['cache-hit'],
+               r['cache-miss'], r['inflates'],
+               int(r['inflate-usecs']) / 1000.0))
+    print('results: %s' % (os.path.join(out, 'results.csv')))
+
+    if bld.options.flare_bench_baseline is not None:
+        regressions = check(results, bld.options.flare_bench_baseline,
+                            bld.options.flare_bench_tolerance)
+        if len(regressions):
+            bld.fatal('bench: regressions:\n ' + '\n '.join(regressions))
+        print('no regressions against %s' % (bld.options.flare_bench_baseline))
@@ -33,6 +33,16 @@ void cache_invalidate(void)
   rtems_cache_invalidate_entire_instruction();
 }
 
+void cache_flush_range(const void* begin, size_t size)
+{
+  rtems_cache_flush_multiple_data_lines(begin, size);
+}
+
+void cache_invalidate_range(const void* begin, size_t size)
+{
+  rtems_cache_invalidate_multiple_data_lines(begin, size);
+}
+
 void cache_flush_invalidate(void)
 {
   cache_flush();
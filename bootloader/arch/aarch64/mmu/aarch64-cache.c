@@ -325,6 +325,11 @@ inline void rtems_cache_flush_entire_data(void)
   _AARCH64_Data_synchronization_barrier();
 }
 
+inline void rtems_cache_flush_multiple_data_lines(const void *begin, size_t size)
+{
+  _CPU_cache_flush_data_range(begin, size);
+}
+
 static inline void AArch64_cache_invalidate_level(uint64_t level)
 {
   uint64_t ccsidr;
@@ -379,6 +384,14 @@ inline void rtems_cache_invalidate_entire_data(void)
   AArch64_data_cache_invalidate_all_levels();
 }
 
+inline void rtems_cache_invalidate_multiple_data_lines(
+  const void *begin,
+  size_t      size
+)
+{
+  _CPU_cache_invalidate_data_range(begin, size);
+}
+
 inline void rtems_cache_enable_data(uint64_t el)
 {
   uint64_t sctlr;
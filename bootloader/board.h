@@ -21,10 +21,20 @@
   #include <board/versal/versal.h>
 #elif FLARE_ZYNQMP
   #include <board/zynqmp/zynqmp.h>
+#elif FLARE_HOST
+  #include <board/host/host.h>
 #else
   #include <board/zynq7000/zynq7000.h>
 #endif
 
+/*
+ * The memory at a physical address. A board that is not the target, for
+ * example the host, maps physical memory somewhere else.
+ */
+#if !defined(BOARD_MEMORY)
+  #define BOARD_MEMORY(_addr) ((uintptr_t) (_addr))
+#endif
+
 /*
  * Board set up.
  */
@@ -0,0 +1,54 @@
+/*
+ * Copyright 2026 Contemporary Software
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+/*
+ * Host board.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include <board.h>
+#include <hw-datasafe.h>
+
+uint8_t* host_memory;
+
+static int host_bootmode = FLARE_DS_BOOTMODE_QSPI;
+
+void board_hardware_setup(void) {
+    host_memory = mmap(NULL, HOST_MEMORY_SIZE, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (host_memory == MAP_FAILED) {
+        perror("error: host memory");
+        exit(1);
+    }
+}
+
+void host_set_bootmode(int bootmode) {
+    host_bootmode = bootmode;
+}
+
+int board_bootmode() {
+    return host_bootmode;
+}
+
+void flare_datasafe_hw_init(flare_datasafe* ds) {
+    ds->bootmode &= ~FLARE_DS_BOOTMODE_HW_MASK;
+    ds->bootmode |= board_bootmode();
+    ds->reset &= ~FLARE_DS_RESET_MASK;
+    ds->reset |= FLARE_DS_RESET_POR;
+}
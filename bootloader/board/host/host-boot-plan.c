@@ -0,0 +1,84 @@
+/*
+ * Copyright 2026 Contemporary Software
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include <flare-boot.h>
+#include <datasafe.h>
+#include <board.h>
+
+#include <driver/flash/flash.h>
+#include <driver/sdhci/sdhci.h>
+
+static int open_qspi() {
+    const char* label;
+    flash_error err = flash_open(&label);
+    return err;
+}
+
+static int mount_qspi_jffs2() {
+    return flare_filesystem_mount(FILESYSTEM_QSPI_JFFS2);
+}
+
+static int open_sd() {
+    return sdhci_open(SDHCI_CTLR_SD);
+}
+
+static int mount_sd_fatfs() {
+    return flare_filesystem_mount(FILESYSTEM_SD_FATFS);
+}
+
+static int open_emmc() {
+    return sdhci_open(SDHCI_CTLR_EMMC);
+}
+
+static int mount_emmc_fatfs() {
+    return flare_filesystem_mount(FILESYSTEM_EMMC_FATFS);
+}
+
+static void boot_plan(flare_boot_plan* bp,
+    plan_item open, char* open_name, plan_item mount, char* mount_name,
+    flare_fs fs) {
+    bp->opens[0] = open;
+    bp->opens_name[0] = open_name;
+    bp->mounts[0] = mount;
+    bp->mounts_name[0] = mount_name;
+
+    for (int i = 1; i < FLARE_STAGE_FUNC_MAX; i++ ) {
+        bp->opens[i] = NULL;
+        bp->opens_name[i] = NULL;
+        bp->mounts[i] = NULL;
+        bp->mounts_name[i] = NULL;
+    }
+
+    bp->boot_fs = fs;
+    bp->bs_name = "flare-0";
+}
+
+void flare_get_boot_plan(flare_boot_plan* bp) {
+    uint32_t bootmode = board_bootmode();
+
+    if (bootmode == FLARE_DS_BOOTMODE_SD_CARD) {
+        boot_plan(bp, &open_sd, "SD", &mount_sd_fatfs, "FATFS",
+            FILESYSTEM_SD_FATFS);
+    } else if (bootmode == FLARE_DS_BOOTMODE_EMMC) {
+        boot_plan(bp, &open_emmc, "EMMC", &mount_emmc_fatfs, "FATFS",
+            FILESYSTEM_EMMC_FATFS);
+    } else {
+        boot_plan(bp, &open_qspi, "QSPI", &mount_qspi_jffs2, "JFFS2",
+            FILESYSTEM_QSPI_JFFS2);
+    }
+}
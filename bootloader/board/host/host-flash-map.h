@@ -0,0 +1,41 @@
+/*
+ * Copyright 2026 Contemporary Software
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+/**
+ * Flash Layout
+ *
+ * The flash image is the filesystem followed by the factory data erase
+ * block. There is no boot partition.
+ */
+
+#if !defined(_FLARE_HOST_FLASH_H_)
+#define _FLARE_HOST_FLASH_H_
+
+/**
+ * Flash memory map.
+ */
+#define FLARE_FLASH_SIZE             flash_device_size()
+#define FLARE_FLASH_BLOCK_SIZE       flash_device_sector_erase_size()
+
+#define FLARE_FLASH_BOOT_BASE        (0UL)
+#define FLARE_FLASH_BOOT_SIZE        (0UL)
+#define FLARE_FLASH_FACTORY_BASE     (FLARE_FLASH_SIZE - FLARE_FLASH_FACTORY_SIZE)
+#define FLARE_FLASH_FACTORY_SIZE     (FLARE_FLASH_BLOCK_SIZE)
+#define FLARE_FLASH_FILESYSTEM_BASE  (FLARE_FLASH_BOOT_BASE + FLARE_FLASH_BOOT_SIZE)
+#define FLARE_FLASH_FILESYSTEM_SIZE  (FLARE_FLASH_FACTORY_BASE - \
+                                        (FLARE_FLASH_BOOT_BASE + FLARE_FLASH_BOOT_SIZE))
+
+#endif
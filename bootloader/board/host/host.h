@@ -0,0 +1,68 @@
+/*
+ * Copyright 2026 Contemporary Software
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+/*
+ * Host. The boot loader's filesystem and loading code built as a Linux
+ * program. The flash and SD card devices are image files and the target's
+ * physical memory is an arena.
+ */
+
+#if !defined(HOST_H)
+#define HOST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "host-flash-map.h"
+
+#define ARCHITECTURE "Host"
+
+/*
+ * The arena covers the target DDR the loader uses. It is reserved and pages
+ * are only allocated when touched.
+ */
+#define HOST_MEMORY_SIZE (0x80000000UL)
+
+extern uint8_t* host_memory;
+
+#define BOARD_MEMORY(_addr) ((uintptr_t) host_memory + (uintptr_t) (_addr))
+
+/*
+ * The default flash erase block size.
+ */
+#define HOST_FLASH_ERASE_SIZE (64UL * 1024)
+
+/*
+ * Attach an image file to the flash or an SD host controller. The image is
+ * mapped read only. Returns 0 or an errno value.
+ */
+int host_flash_attach(const char* path, size_t erase_size);
+int host_sdhci_attach(int controller, const char* path);
+
+/*
+ * The number of reads and bytes read from an SD host controller's card.
+ */
+void host_sdhci_stats(int controller, uint32_t* reads, uint64_t* bytes,
+    bool reset);
+
+/*
+ * Set the boot mode, FLARE_DS_BOOTMODE_QSPI, FLARE_DS_BOOTMODE_SD_CARD or
+ * FLARE_DS_BOOTMODE_EMMC.
+ */
+void host_set_bootmode(int bootmode);
+
+#endif /* HOST_H */
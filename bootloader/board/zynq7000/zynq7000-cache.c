@@ -42,8 +42,10 @@
 #define L2CC_IAR               (0x220)
 #define L2CC_ISR               (0x21c)
 #define L2CC_CACHE_SYNC        (0x730)
+#define L2CC_CACHE_INVLD_PA    (0x770)
 #define L2CC_CACHE_INVLD_WAY   (0x77c)
 #define L2CC_DUMMY_CACHE_SYNC  (0x740)
+#define L2CC_CACHE_INV_CLN_PA  (0x7f0)
 #define L2CC_CACHE_INV_CLN_WAY (0x7fc)
 #define L2CC_DEBUG_CTRL        (0xf40)
 
@@ -52,6 +54,11 @@
 #define L2CC_TAG_RAM_DEFAULT_MASK  (0x00000111)
 #define L2CC_DATA_RAM_DEFAULT_MASK (0x00000121)
 
+/*
+ * The L1 and L2 cache line size.
+ */
+#define CACHE_LINE_SIZE (32)
+
 /*
  * ARM and thumb mode controls.
  */
@@ -319,6 +326,38 @@ cache_l1_dcache_disable(void)
   }
 }
 
+/* DCCIMVAC, Data Cache Clean and Invalidate by MVA to PoC */
+static inline void
+cache_l1_dcache_flush_line(uint32_t mva)
+{
+  ARM_SWITCH_REGISTERS;
+
+  __asm__ volatile (
+    ARM_SWITCH_TO_ARM
+    "mcr p15, 0, %[mva], c7, c14, 1\n"
+    ARM_SWITCH_BACK
+    : ARM_SWITCH_OUTPUT
+    : [mva] "r" (mva)
+    : "memory"
+  );
+}
+
+/* DCIMVAC, Data Cache Invalidate by MVA to PoC */
+static inline void
+cache_l1_dcache_invalidate_line(uint32_t mva)
+{
+  ARM_SWITCH_REGISTERS;
+
+  __asm__ volatile (
+    ARM_SWITCH_TO_ARM
+    "mcr p15, 0, %[mva], c7, c6, 1\n"
+    ARM_SWITCH_BACK
+    : ARM_SWITCH_OUTPUT
+    : [mva] "r" (mva)
+    : "memory"
+  );
+}
+
 static inline void
 cache_l2_sync(void)
 {
@@ -356,6 +395,38 @@ cache_l2_invalidate(void)
   cache_dsb();
 }
 
+/*
+ * The L2 range operations use physical addresses. The FSBL runs with a flat
+ * map so the virtual address is the physical address.
+ */
+static inline void
+cache_l2_flush_range(uint32_t begin, uint32_t end)
+{
+  if ((board_reg_read(L2CC_BASE + L2CC_CNTRL) & 0x01) != 0) {
+#if defined(CONFIG_PL310_ERRATA_588369) || defined(CONFIG_PL310_ERRATA_727915)
+    board_reg_write(L2CC_BASE + L2CC_DEBUG_CTRL, 0x3);
+#endif
+    for (; begin < end; begin += CACHE_LINE_SIZE) {
+      board_reg_write(L2CC_BASE + L2CC_CACHE_INV_CLN_PA, begin);
+    }
+    cache_l2_sync();
+#if defined(CONFIG_PL310_ERRATA_588369) || defined(CONFIG_PL310_ERRATA_727915)
+    board_reg_write(L2CC_BASE + L2CC_DEBUG_CTRL, 0x0);
+#endif
+  }
+}
+
+static inline void
+cache_l2_invalidate_range(uint32_t begin, uint32_t end)
+{
+  if ((board_reg_read(L2CC_BASE + L2CC_CNTRL) & 0x01) != 0) {
+    for (; begin < end; begin += CACHE_LINE_SIZE) {
+      board_reg_write(L2CC_BASE + L2CC_CACHE_INVLD_PA, begin);
+    }
+    cache_l2_sync();
+  }
+}
+
 static inline void
 cache_l2_enable(void)
 {
@@ -392,6 +463,40 @@ cache_flush(void)
   cache_l2_flush();
 }
 
+void
+cache_flush_range(const void* begin, size_t size)
+{
+  uint32_t start = ((uintptr_t) begin) & ~(CACHE_LINE_SIZE - 1);
+  uint32_t end = ((uintptr_t) begin) + size;
+  uint32_t mva;
+  if (size == 0)
+    return;
+  cache_dsb();
+  for (mva = start; mva < end; mva += CACHE_LINE_SIZE)
+    cache_l1_dcache_flush_line(mva);
+  cache_dsb();
+  cache_l2_flush_range(start, end);
+  cache_dsb();
+}
+
+/*
+ * Invalidate the outer cache first so a line cannot be refilled into the L1
+ * from a stale L2 line.
+ */
+void
+cache_invalidate_range(const void* begin, size_t size)
+{
+  uint32_t start = ((uintptr_t) begin) & ~(CACHE_LINE_SIZE - 1);
+  uint32_t end = ((uintptr_t) begin) + size;
+  uint32_t mva;
+  if (size == 0)
+    return;
+  cache_l2_invalidate_range(start, end);
+  for (mva = start; mva < end; mva += CACHE_LINE_SIZE)
+    cache_l1_dcache_invalidate_line(mva);
+  cache_dsb();
+}
+
 void
 cache_invalidate_icache(void)
 {
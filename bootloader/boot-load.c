@@ -22,6 +22,7 @@
 #include <string.h>
 
 #include <boot-load.h>
+#include <boot-profile.h>
 #include <flare-boot.h>
 #include <flash-map.h>
 #include <uboot.h>
@@ -43,119 +44,450 @@ static inline uintptr_t swap_end_32(uint32_t val) {
             ((0x000000FF & val) << 24));
 }
 
-bool load_uboot_image(uint8_t* image, size_t size, uint32_t* entry_point)
+/*
+ * U-Boot legacy image header.
+ */
+typedef struct {
+    uint8_t* load_to;
+    size_t   size;
+    uint32_t entry_point;
+    uint8_t  compression;
+    char     name[UBOOT_NAME_LEN + 1];
+} uboot_header;
+
+/*
+ * Gzip header parse status.
+ */
+typedef enum {
+    GZIP_HEADER_VALID,
+    GZIP_HEADER_SHORT,
+    GZIP_HEADER_INVALID
+} gzip_header_status;
+
+/*
+ * Streaming load state. The sink is first so the handler can find the
+ * state.
+ */
+typedef enum {
+    LOAD_STREAM_UBOOT_HEADER,
+    LOAD_STREAM_GZIP_HEADER,
+    LOAD_STREAM_INFLATE,
+    LOAD_STREAM_COPY,
+    LOAD_STREAM_DONE,
+    LOAD_STREAM_AFTER_READ,
+    LOAD_STREAM_IMAGE,
+    LOAD_STREAM_ERROR
+} load_stream_state;
+
+typedef struct {
+    flare_file_sink   sink;
+    load_stream_state state;
+    const uint8_t*    image;
+    uboot_header      header;
+    size_t            in;
+    size_t            limit;
+    int               ze;
+    boot_profile_id   phase;
+} load_stream;
+
+static bool load_uboot_header(
+    const uint8_t* image, size_t size, uboot_header* header, bool verbose)
 {
-    uint8_t*          loadTo;
-    uint8_t           compression;
-    char              name[UBOOT_NAME_LEN + 1] = {0};
-    uint32_t          magic_num;
-
-    loadTo = (uint8_t*)swap_end_32(*(uint32_t*)(image + UBOOT_LOAD_ADDR_OFF));
-    size = (size_t)swap_end_32(*(uint32_t*)(image + UBOOT_DATA_SIZE_OFF));
-    *entry_point = swap_end_32(*(uint32_t*)(image + UBOOT_ENTRY_PT_OFF));
-    compression = *(image + UBOOT_COMP_OFF);
+    uint32_t magic_num;
+
+    if (size < UBOOT_DATA_OFF) {
+        if (verbose)
+            printf("Image too small: %zu\n", size);
+        return false;
+    }
+
+    header->load_to = (uint8_t*) BOARD_MEMORY(
+        swap_end_32(*(uint32_t*)(image + UBOOT_LOAD_ADDR_OFF)));
+    header->size = (size_t)swap_end_32(*(uint32_t*)(image + UBOOT_DATA_SIZE_OFF));
+    header->entry_point = swap_end_32(*(uint32_t*)(image + UBOOT_ENTRY_PT_OFF));
+    header->compression = *(image + UBOOT_COMP_OFF);
     magic_num = swap_end_32(*(uint32_t*)(image + UBOOT_MAGIC_NUM_OFF));
 
-    memcpy(name, image + UBOOT_IMAGE_NAME_OFF, UBOOT_NAME_LEN);
+    memcpy(header->name, image + UBOOT_IMAGE_NAME_OFF, UBOOT_NAME_LEN);
+    header->name[UBOOT_NAME_LEN] = '\0';
 
     if (magic_num != UBOOT_MAGIC_NUMBER) {
-        printf("Bad magic number\nExpected: %08x\nFound: %08x\n",
-            UBOOT_MAGIC_NUMBER, magic_num);
+        if (verbose)
+            printf("Bad magic number\nExpected: %08x\nFound: %08x\n",
+                UBOOT_MAGIC_NUMBER, magic_num);
         return false;
     }
 
-    if (compression != UBOOT_COMPRESSION_NONE &&
-          compression != UBOOT_COMPRESSION_GZIP)
+    if (header->compression != UBOOT_COMPRESSION_NONE &&
+          header->compression != UBOOT_COMPRESSION_GZIP)
     {
-        printf("Invalid compression format (%d)\n", compression);
+        if (verbose)
+            printf("Invalid compression format (%d)\n", header->compression);
         return false;
     }
 
-    printf("       Loading: U-Boot Image: %s\n", name);
-    printf("            To: %p\n", loadTo);
-    printf("          Size: 0x%08zx\n", size);
-    printf("    Compressed: %d\n", compression);
-    printf("   Entry point: 0x%08x\n", *entry_point);
+    return true;
+}
 
-    image = image + UBOOT_DATA_OFF;
+static void load_uboot_header_print(const uboot_header* header)
+{
+    printf("       Loading: U-Boot Image: %s\n", header->name);
+    printf("            To: %p\n", header->load_to);
+    printf("          Size: 0x%08zx\n", header->size);
+    printf("    Compressed: %d\n", header->compression);
+    printf("   Entry point: 0x%08x\n", header->entry_point);
+}
+
+/*
+ * We only support a gzip format file:
+ *
+ *    http://www.gzip.org/zlib/rfc-gzip.html
+ *
+ * Check the header and return the offset of the compressed data. The data
+ * may only be part of the file and the header can be short.
+ */
+static gzip_header_status load_gzip_header(
+    const uint8_t* data, size_t size, size_t* offset)
+{
+    size_t o = 10;
+
+    if (size < o)
+        return GZIP_HEADER_SHORT;
 
-    if (compression == UBOOT_COMPRESSION_GZIP)
+    if ((data[0] != 0x1f) || (data[1] != 0x8b) || (data[2] != 0x08))
+        return GZIP_HEADER_INVALID;
+
+    /* FLG.FEXTRA */
+    if ((data[3] & (1 << 2)) != 0)
+    {
+        if ((o + 2) > size)
+            return GZIP_HEADER_SHORT;
+        o += (data[o] | (data[o + 1] << 8)) + 2;
+    }
+    /* FLG.FNAME */
+    if ((data[3] & (1 << 3)) != 0)
     {
-        size_t offset;
-        uint32_t dsize;
-        int    ze;
+        do
+        {
+            if (o >= size)
+                return GZIP_HEADER_SHORT;
+        } while (data[o++] != 0);
+    }
+    /* FLG.FCOMMENT */
+    if ((data[3] & (1 << 4)) != 0)
+    {
+        do
+        {
+            if (o >= size)
+                return GZIP_HEADER_SHORT;
+        } while (data[o++] != 0);
+    }
+    /* FLG.FHCRC */
+    if ((data[3] & (1 << 1)) != 0)
+        o += 2;
 
-        /*
-         * We only support a gzip format file:
-         *
-         *    http://www.gzip.org/zlib/rfc-gzip.html
-         *
-         * Check the header.
-         */
+    if (o >= size)
+        return GZIP_HEADER_SHORT;
+
+    *offset = o;
+    return GZIP_HEADER_VALID;
+}
+
+/*
+ * Decompressing in place is safe if the end of the compressed data is this
+ * far past the end of the decompressed data. The margin is one byte for
+ * each 4K of output, which covers the 5 byte header of each stored block,
+ * plus the 32K deflate window and the 18 bytes of gzip header and trailer.
+ */
+#define GZIP_IN_PLACE_MARGIN(dsize) (PAD_4(((dsize) >> 12) + 32768 + 18))
+
+static bool load_regions_overlap(
+    const uint8_t* a, size_t a_size, const uint8_t* b, size_t b_size)
+{
+    return (a < (b + b_size)) && (b < (a + a_size));
+}
+
+/*
+ * The JFFS2 region holds the page cache kept across a reset and the mount
+ * index. Data is not loaded over it.
+ */
+static bool load_region_reserved(const uint8_t* dest, size_t size)
+{
+    return load_regions_overlap(
+        dest, size, (const uint8_t*) BOARD_MEMORY(FLARE_JFFS2_REGION_ADDRESS),
+        FLARE_JFFS2_REGION_SIZE);
+}
+
+/*
+ * The most data that can be inflated to the destination before it reaches
+ * the JFFS2 region.
+ */
+static size_t load_region_limit(const uint8_t* dest)
+{
+    const uint8_t* region = (const uint8_t*) BOARD_MEMORY(FLARE_JFFS2_REGION_ADDRESS);
+    if ((dest < region) && ((size_t) (region - dest) < FLARE_EXECUTABLE_SIZE))
+        return region - dest;
+    return FLARE_EXECUTABLE_SIZE;
+}
+
+/*
+ * Plan where the data is placed. Data is loaded directly to the load
+ * address if the source and destination do not overlap. If they overlap
+ * compressed data is decompressed in place with the margin it needs and
+ * is only moved if it does not already sit far enough past the output.
+ */
+typedef enum {
+    LOAD_PLACE_DIRECT,
+    LOAD_PLACE_IN_PLACE,
+    LOAD_PLACE_MOVE,
+    LOAD_PLACE_TOO_BIG
+} load_placement;
+
+static load_placement load_plan_placement(
+    const uint8_t* src, size_t src_size, uint8_t* dest, size_t dest_size,
+    const uint8_t** from)
+{
+    const uint8_t* placed;
+    size_t         region;
+
+    *from = src;
+
+    if (!load_regions_overlap(src, src_size, dest, dest_size))
+        return LOAD_PLACE_DIRECT;
+
+    region = dest_size + GZIP_IN_PLACE_MARGIN(dest_size);
+    if ((region < src_size) || (region > FLARE_EXECUTABLE_SIZE))
+        return LOAD_PLACE_TOO_BIG;
+
+    placed = dest + region - src_size;
+    if (src >= placed)
+        return LOAD_PLACE_IN_PLACE;
+
+    *from = placed;
+    return LOAD_PLACE_MOVE;
+}
+
+static bool load_uboot_data(const uint8_t* image, const uboot_header* header)
+{
+    uint8_t* loadTo = header->load_to;
+    size_t   size = header->size;
+
+    image = image + UBOOT_DATA_OFF;
+
+    if (header->compression == UBOOT_COMPRESSION_GZIP)
+    {
+        const uint8_t* data;
+        size_t         offset;
+        uint32_t       dsize;
+        int            ze;
 
-        if ((image[0] != 0x1f) || (image[1] != 0x8b) || (image[2] != 0x08))
+        if ((load_gzip_header(image, size, &offset) != GZIP_HEADER_VALID) ||
+            ((offset + 8) > size))
         {
-            printf("error: invalid %s header\n", name);
+            printf("error: invalid %s header\n", header->name);
             return false;
         }
 
-        offset = 10;
+        /*
+         * The gzip trailer's ISIZE is the size of the decompressed data.
+         */
+        dsize = image[size - 4] | (image[size - 3] << 8) |
+            (image[size - 2] << 16) | ((uint32_t) image[size - 1] << 24);
 
-        /* FLG.FEXTRA */
-        if ((image[3] & (1 << 2)) != 0)
-            offset += ((image[offset] << 8) | image[offset + 1]) + 2;
-        /* FLG.FNAME */
-        if ((image[3] & (1 << 3)) != 0)
+        if (load_region_reserved(loadTo, dsize))
         {
-            while (image[offset] != 0)
-            {
-                if (offset >= size)
-                {
-                    printf("error: invalid %s header: fname\n", name);
-                    return false;
-                }
-                ++offset;
-            }
-            ++offset;
+            printf("error: %s load overlaps the JFFS2 region\n", header->name);
+            return false;
         }
-        /* FLG.FCOMMENT */
-        if ((image[3] & (1 << 4)) != 0)
+
+        switch (load_plan_placement(image, size, loadTo, dsize, &data))
         {
-            while (image[offset] != 0)
-            {
-                if (offset >= size)
-                {
-                    printf("error: invalid %s header: fcomment\n", name);
-                    return false;
-                }
-                ++offset;
-            }
-            ++offset;
+            case LOAD_PLACE_MOVE:
+                memmove((void*) data, image, size);
+                break;
+            case LOAD_PLACE_TOO_BIG:
+                printf("error: %s too big to decompress in place: %u\n",
+                       header->name, dsize);
+                return false;
+            default:
+                break;
         }
-        /* FLG.FHCRC */
-        if ((image[3] & (1 << 1)) != 0)
-            offset += 2;
 
-        dsize = FLARE_EXECUTABLE_SIZE - PAD_4(size);
-
-        ze = raw_uncompress(loadTo + PAD_4(size),
+        ze = raw_uncompress(loadTo,
                             &dsize,
-                            image + offset,
+                            data + offset,
                             size - offset - 8);
         if (ze != Z_OK)
         {
-            printf("error: %s uncompress failure: %d\n", name, ze);
+            printf("error: %s uncompress failure: %d\n", header->name, ze);
             return false;
         }
-
-        memmove(loadTo, loadTo + PAD_4(size), dsize);
-    } else {
+    } else if (load_region_reserved(loadTo, size)) {
+        printf("error: %s load overlaps the JFFS2 region\n", header->name);
+        return false;
+    } else if (loadTo != image) {
         memmove(loadTo, (const void*)image, size);
     }
 
     return true;
 }
 
+bool load_uboot_image(uint8_t* image, size_t size, uint32_t* entry_point)
+{
+    uboot_header header;
+
+    if (!load_uboot_header(image, size, &header, true))
+        return false;
+
+    load_uboot_header_print(&header);
+
+    *entry_point = header.entry_point;
+
+    return load_uboot_data(image, &header);
+}
+
+static void load_stream_copy(load_stream* ls, size_t available)
+{
+    size_t end = UBOOT_DATA_OFF + ls->header.size;
+    if (end > available)
+        end = available;
+    if (end > ls->in)
+    {
+        boot_profile_resume(ls->phase);
+        memcpy(ls->header.load_to + (ls->in - UBOOT_DATA_OFF),
+               ls->image + ls->in, end - ls->in);
+        boot_profile_pause(ls->phase);
+        ls->in = end;
+    }
+    if (ls->in == (UBOOT_DATA_OFF + ls->header.size))
+        ls->state = LOAD_STREAM_DONE;
+}
+
+/*
+ * The file sink. The data is placed at the load address as the file is read
+ * if it cannot overwrite the image being read. A gzip image is inflated and
+ * an uncompressed image is copied while the data is in the cache. Any other
+ * image is loaded once the read has finished.
+ */
+static int load_stream_data(
+    flare_file_sink* sink, size_t offset, const uint8_t* data, size_t size)
+{
+    load_stream* ls = (load_stream*) sink;
+    size_t       available = offset + size;
+    size_t       end;
+
+    if ((offset == 0) &&
+        ((ls->state == LOAD_STREAM_GZIP_HEADER) ||
+         (ls->state == LOAD_STREAM_INFLATE) ||
+         (ls->state == LOAD_STREAM_COPY) ||
+         (ls->state == LOAD_STREAM_DONE)))
+    {
+        /*
+         * The file is being passed again. Load it once the read has
+         * finished.
+         */
+        ls->state = LOAD_STREAM_AFTER_READ;
+    }
+
+    switch (ls->state)
+    {
+        case LOAD_STREAM_UBOOT_HEADER:
+            if (available < UBOOT_DATA_OFF)
+                break;
+            if (!load_uboot_header(ls->image, available, &ls->header, false))
+            {
+                /*
+                 * Load the image after the read to report the error.
+                 */
+                ls->state = LOAD_STREAM_IMAGE;
+                break;
+            }
+            if (ls->header.compression == UBOOT_COMPRESSION_NONE)
+            {
+                if (load_regions_overlap(ls->header.load_to, ls->header.size,
+                                         ls->image,
+                                         UBOOT_DATA_OFF + ls->header.size) ||
+                    load_region_reserved(ls->header.load_to, ls->header.size))
+                {
+                    ls->state = LOAD_STREAM_AFTER_READ;
+                    break;
+                }
+                ls->in = UBOOT_DATA_OFF;
+                ls->state = LOAD_STREAM_COPY;
+                ls->phase = boot_profile_phase("copy", NULL);
+                load_stream_copy(ls, available);
+                break;
+            }
+            if (load_regions_overlap(ls->header.load_to, FLARE_EXECUTABLE_SIZE,
+                                     ls->image,
+                                     UBOOT_DATA_OFF + ls->header.size) ||
+                load_region_reserved(ls->header.load_to, 1))
+            {
+                ls->state = LOAD_STREAM_AFTER_READ;
+                break;
+            }
+            ls->state = LOAD_STREAM_GZIP_HEADER;
+            /* fall through */
+        case LOAD_STREAM_GZIP_HEADER:
+            end = UBOOT_DATA_OFF + ls->header.size;
+            if (end > available)
+                end = available;
+            switch (load_gzip_header(ls->image + UBOOT_DATA_OFF,
+                                     end - UBOOT_DATA_OFF, &ls->in))
+            {
+                case GZIP_HEADER_SHORT:
+                    return 0;
+                case GZIP_HEADER_INVALID:
+                    ls->state = LOAD_STREAM_AFTER_READ;
+                    return 0;
+                default:
+                    break;
+            }
+            ls->in += UBOOT_DATA_OFF;
+            ls->phase = boot_profile_phase("inflate", NULL);
+            ls->limit = load_region_limit(ls->header.load_to);
+            raw_inflate_begin(ls->header.load_to, ls->limit);
+            ls->state = LOAD_STREAM_INFLATE;
+            /* fall through */
+        case LOAD_STREAM_INFLATE:
+            end = UBOOT_DATA_OFF + ls->header.size;
+            if (end > available)
+                end = available;
+            if (end <= ls->in)
+                break;
+            boot_profile_resume(ls->phase);
+            ls->ze = raw_inflate(ls->image + ls->in, end - ls->in);
+            boot_profile_pause(ls->phase);
+            ls->in = end;
+            if (ls->ze == Z_STREAM_END)
+            {
+                ls->state = LOAD_STREAM_DONE;
+            }
+            else if (ls->ze != Z_OK)
+            {
+                /*
+                 * The output may have reached the JFFS2 region. The load
+                 * after the read checks the size and reports the error.
+                 */
+                if (ls->limit < FLARE_EXECUTABLE_SIZE)
+                {
+                    ls->state = LOAD_STREAM_AFTER_READ;
+                    return 0;
+                }
+                ls->state = LOAD_STREAM_ERROR;
+                return -1;
+            }
+            break;
+        case LOAD_STREAM_COPY:
+            load_stream_copy(ls, available);
+            break;
+        default:
+            break;
+    }
+
+    return 0;
+}
+
 bool
 load_exe(const boot_script* const script, uint32_t* entry_point)
 {
@@ -166,6 +498,14 @@ load_exe(const boot_script* const script, uint32_t* entry_point)
     int               rc;
     uint32_t          length = FLARE_EXECUTABLE_SIZE;
     uint8_t           checksum[CRC_CHECKSUM_SIZE];
+    boot_profile_id   stage;
+    bool              loaded;
+    load_stream       ls = {
+        .sink = { .handler = load_stream_data },
+        .state = LOAD_STREAM_UBOOT_HEADER,
+        .image = (const uint8_t*)FLARE_IMAGE_STAGE_ADDR,
+        .phase = -1
+    };
 
     printf("  Executable: %s", script->path);
     if (script->path[strlen(script->path) - 1] != '/') {
@@ -173,6 +513,9 @@ load_exe(const boot_script* const script, uint32_t* entry_point)
     }
     printf("%s ", script->executable);
 
+    ls.sink.crc = &crc;
+    crc32_clear(&crc);
+
     rc = flare_chdir(script->fs, script->path);
     if (rc != 0)
     {
@@ -180,16 +523,23 @@ load_exe(const boot_script* const script, uint32_t* entry_point)
         return false;
     }
 
+    stage = boot_profile_begin("read", NULL);
+    ls.sink.crc_phase = boot_profile_phase("crc", NULL);
     rc = flare_read_file(script->fs, script->executable,
-        (char*)FLARE_IMAGE_STAGE_ADDR, &length);
+        (char*)FLARE_IMAGE_STAGE_ADDR, &length, &ls.sink);
+    boot_profile_end(stage);
     if (rc != 0)
     {
-        printf("%s read: %d\n", error, rc);
+        if (ls.state == LOAD_STREAM_ERROR)
+            printf("%s %s uncompress failure: %d\n",
+                   error, ls.header.name, ls.ze);
+        else
+        {
+            printf("%s read: %d\n", error, rc);
+        }
         return false;
     }
 
-    crc32_clear(&crc);
-    crc32_update(&crc, (const void*)FLARE_IMAGE_STAGE_ADDR, length);
     crc32_str(&crc, checksum);
 
     printf("%s(CRC32: ", csum_valid ? "" : "[NOT CHECKED] ");
@@ -209,6 +559,34 @@ load_exe(const boot_script* const script, uint32_t* entry_point)
         }
     }
 
+    switch (ls.state)
+    {
+        case LOAD_STREAM_DONE:
+            load_uboot_header_print(&ls.header);
+            *entry_point = ls.header.entry_point;
+            return true;
+        case LOAD_STREAM_AFTER_READ:
+            load_uboot_header_print(&ls.header);
+            *entry_point = ls.header.entry_point;
+            stage = boot_profile_begin("place", NULL);
+            loaded = load_uboot_data((uint8_t*)FLARE_IMAGE_STAGE_ADDR,
+                                     &ls.header);
+            boot_profile_end(stage);
+            return loaded;
+        case LOAD_STREAM_GZIP_HEADER:
+        case LOAD_STREAM_INFLATE:
+            load_uboot_header_print(&ls.header);
+            printf("error: %s uncompress failure: %d\n",
+                   ls.header.name, Z_DATA_ERROR);
+            return false;
+        case LOAD_STREAM_COPY:
+            load_uboot_header_print(&ls.header);
+            printf("error: %s truncated\n", ls.header.name);
+            return false;
+        default:
+            break;
+    }
+
     return load_uboot_image((uint8_t*)FLARE_IMAGE_STAGE_ADDR, length,
                                      entry_point);
 }
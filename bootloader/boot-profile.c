@@ -0,0 +1,172 @@
+/*
+ * Copyright 2026 Contemporary Software
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+
+/*
+ * Boot Profile.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <boot-profile.h>
+
+#include <driver/timer/board-timer.h>
+
+#if FLARE_BOOT_PROFILE
+
+typedef struct {
+    const char* label;
+    const char* name;
+    uint32_t    depth;
+    uint32_t    count;
+    uint64_t    start;
+    uint64_t    elapsed;
+    uint64_t    interval;
+    bool        running;
+} boot_profile_record;
+
+static boot_profile_record records[BOOT_PROFILE_RECORDS];
+static int                 record_count;
+static uint32_t            depth;
+
+static boot_profile_id
+boot_profile_record_alloc(const char* label, const char* name)
+{
+    boot_profile_record* record;
+    if (record_count >= BOOT_PROFILE_RECORDS) {
+        return -1;
+    }
+    record = &records[record_count];
+    record->label = label;
+    record->name = name;
+    record->depth = depth;
+    record->count = 0;
+    record->start = 0;
+    record->elapsed = 0;
+    record->running = false;
+    return record_count++;
+}
+
+static bool
+boot_profile_valid(boot_profile_id id)
+{
+    return id >= 0 && id < record_count;
+}
+
+boot_profile_id
+boot_profile_begin(const char* label, const char* name)
+{
+    boot_profile_id id = boot_profile_record_alloc(label, name);
+    boot_profile_resume(id);
+    ++depth;
+    return id;
+}
+
+void
+boot_profile_end(boot_profile_id id)
+{
+    boot_profile_pause(id);
+    if (depth > 0) {
+        --depth;
+    }
+}
+
+boot_profile_id
+boot_profile_phase(const char* label, const char* name)
+{
+    return boot_profile_record_alloc(label, name);
+}
+
+void
+boot_profile_resume(boot_profile_id id)
+{
+    if (boot_profile_valid(id)) {
+        boot_profile_record* record = &records[id];
+        board_timer_get(&record->interval);
+        if (record->count == 0) {
+            record->start = record->interval;
+        }
+        record->running = true;
+    }
+}
+
+void
+boot_profile_pause(boot_profile_id id)
+{
+    if (boot_profile_valid(id) && records[id].running) {
+        boot_profile_record* record = &records[id];
+        uint64_t now;
+        board_timer_get(&now);
+        record->elapsed += now - record->interval;
+        ++record->count;
+        record->running = false;
+    }
+}
+
+void
+boot_profile_print(void)
+{
+    uint64_t now;
+    int      r;
+
+    board_timer_get(&now);
+
+    printf("     Profile: %-28s %10s %10s %6s\n",
+           "stage", "start-us", "time-us", "count");
+    for (r = 0; r < record_count; ++r) {
+        const boot_profile_record* record = &records[r];
+        int len = 0;
+        uint32_t d;
+        printf("              ");
+        for (d = 0; d < record->depth; ++d) {
+            printf("  ");
+            len += 2;
+        }
+        printf("%s", record->label);
+        len += strlen(record->label);
+        if (record->name != NULL) {
+            printf(" %s", record->name);
+            len += 1 + strlen(record->name);
+        }
+        while (len < 28) {
+            printf(" ");
+            ++len;
+        }
+        printf(" %10u %10u %6u\n",
+               (uint32_t) record->start, (uint32_t) record->elapsed,
+               record->count);
+    }
+    printf("              %-28s %10u\n", "handoff", (uint32_t) now);
+
+#if FLARE_BOOT_PROFILE_CSV
+    /*
+     * profile,<index>,<depth>,<label>,<name>,<start>,<time>,<count>
+     */
+    for (r = 0; r < record_count; ++r) {
+        const boot_profile_record* record = &records[r];
+        printf("profile,%d,%u,%s,%s,%u,%u,%u\n",
+               r, record->depth, record->label,
+               record->name != NULL ? record->name : "",
+               (uint32_t) record->start, (uint32_t) record->elapsed,
+               record->count);
+    }
+    printf("profile,%d,0,handoff,,%u,0,0\n", r, (uint32_t) now);
+#endif
+}
+
+#endif
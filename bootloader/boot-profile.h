@@ -0,0 +1,83 @@
+/*
+ * Copyright 2026 Contemporary Software
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+/*
+ * Boot Profile.
+ *
+ * Time the stages of the boot. A stage is timed from its begin to its end
+ * and can hold stages started while it is running. A phase accumulates the
+ * time of a number of intervals, for example the decompression of each
+ * piece of a file as it is read.
+ */
+
+#if !defined(BOOT_PROFILE_H)
+#define BOOT_PROFILE_H
+
+#include <stdint.h>
+
+#if !defined(FLARE_BOOT_PROFILE)
+#define FLARE_BOOT_PROFILE 1
+#endif
+
+/*
+ * Print the records as comma separated values after the table so the
+ * profile can be captured from the console.
+ */
+#if !defined(FLARE_BOOT_PROFILE_CSV)
+#define FLARE_BOOT_PROFILE_CSV 0
+#endif
+
+#define BOOT_PROFILE_RECORDS (32)
+
+typedef int boot_profile_id;
+
+#if FLARE_BOOT_PROFILE
+
+/*
+ * Begin a stage. The name is optional and must remain valid.
+ */
+boot_profile_id boot_profile_begin(const char* label, const char* name);
+
+/*
+ * End a stage.
+ */
+void boot_profile_end(boot_profile_id id);
+
+/*
+ * Create a phase. The time is accumulated by each resume and pause.
+ */
+boot_profile_id boot_profile_phase(const char* label, const char* name);
+
+void boot_profile_resume(boot_profile_id id);
+void boot_profile_pause(boot_profile_id id);
+
+/*
+ * Print the profile.
+ */
+void boot_profile_print(void);
+
+#else
+
+#define boot_profile_begin(label, name) (-1)
+#define boot_profile_end(id)            do { (void) (id); } while (0)
+#define boot_profile_phase(label, name) (-1)
+#define boot_profile_resume(id)         do { (void) (id); } while (0)
+#define boot_profile_pause(id)          do { (void) (id); } while (0)
+#define boot_profile_print()            do { } while (0)
+
+#endif
+
+#endif
@@ -62,7 +62,7 @@ int boot_script_load(flare_fs fs, const char* name, boot_script* bs) {
     memset(bs, 0, sizeof(*bs));
     bs->fs = fs;
 
-    rc = flare_read_file(fs, name, buffer, &length);
+    rc = flare_read_file(fs, name, buffer, &length, NULL);
     if (rc != 0)
     {
         printf("%s read: %d\n", error, rc);
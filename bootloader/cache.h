@@ -21,9 +21,13 @@
 #if !defined(CACHE_H)
 #define CACHE_H
 
+#include <stddef.h>
+
 void cache_flush(void);
 void cache_invalidate(void);
 void cache_flush_invalidate(void);
+void cache_flush_range(const void* begin, size_t size);
+void cache_invalidate_range(const void* begin, size_t size);
 void cache_disable_icache(void);
 void cache_disable_dcache(void);
 void cache_disable(void);
@@ -68,6 +68,13 @@ flare_datasafe_valid(void)
     return crc == datasafe->crc32;
 }
 
+uint32_t
+flare_datasafe_reset_reason(void)
+{
+    flare_datasafe *datasafe = (flare_datasafe*) FLARE_DS_BASE;
+    return datasafe->reset & FLARE_DS_RESET_MASK;
+}
+
 void
 flare_datasafe_set_boot(const char* path, const char* exe)
 {
@@ -177,3 +184,27 @@ flare_datasafe_clear_factory_boot_request(void)
     datasafe->crc32 = 0;
     crc32_update(&datasafe->crc32, FLARE_DS_CRC_BASE, FLARE_DS_CRC_LEN);
 }
+
+bool
+flare_datasafe_qspi_clock(uint32_t flash_id, uint32_t* setting)
+{
+    flare_datasafe *datasafe = (flare_datasafe*) FLARE_DS_BASE;
+    if (flare_datasafe_valid() &&
+        (datasafe->qspi_flash_id ==
+         (FLARE_DS_QSPI_CLOCK_VALID | (flash_id & FLARE_DS_QSPI_FLASH_ID)))) {
+        *setting = datasafe->qspi_clock;
+        return true;
+    }
+    return false;
+}
+
+void
+flare_datasafe_set_qspi_clock(uint32_t flash_id, uint32_t setting)
+{
+    flare_datasafe *datasafe = (flare_datasafe*) FLARE_DS_BASE;
+    datasafe->qspi_flash_id =
+        FLARE_DS_QSPI_CLOCK_VALID | (flash_id & FLARE_DS_QSPI_FLASH_ID);
+    datasafe->qspi_clock = setting;
+    datasafe->crc32 = 0;
+    crc32_update(&datasafe->crc32, FLARE_DS_CRC_BASE, FLARE_DS_CRC_LEN);
+}
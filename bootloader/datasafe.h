@@ -32,7 +32,13 @@
 #include <stdbool.h>
 #include <stdint.h>
 
-#define FLARE_DS_BASE     (0x00080000UL)
+#define FLARE_DS_ADDRESS  (0x00080000UL)
+#if FLARE_HOST
+#include <board.h>
+#define FLARE_DS_BASE     BOARD_MEMORY(FLARE_DS_ADDRESS)
+#else
+#define FLARE_DS_BASE     FLARE_DS_ADDRESS
+#endif
 #define FLARE_DS_CRC_BASE ((const unsigned char*)(FLARE_DS_BASE + 2*sizeof(uint32_t)))
 #define FLARE_DS_CRC_LEN  (sizeof(flare_datasafe) - 2*sizeof(uint32_t))
 
@@ -67,11 +73,17 @@
 #define FLARE_DS_RESET_EXT (1 << 27) /* External reset */
 #define FLARE_DS_RESET_ERR (1 << 26) /* Unknown or unsupported reset */
 
+/*
+ * QSPI clock flash ID bit masks
+ */
+#define FLARE_DS_QSPI_CLOCK_VALID (1 << 31) /* The QSPI clock is calibrated */
+#define FLARE_DS_QSPI_FLASH_ID    (0xFFFFFF) /* JEDEC ID of the flash */
+
 /*
  * The data safe.
  *
  * Definitions of the data safe can be found in datasafe.txt.
- * This is datasafe version 1
+ * This is datasafe version 2
  */
 typedef struct
 {
@@ -103,6 +115,8 @@ typedef struct
     char                  app_data[FLARE_DS_FACTORY_APP_DETAILS_SIZE];
     char                  boot_cmd[FLARE_DS_FACTORY_APP_DETAILS_SIZE];
     uint32_t              error_trace[FLARE_DS_ERROR_TRACE_LEN];
+    uint32_t              qspi_flash_id;
+    uint32_t              qspi_clock;
 } flare_datasafe;
 
 /*
@@ -111,6 +125,11 @@ typedef struct
  */
 void flare_datasafe_init();
 
+/*
+ * The reset reason, one of the FLARE_DS_RESET values.
+ */
+uint32_t flare_datasafe_reset_reason(void);
+
 /*
  * Set the boot path and loader.
  */
@@ -166,4 +185,15 @@ void flare_datasafe_clear_factory_boot_request(void);
  */
 bool flare_datasafe_factory_boot_requested(void);
 
+/*
+ * Get the QSPI clock setting calibrated for the flash with the JEDEC ID.
+ * Returns false if the flash has not been calibrated.
+ */
+bool flare_datasafe_qspi_clock(uint32_t flash_id, uint32_t* setting);
+
+/*
+ * Set the QSPI clock setting calibrated for the flash with the JEDEC ID.
+ */
+void flare_datasafe_set_qspi_clock(uint32_t flash_id, uint32_t setting);
+
 #endif
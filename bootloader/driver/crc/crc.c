@@ -20,8 +20,19 @@
  * @brief Defines utility functions and data structures related to CRC32 useful throughout the SDK.
  */
 
+#include <stdbool.h>
+
 #include "crc.h"
 
+/*
+ * Other hosts, for example the CRC benchmark, provide a model of the
+ * instructions.
+ */
+#if CRC32_ARMV8 && defined(__aarch64__)
+#include <arm_acle.h>
+#endif
+
+#if !CRC32_ARMV8 || CRC32_ALL_ENGINES
 static const uint32_t table[256] = {
     0x00000000L, 0x77073096L, 0xee0e612cL, 0x990951baL, 0x076dc419L, 0x706af48fL, 0xe963a535L,
     0x9e6495a3L, 0x0edb8832L, 0x79dcb8a4L, 0xe0d5e91eL, 0x97d2d988L, 0x09b64c2bL, 0x7eb17cbdL,
@@ -60,18 +71,232 @@ static const uint32_t table[256] = {
     0x47b2cf7fL, 0x30b5ffe9L, 0xbdbdf21cL, 0xcabac28aL, 0x53b39330L, 0x24b4a3a6L, 0xbad03605L,
     0xcdd70693L, 0x54de5729L, 0x23d967bfL, 0xb3667a2eL, 0xc4614ab8L, 0x5d681b02L, 0x2a6f2b94L,
     0xb40bbe37L, 0xc30c8ea1L, 0x5a05df1bL, 0x2d02ef8dUL};
+#endif
+
+/*
+ * The slicing engines process 8 or 16 bytes per step with a table for each
+ * byte position. The tables are derived from the byte table on first use.
+ * The benchmark builds all the engines.
+ */
+#if CRC32_ALL_ENGINES
+#define CRC32_SLICE_TABLES 16
+#elif CRC32_ARMV8
+#define CRC32_SLICE_TABLES 1
+#else
+#define CRC32_SLICE_TABLES CRC32_SLICE
+#endif
+
+#if CRC32_SLICE_TABLES > 1 && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "CRC32 slicing engines are little endian only"
+#endif
+
+typedef uint32_t __attribute__((__may_alias__)) crc32_word;
+
+#if !CRC32_ARMV8 || CRC32_ALL_ENGINES
+static uint32_t crc32_bytes(uint32_t crc, const uint8_t* p, size_t len) {
+    while (len-- != 0) {
+        crc = table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+#endif
+
+#if CRC32_SLICE_TABLES > 1
+static uint32_t slice_table[CRC32_SLICE_TABLES][256];
+static bool slice_table_ready;
+
+static void crc32_slice_init(void) {
+    int n;
+    int k;
+    for (n = 0; n < 256; n++) {
+        uint32_t c = table[n];
+        slice_table[0][n] = c;
+        for (k = 1; k < CRC32_SLICE_TABLES; k++) {
+            c = table[c & 0xff] ^ (c >> 8);
+            slice_table[k][n] = c;
+        }
+    }
+    slice_table_ready = true;
+}
+
+static const uint8_t* crc32_align(uint32_t* crc, const uint8_t* p, size_t* len) {
+    size_t head = (sizeof(crc32_word) - ((uintptr_t) p & (sizeof(crc32_word) - 1))) &
+        (sizeof(crc32_word) - 1);
+    if (head > *len) {
+        head = *len;
+    }
+    *crc = crc32_bytes(*crc, p, head);
+    *len -= head;
+    return p + head;
+}
+
+#define CRC32_SLICE_WORD(t, w)                     \
+    (slice_table[(t) + 3][(w) & 0xff] ^            \
+     slice_table[(t) + 2][((w) >> 8) & 0xff] ^     \
+     slice_table[(t) + 1][((w) >> 16) & 0xff] ^    \
+     slice_table[(t)][(w) >> 24])
+#endif
+
+#if (CRC32_SLICE == 8 && !CRC32_ARMV8) || CRC32_ALL_ENGINES
+static uint32_t crc32_slice8(uint32_t crc, const uint8_t* p, size_t len) {
+    if (!slice_table_ready) {
+        crc32_slice_init();
+    }
+    p = crc32_align(&crc, p, &len);
+    while (len >= 8) {
+        const crc32_word* w = (const crc32_word*) p;
+        uint32_t one = w[0] ^ crc;
+        uint32_t two = w[1];
+        crc = CRC32_SLICE_WORD(4, one) ^ CRC32_SLICE_WORD(0, two);
+        p += 8;
+        len -= 8;
+    }
+    return crc32_bytes(crc, p, len);
+}
+#endif
+
+#if (CRC32_SLICE == 16 && !CRC32_ARMV8) || CRC32_ALL_ENGINES
+static uint32_t crc32_slice16(uint32_t crc, const uint8_t* p, size_t len) {
+    if (!slice_table_ready) {
+        crc32_slice_init();
+    }
+    p = crc32_align(&crc, p, &len);
+    while (len >= 16) {
+        const crc32_word* w = (const crc32_word*) p;
+        uint32_t one = w[0] ^ crc;
+        uint32_t two = w[1];
+        uint32_t three = w[2];
+        uint32_t four = w[3];
+        crc = CRC32_SLICE_WORD(12, one) ^ CRC32_SLICE_WORD(8, two) ^
+            CRC32_SLICE_WORD(4, three) ^ CRC32_SLICE_WORD(0, four);
+        p += 16;
+        len -= 16;
+    }
+    return crc32_bytes(crc, p, len);
+}
+#endif
+
+#if CRC32_ARMV8
+/*
+ * ARMv8 CRC32 instructions. A block of three streams is processed with the
+ * streams interleaved so each CRC instruction does not wait for the result
+ * of the one before it. The stream CRCs are combined by shifting the
+ * earlier streams over the later ones, that is multiplying by x^(8 *
+ * CRC32_ARMV8_STREAM) modulo the polynomial. The shift is linear so it is
+ * a table per byte of the CRC.
+ */
+#define CRC32_ARMV8_STREAM (512)
+#define CRC32_ARMV8_BLOCK  (3 * CRC32_ARMV8_STREAM)
+
+typedef uint64_t __attribute__((__may_alias__)) crc32_dword;
+
+static uint32_t armv8_shift_table[4][256];
+static bool armv8_shift_table_ready;
+
+static uint32_t crc32_multmodp(uint32_t a, uint32_t b) {
+    uint32_t m = 1U << 31;
+    uint32_t p = 0;
+    for (;;) {
+        if ((a & m) != 0) {
+            p ^= b;
+            if ((a & (m - 1)) == 0) {
+                break;
+            }
+        }
+        m >>= 1;
+        b = (b & 1) != 0 ? (b >> 1) ^ 0xedb88320 : b >> 1;
+    }
+    return p;
+}
+
+static void crc32_armv8_init(void) {
+    uint32_t shift = 1U << 31;
+    int i;
+    int n;
+    /*
+     * Running the CRC over zeros from x^0 gives x^(8 * length).
+     */
+    for (i = 0; i < CRC32_ARMV8_STREAM; i++) {
+        shift = __crc32b(shift, 0);
+    }
+    for (i = 0; i < 4; i++) {
+        for (n = 0; n < 256; n++) {
+            armv8_shift_table[i][n] = crc32_multmodp(shift, ((uint32_t) n) << (8 * i));
+        }
+    }
+    armv8_shift_table_ready = true;
+}
+
+static inline uint32_t crc32_armv8_shift(uint32_t crc) {
+    return armv8_shift_table[0][crc & 0xff] ^
+        armv8_shift_table[1][(crc >> 8) & 0xff] ^
+        armv8_shift_table[2][(crc >> 16) & 0xff] ^
+        armv8_shift_table[3][crc >> 24];
+}
+
+static uint32_t crc32_armv8(uint32_t crc, const uint8_t* p, size_t len) {
+    while ((len != 0) && (((uintptr_t) p & (sizeof(crc32_dword) - 1)) != 0)) {
+        crc = __crc32b(crc, *p++);
+        --len;
+    }
+    if (len >= CRC32_ARMV8_BLOCK) {
+        if (!armv8_shift_table_ready) {
+            crc32_armv8_init();
+        }
+        while (len >= CRC32_ARMV8_BLOCK) {
+            const crc32_dword* s0 = (const crc32_dword*) p;
+            const crc32_dword* s1 = (const crc32_dword*) (p + CRC32_ARMV8_STREAM);
+            const crc32_dword* s2 = (const crc32_dword*) (p + (2 * CRC32_ARMV8_STREAM));
+            uint32_t crc1 = 0;
+            uint32_t crc2 = 0;
+            size_t i;
+            for (i = 0; i < (CRC32_ARMV8_STREAM / sizeof(crc32_dword)); i++) {
+                crc = __crc32d(crc, s0[i]);
+                crc1 = __crc32d(crc1, s1[i]);
+                crc2 = __crc32d(crc2, s2[i]);
+            }
+            crc = crc32_armv8_shift(crc32_armv8_shift(crc) ^ crc1) ^ crc2;
+            p += CRC32_ARMV8_BLOCK;
+            len -= CRC32_ARMV8_BLOCK;
+        }
+    }
+    while (len >= sizeof(crc32_dword)) {
+        crc = __crc32d(crc, *(const crc32_dword*) p);
+        p += sizeof(crc32_dword);
+        len -= sizeof(crc32_dword);
+    }
+    if (len >= sizeof(crc32_word)) {
+        crc = __crc32w(crc, *(const crc32_word*) p);
+        p += sizeof(crc32_word);
+        len -= sizeof(crc32_word);
+    }
+    while (len-- != 0) {
+        crc = __crc32b(crc, *p++);
+    }
+    return crc;
+}
+#endif
+
+uint32_t crc32_raw(uint32_t crc, const void* data, size_t len) {
+#if CRC32_ARMV8
+    return crc32_armv8(crc, data, len);
+#elif CRC32_SLICE == 16
+    return crc32_slice16(crc, data, len);
+#elif CRC32_SLICE == 8
+    return crc32_slice8(crc, data, len);
+#elif CRC32_SLICE == 1
+    return crc32_bytes(crc, data, len);
+#else
+#error "CRC32_SLICE must be 1, 8 or 16"
+#endif
+}
 
 void crc32_clear(CRC32* crc) {
     *crc = 0;
 }
 
 void crc32_update(CRC32* crc, const unsigned char* data, int len) {
-    uint32_t value = *crc;
-    value = ~value;
-    while (len-- != 0) {
-        value = table[(value ^ *data++) & 0xff] ^ (value >> 8);
-    }
-    *crc = ~value;
+    *crc = ~crc32_raw(~*crc, data, len);
 }
 
 void crc32_str(CRC32* crc, unsigned char* data) {
@@ -23,9 +23,39 @@
 #ifndef PIXIESDK_UTIL_CRC_HPP
 #define PIXIESDK_UTIL_CRC_HPP
 
+#include <stddef.h>
 #include <stdint.h>
 
 #define CRC_CHECKSUM_SIZE   8
+
+/**
+ * @brief Selects the CRC32 engine
+ *
+ * 1 is the compact byte table engine, 8 and 16 are the slicing-by-8 and
+ * slicing-by-16 engines. The slicing engines use 8K or 16K of RAM for
+ * tables built on first use.
+ */
+#if !defined(CRC32_SLICE)
+ #if SIZE_OVER_SPEED
+  #define CRC32_SLICE 1
+ #else
+  #define CRC32_SLICE 8
+ #endif
+#endif
+
+/**
+ * @brief Use the ARMv8 CRC32 instructions
+ *
+ * The default is on if the compiler targets a core with the CRC32
+ * extension, for example -mcpu=cortex-a53. The table engine is not used.
+ */
+#if !defined(CRC32_ARMV8)
+ #if defined(__ARM_FEATURE_CRC32) && defined(__aarch64__)
+  #define CRC32_ARMV8 1
+ #else
+  #define CRC32_ARMV8 0
+ #endif
+#endif
 /**
  * @brief Defines a function for a CRC32 checksum
  *
@@ -36,6 +66,14 @@
  */
 typedef uint32_t CRC32;
 
+/**
+ * @brief Update a raw CRC32
+ *
+ * No pre or post conditioning is applied. This is the CRC32 JFFS2 uses and
+ * the engine the other calls use.
+ */
+uint32_t crc32_raw(uint32_t crc, const void* data, size_t len);
+
 void crc32_clear(CRC32* crc);
 
 void crc32_update(CRC32* crc, const unsigned char* data, int len);
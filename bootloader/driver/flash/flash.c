@@ -18,6 +18,8 @@
 #include <unistd.h>
 #include <stdio.h>
 
+#include <driver/crc/crc.h>
+
 #include "flash.h"
 #if FLARE_VERSAL
 #include "versal-flash.h"
@@ -41,6 +43,10 @@
  #else
   #define FLASH_READ_CMD        0x13
  #endif
+ #define FLASH_DUAL_OUT_READ_CMD 0x3C
+ #define FLASH_QUAD_OUT_READ_CMD 0x6C
+ #define FLASH_DUAL_IO_READ_CMD  0xBC
+ #define FLASH_QUAD_IO_READ_CMD  0xEC
  #define FLASH_SEC_ERASE_CMD    0xDC
 #else
  #define FLASH_ADDRESS_SIZE     3
@@ -50,6 +56,10 @@
  #else
   #define FLASH_READ_CMD        0x03
  #endif
+ #define FLASH_DUAL_OUT_READ_CMD 0x3B
+ #define FLASH_QUAD_OUT_READ_CMD 0x6B
+ #define FLASH_DUAL_IO_READ_CMD  0xBB
+ #define FLASH_QUAD_IO_READ_CMD  0xEB
  #define FLASH_SEC_ERASE_CMD    0xD8
 #endif
 
@@ -61,6 +71,118 @@
 #define FLASH_BULK_ERASE_CMD        0xC7
 #define FLASH_READ_ID               0x9F
 #define FLASH_READ_STATUS_FLAG_CMD  0x70
+#define FLASH_READ_SFDP_CMD         0x5A
+
+/*
+ * Spansion configuration register quad enable.
+ */
+#define FLASH_CR_QUAD  (1 << 1)
+
+/*
+ * The longest a program or erase status poll runs before the wait handler
+ * is called.
+ */
+#define FLASH_WAIT_POLL_USECS (100000)
+
+/*
+ * Clock calibration checks a CRC of the start of the flash. The boot image
+ * header and code there are a good mix of bits. A blank or uniform start
+ * reads the same at any delay so the reference must have at least
+ * FLASH_CALIBRATE_CHANGES_MIN bytes that differ from the byte before them.
+ * If it does not the part's SFDP tables are the reference.
+ */
+#define FLASH_CALIBRATE_LENGTH      (4096)
+#define FLASH_CALIBRATE_SFDP_LENGTH (256)
+#define FLASH_CALIBRATE_CHUNK       (256)
+#define FLASH_CALIBRATE_CHANGES_MIN (64)
+
+/*
+ * The fastest read clock of a part in MHz. A part set up from its SFDP
+ * tables uses FLASH_CLOCK_SFDP_MHZ, JESD216 does not hold the clock. Set
+ * FLASH_CLOCK_MAX_MHZ to limit all parts.
+ */
+#if !defined(FLASH_CLOCK_SFDP_MHZ)
+#define FLASH_CLOCK_SFDP_MHZ (104)
+#endif
+
+/*
+ * Read mode defaults.
+ */
+#if !defined(FLASH_READ_MODE)
+#define FLASH_READ_MODE FLASH_READ_MODE_SINGLE
+#endif
+
+/*
+ * JESD216 serial flash discoverable parameters. The SFDP read command always
+ * has a 3 byte address and 8 dummy clocks.
+ */
+#define FLASH_SFDP_SIGNATURE   0x50444653 /* "SFDP" */
+#define FLASH_SFDP_HEADER_SIZE 8
+#define FLASH_SFDP_BFPT_ID     0xff00     /* Basic flash parameter table */
+#define FLASH_SFDP_4BAIT_ID    0xff84     /* 4-byte address instruction table */
+#define FLASH_SFDP_BFPT_DWORDS 16
+#define FLASH_SFDP_SEC_ERASE   0xD8       /* 3 byte address sector erase */
+
+/*
+ * The read command and lanes for each read mode.
+ */
+typedef struct
+{
+    uint8_t command;
+    uint8_t addr_lanes;
+    uint8_t data_lanes;
+} flash_read_op;
+
+static const flash_read_op flash_read_ops[FLASH_READ_MODES] =
+{
+    { FLASH_READ_CMD,          1, 1 },
+    { FLASH_DUAL_OUT_READ_CMD, 1, 2 },
+    { FLASH_QUAD_OUT_READ_CMD, 1, 4 },
+    { FLASH_DUAL_IO_READ_CMD,  2, 2 },
+    { FLASH_QUAD_IO_READ_CMD,  4, 4 }
+};
+
+/*
+ * A part's read support. The dummy cycles are the clocks between the address
+ * and the data, including any mode bit clocks, at the part's default
+ * latency. The single mode uses flash_read_dummies.
+ */
+typedef enum
+{
+    FLASH_QE_NONE,     /* Quad is always enabled */
+    FLASH_QE_CR_BIT1   /* Spansion configuration register QUAD bit */
+} flash_quad_enable;
+
+typedef struct
+{
+    uint32_t          modes;  /* Mask of (1 << FLASH_READ_MODE_*) */
+    uint8_t           dummy_cycles[FLASH_READ_MODES];
+    flash_quad_enable quad_enable;
+    uint32_t          max_mhz;
+    uint8_t           commands[FLASH_READ_MODES]; /* 0 is flash_read_ops */
+} flash_read_part;
+
+static const flash_read_part flash_read_single =
+{
+    1 << FLASH_READ_MODE_SINGLE, { 0, 0, 0, 0, 0 }, FLASH_QE_NONE, 50
+};
+
+static const flash_read_part flash_read_spansion =
+{
+    0x1f, { 0, 8, 8, 4, 6 }, FLASH_QE_CR_BIT1, 104
+};
+
+static const flash_read_part flash_read_micron =
+{
+    0x1f, { 0, 8, 8, 8, 10 }, FLASH_QE_NONE, 108
+};
+
+/*
+ * A part not in the ID table is set up from its SFDP tables.
+ */
+static flash_read_part flash_read_sfdp;
+static bool            flash_sfdp;
+static char            flash_sfdp_label[48];
 
 /*
  * A write buffer.
@@ -73,6 +195,36 @@ static flash_transfer_buffer flash_buf_;
  */
 static uint64_t      flash_size;
 static uint32_t      flash_read_dummies;
+static uint32_t      flash_read_mode;
+static uint32_t      flash_read_command = FLASH_READ_CMD;
+static uint32_t      flash_read_cycles;
+static uint32_t      flash_max_mhz;
+#if FLASH_LINEAR_READ
+static bool          flash_linear;
+#endif
+
+#if FLASH_DMA_READ
+/*
+ * Reads use the DMA. The DMA check clears it to read through the RX FIFO.
+ * The check's buffers start FLASH_DMA_CHECK_HEAD bytes before a cache line
+ * boundary and the read stops FLASH_DMA_CHECK_TAIL bytes before the end.
+ */
+#define FLASH_DMA_CHECK_SIZE  (4 * 1024)
+#define FLASH_DMA_CHECK_HEAD  (13)
+#define FLASH_DMA_CHECK_TAIL  (27)
+#define FLASH_DMA_CHECK_GUARD (0xa5)
+
+static bool          flash_dma_read = true;
+#endif
+
+/*
+ * Dual parallel devices. Each device holds alternate bytes, the controller
+ * stripes the data and the device address is half the flash address.
+ */
+static bool          flash_parallel;
+static uint32_t      flash_comm_all = FLASH_COMM_METHOD_ALL;
+static uint32_t      flash_comm_reg = FLASH_COMM_METHOD_SINGLE;
+static char          flash_label[64];
 static uint32_t      flash_erase_sector_size;
 static uint32_t      flash_page_size;
 static size_t        flash_num_regions;
@@ -81,9 +233,11 @@ static uint8_t*      flash_erase_buffer;
 static size_t        flash_erase_buffer_size;
 
 /*
- * Initialised state.
+ * Initialised state. The controller is initialised while a session is
+ * open and transfers skip the controller set up.
  */
-static bool initialised = false;
+static bool     initialised = false;
+static uint32_t flash_session;
 
 /*
  * Wait handler.
@@ -103,7 +257,39 @@ static bool flash_trace = 1;
 static size_t   cfi_length;
 static uint8_t* cfi_data;
 
+/*
+ * A register read returns two bytes. In parallel there is one byte from
+ * each device. Any is set if either device's bit is set and all is set if
+ * both devices' bits are set.
+ */
+static inline uint16_t
+flash_StatusAny(uint16_t value)
+{
+    if (flash_parallel)
+        return (value | (value >> 8)) & 0xff;
+    return value & 0xff;
+}
+
+static inline uint16_t
+flash_StatusAll(uint16_t value)
+{
+    if (flash_parallel)
+        return (value & (value >> 8)) & 0xff;
+    return value & 0xff;
+}
+
+static inline uint32_t
+flash_DeviceAddress(uint32_t address)
+{
+    return flash_parallel ? address / 2 : address;
+}
+
 static flash_error flash_readCFI(void);
+static flash_error flash_SfdpRegions(void);
+static flash_error flash_ReadIdFrom(uint32_t  comm_method,
+                                   uint32_t* manufactureCode,
+                                   uint32_t* memIfaceType,
+                                   uint32_t* density);
 
 void
 flash_transfer_trace(const char*                  message,
@@ -147,6 +333,12 @@ flash_Get16(const uint8_t* data)
     return (((uint16_t) data[1]) << 8) | data[0];
 }
 
+static inline uint32_t
+flash_Get32(const uint8_t* data)
+{
+    return (((uint32_t) flash_Get16(data + 2)) << 16) | flash_Get16(data);
+}
+
 static void
 flash_TransferBuffer_Clear(flash_transfer_buffer* transfer)
 {
@@ -154,6 +346,11 @@ flash_TransferBuffer_Clear(flash_transfer_buffer* transfer)
     transfer->padding = 0;
     transfer->in = 0;
     transfer->out = 0;
+    transfer->addr_lanes = 1;
+    transfer->data_lanes = 1;
+    transfer->dummy_cycles = 0;
+    transfer->payload = NULL;
+    transfer->payload_length = 0;
 }
 
 static void
@@ -286,11 +483,54 @@ static void flash_TransferBuffer_SetCommMethod(flash_transfer_buffer* transfer,
     transfer->comm_method = comm_method;
 }
 
+static void flash_TransferBuffer_SetPayload(flash_transfer_buffer* transfer,
+                                            void*                  payload,
+                                            size_t                 length)
+{
+    transfer->payload = payload;
+    transfer->payload_length = length;
+}
+
+static void flash_TransferBuffer_SetLanes(flash_transfer_buffer* transfer,
+                                          uint32_t               addr_lanes,
+                                          uint32_t               data_lanes,
+                                          uint32_t               dummy_cycles)
+{
+    transfer->addr_lanes = addr_lanes;
+    transfer->data_lanes = data_lanes;
+    transfer->dummy_cycles = dummy_cycles;
+}
+
 static flash_error flash_SetRegions(void)
 {
+  if (flash_sfdp)
+    return flash_SfdpRegions();
   return flash_readCFI();
 }
 
+/*
+ * Sessions nest. The first opens the controller and the last closes it.
+ */
+static void
+flash_SessionBegin(void)
+{
+    if (flash_session++ == 0)
+    {
+        flash_SessionOpen();
+        initialised = true;
+    }
+}
+
+static void
+flash_SessionEnd(void)
+{
+    if (--flash_session == 0)
+    {
+        initialised = false;
+        flash_SessionClose();
+    }
+}
+
 static flash_error
 flash_readRegister(uint8_t reg, uint16_t* value)
 {
@@ -303,7 +543,7 @@ flash_readRegister(uint8_t reg, uint16_t* value)
     flash_TransferBuffer_Set8(flash_buf, 0);
     flash_TransferBuffer_SetDir(flash_buf, FLASH_RX_TRANS);
     flash_TransferBuffer_SetCommandLen(flash_buf, FLASH_COMMAND_SIZE);
-    flash_TransferBuffer_SetCommMethod(flash_buf, FLASH_COMM_METHOD_SINGLE);
+    flash_TransferBuffer_SetCommMethod(flash_buf, flash_comm_reg);
 
     fe = flash_Transfer(flash_buf, initialised);
     if (fe != FLASH_NO_ERROR)
@@ -314,6 +554,39 @@ flash_readRegister(uint8_t reg, uint16_t* value)
     return FLASH_NO_ERROR;
 }
 
+/*
+ * Write register values. The values are in the form a register read
+ * returns. In parallel the data is striped so each byte is sent twice, the
+ * lower device's byte from the high byte of the value and the upper
+ * device's byte from the low byte, and each device gets its own value.
+ */
+static flash_error
+flash_writeRegister(uint8_t reg, const uint16_t* values, size_t count)
+{
+    size_t v;
+
+    flash_TransferBuffer_Clear(flash_buf);
+    flash_TransferBuffer_SetLength(flash_buf,
+                                   FLASH_COMMAND_SIZE + (flash_parallel ? 2 : 1) * count);
+    flash_TransferBuffer_Set8(flash_buf, reg);
+    for (v = 0; v < count; ++v)
+    {
+        if (flash_parallel)
+            flash_TransferBuffer_Set8(flash_buf, values[v] >> 8);
+        flash_TransferBuffer_Set8(flash_buf, values[v] & 0xff);
+    }
+    flash_TransferBuffer_SetDir(flash_buf, FLASH_TX_TRANS);
+    flash_TransferBuffer_SetCommandLen(flash_buf, FLASH_COMMAND_SIZE);
+    flash_TransferBuffer_SetCommMethod(flash_buf, flash_comm_reg);
+
+    return flash_Transfer(flash_buf, initialised);
+}
+
+/*
+ * The same register value for each device.
+ */
+#define FLASH_REGISTER_ALL(value) ((uint16_t) (((value) << 8) | (value)))
+
 static flash_error
 flash_WaitForWrite(uint32_t wait)
 {
@@ -326,11 +599,23 @@ flash_WaitForWrite(uint32_t wait)
         if (wait_Handler != NULL)
             wait_Handler(wait_Handler_User);
 
+        /*
+         * The controller polls the write in progress bit. A poll that times
+         * out returns here so the wait handler is called.
+         */
+        fe = flash_PollStatus(flash_comm_reg, FLASH_READ_STATUS_CMD,
+                              FLASH_SR_WIP, 0, FLASH_WAIT_POLL_USECS,
+                              initialised);
+        if (fe == FLASH_POLL_TIMEOUT)
+            continue;
+        if (fe != FLASH_NO_ERROR)
+            return fe;
+
         fe = flash_readRegister(FLASH_READ_STATUS_FLAG_CMD, &status);
         if (fe != FLASH_NO_ERROR)
             return fe;
 
-        status = status & 0xFF;
+        status = flash_StatusAny(status);
 
         if ((status & FLASH_SR_E_ERR) != 0)
             return FLASH_ERASE_FAILURE;
@@ -342,7 +627,7 @@ flash_WaitForWrite(uint32_t wait)
          * received the flash device.
          */
         fe = flash_readRegister(FLASH_READ_STATUS_CMD, &status);
-        status = status & 0xFF;
+        status = flash_StatusAny(status);
         if (fe != FLASH_NO_ERROR)
             return fe;
 
@@ -374,7 +659,7 @@ flash_SetWEL(void)
     flash_TransferBuffer_Set8(flash_buf, FLASH_WRITE_ENABLE_CMD);
     flash_TransferBuffer_SetDir(flash_buf, FLASH_TX_TRANS);
     flash_TransferBuffer_SetCommandLen(flash_buf, FLASH_COMMAND_SIZE);
-    flash_TransferBuffer_SetCommMethod(flash_buf, FLASH_COMM_METHOD_SINGLE);
+    flash_TransferBuffer_SetCommMethod(flash_buf, flash_comm_reg);
 
     fe = flash_Transfer(flash_buf, initialised);
     if (fe != FLASH_NO_ERROR)
@@ -384,7 +669,7 @@ flash_SetWEL(void)
     if (fe != FLASH_NO_ERROR)
         return fe;
 
-    if ((status & FLASH_SR_WEL) == 0)
+    if ((flash_StatusAll(status) & FLASH_SR_WEL) == 0)
         return FLASH_READ_ONLY;
 
     return FLASH_NO_ERROR;
@@ -401,7 +686,7 @@ flash_ClearWEL(void)
     flash_TransferBuffer_Set8(flash_buf, FLASH_WRITE_DISABLE_CMD);
     flash_TransferBuffer_SetDir(flash_buf, FLASH_TX_TRANS);
     flash_TransferBuffer_SetCommandLen(flash_buf, FLASH_COMMAND_SIZE);
-    flash_TransferBuffer_SetCommMethod(flash_buf, FLASH_COMM_METHOD_SINGLE);
+    flash_TransferBuffer_SetCommMethod(flash_buf, flash_comm_reg);
 
     fe = flash_Transfer(flash_buf, initialised);
     if (fe != FLASH_NO_ERROR)
@@ -411,7 +696,7 @@ flash_ClearWEL(void)
     if (fe != FLASH_NO_ERROR)
         return fe;
 
-    if ((status & FLASH_SR_WEL) != 0)
+    if ((flash_StatusAny(status) & FLASH_SR_WEL) != 0)
         return FLASH_WRITE_LATCH_CLEAR_FAIL;
 
     return FLASH_NO_ERROR;
@@ -496,6 +781,16 @@ flash_readCFI(void)
         }
         flash_erase_sector_size = flash_erase_buffer_size;
 
+        if (flash_parallel)
+        {
+            flash_page_size *= 2;
+            flash_size *= 2;
+            flash_erase_sector_size *= 2;
+            flash_erase_buffer_size *= 2;
+            for (region = 0; region < flash_num_regions; ++region)
+                flash_regions[region].size *= 2;
+        }
+
         if (flash_erase_buffer_size)
         {
             flash_erase_buffer = FLASH_WORKSPACE_ALLOC(FLASH_WS_ERASE_BUFFER);
@@ -568,247 +863,948 @@ flash_get_regions(flash_region** regions, size_t* size)
     return FLASH_NO_ERROR;
 }
 
-flash_error flash_open(const char** label) {
-    uint8_t     buffer[64];
-    uint32_t    manufacture_code;
-    uint32_t    mem_iface_type;
-    uint32_t    density;
+/*
+ * Read SFDP data from the first device.
+ */
+static flash_error
+flash_SfdpRead(uint32_t address, uint8_t* data, size_t length)
+{
     flash_error fe;
-    bool        found = false;
-
-    if (label == NULL) {
-        return FLASH_INVALID_DEVICE;
-    }
 
-    *label = NULL;
+    flash_TransferBuffer_Clear(flash_buf);
+    flash_TransferBuffer_SetLength(flash_buf, FLASH_COMMAND_SIZE + 3 + 1 + length);
+    flash_TransferBuffer_Set8(flash_buf, FLASH_READ_SFDP_CMD);
+    flash_TransferBuffer_Set8(flash_buf, (address >> 16) & 0xff);
+    flash_TransferBuffer_Set8(flash_buf, (address >> 8) & 0xff);
+    flash_TransferBuffer_Set8(flash_buf, address & 0xff);
+    fe = flash_TransferBuffer_Fill(flash_buf, 0x00, 1 + length);
+    flash_TransferBuffer_SetDir(flash_buf, FLASH_RX_TRANS);
+    flash_TransferBuffer_SetCommandLen(flash_buf, FLASH_COMMAND_SIZE + 3 + 1);
+    flash_TransferBuffer_SetCommMethod(flash_buf, FLASH_COMM_METHOD_SINGLE);
+    if (fe != FLASH_NO_ERROR)
+        return fe;
 
-    fe = flash_read_id(&manufacture_code,
-                      &mem_iface_type,
-                      &density);
+    fe = flash_Transfer(flash_buf, initialised);
     if (fe != FLASH_NO_ERROR)
-    {
-        printf("flash: device id read failed: %d\n", fe);
         return fe;
-    }
 
-    switch (manufacture_code) {
-        case 1:
-            if ((mem_iface_type == 0x20) && (density == 0x18))
-            {
-                *label = "S25FL128P_64K (16MiB)";
-                flash_size = 16UL * 1024UL * 1024UL;
-                flash_erase_sector_size = 64UL * 1024UL;
-                flash_page_size = 256;
-                found = true;
-            }
-            else if ((mem_iface_type == 0x02) && (density == 0x20))
-            {
-                *label = "S25FL512S_256K (64MiB)";
-                flash_size = 64UL * 1024UL * 1024UL;
-                flash_erase_sector_size = 256UL * 1024UL;
-                flash_page_size = 256;
-                found = true;
-            }
-            break;
-        case  0x20:
-            switch (density) {
-                case 0x18:
-                    *label = "1x MT25QL128ABA";
-                    flash_size = 0x1000000; /* 128 Mb on one flash */
-                    flash_erase_sector_size = 0x10000UL;
-                    flash_page_size = 256;
-                    found = true;
-                    break;
-                case 0x19:
-                    *label = "1x N25Q256A";
-                    flash_size = 0x2000000; /* 256 Mb on one flash */
-                    flash_erase_sector_size = 0x10000UL;
-                    flash_page_size = 256;
-                    found = true;
-                    break;
-                case 0x20:
-                    *label = "MT25QU512ABB (64MiB)";
-                    flash_size = 64UL * 1024UL * 1024UL; /* 512 Mb on one flash */
-                    flash_erase_sector_size = 64UL * 1024UL;
-                    flash_page_size = 256;
-                    found = true;
-                    break;
-                case 0x21:
-                    *label = "2x N25Q00A (128MiB) in parallel (256MiB total)";
-                    flash_size = 0x8000000UL * 2UL; /* 1 Gib on each flash in parallel */
-                    flash_erase_sector_size = 0x10000UL * 2;
-                    flash_page_size = 256 * 2;
-                    found = true;
-                    break;
-                case 0x22:
-                    *label = "2x mt25qu02g (256MiB) in parallel (512MiB total)";
-                    flash_size = 0x10000000UL * 2UL; /* 2Gib on each flash in parallel */
-                    flash_erase_sector_size = 0x10000UL * 2UL;
-                    flash_page_size = 256 * 2;
-                    found = true;
-                    break;
-                default:
-                    break;
-            }
-            break;
-        default:
-            break;
-    }
+    flash_transfer_buffer_skip(flash_buf, 3 + 1);
 
-    if (!found && (flash_readCFI() == FLASH_NO_ERROR)) {
-        *label = "Unknown Flash";
-    }
+    return flash_TransferBuffer_CopyOut(flash_buf, data, length);
+}
 
-    if (*label == NULL)
-    {
-        printf("error: flash: unknown device: 0x%02x 0x%02x 0x%02x\n",
-               manufacture_code, mem_iface_type, density);
+/*
+ * A BFPT fast read field is the dummy clocks in bits 4:0, the mode clocks
+ * in bits 7:5 and the command in bits 15:8.
+ */
+static void
+flash_SfdpReadMode(flash_read_part* part, uint32_t mode, uint32_t field)
+{
+    part->modes |= 1 << mode;
+    part->dummy_cycles[mode] = (field & 0x1f) + ((field >> 5) & 0x7);
+#if !FLASH_4BYTE_ADDRESSING
+    part->commands[mode] = (field >> 8) & 0xff;
+#endif
+}
+
+/*
+ * Set up the geometry and read support from the basic flash parameter table
+ * (BFPT). The sector erase size is the erase type using the sector erase
+ * command. Parts that need a quad enable other than the configuration
+ * register bit or do not say which one they need read without quad.
+ */
+static flash_error
+flash_SfdpParse(const uint8_t* bfpt, size_t dwords, const uint8_t* bait)
+{
+    flash_read_part* part = &flash_read_sfdp;
+    uint32_t         dw;
+    uint32_t         erase_type;
+    bool             quad;
+
+    memset(part, 0, sizeof(*part));
+    part->modes = 1 << FLASH_READ_MODE_SINGLE;
+    part->max_mhz = FLASH_CLOCK_SFDP_MHZ;
+
+    dw = flash_Get32(bfpt);
+#if FLASH_4BYTE_ADDRESSING
+    if (((dw >> 17) & 3) == 0)
+        return FLASH_4BYTE_ADDR_NOT_SUPPORTED;
+#else
+    if (((dw >> 17) & 3) == 2)
         return FLASH_INVALID_DEVICE;
-    }
+#endif
 
-    flash_writeUnlock();
+    if ((dw & (1 << 16)) != 0)
+        flash_SfdpReadMode(part, FLASH_READ_MODE_DUAL_OUT, flash_Get32(bfpt + 12));
+    if ((dw & (1 << 20)) != 0)
+        flash_SfdpReadMode(part, FLASH_READ_MODE_DUAL_IO, flash_Get32(bfpt + 12) >> 16);
+    if ((dw & (1 << 21)) != 0)
+        flash_SfdpReadMode(part, FLASH_READ_MODE_QUAD_IO, flash_Get32(bfpt + 8));
+    if ((dw & (1 << 22)) != 0)
+        flash_SfdpReadMode(part, FLASH_READ_MODE_QUAD_OUT, flash_Get32(bfpt + 8) >> 16);
+
+    /*
+     * The density is in bits, bit 31 set is a power of 2.
+     */
+    dw = flash_Get32(bfpt + 4);
+    if ((dw & (1UL << 31)) != 0)
+    {
+        dw &= ~(1UL << 31);
+        if ((dw < 3) || (dw > 35))
+            return FLASH_INVALID_DEVICE;
+        flash_size = 1ULL << (dw - 3);
+    }
+    else
+    {
+        flash_size = ((uint64_t) dw + 1) / 8;
+    }
 
-    fe = flash_SetWEL();
-    if (fe != FLASH_NO_ERROR)
+    flash_erase_sector_size = 0;
+    for (erase_type = 0; erase_type < 4; ++erase_type)
     {
-        flash_writeLock();
-        return fe;
+        const uint8_t* type = bfpt + (7 * 4) + (erase_type * 2);
+        if ((type[0] != 0) && (type[1] == FLASH_SFDP_SEC_ERASE))
+            flash_erase_sector_size = 1UL << type[0];
     }
+    if (flash_erase_sector_size == 0)
+        return FLASH_INVALID_DEVICE;
 
-    flash_TransferBuffer_Clear(flash_buf);
-    flash_TransferBuffer_SetLength(flash_buf, 1 + 2);
-    flash_TransferBuffer_Set8(flash_buf, FLASH_WRITE_STATUS_CMD);
-    flash_TransferBuffer_Set8(flash_buf, 0);
-    flash_TransferBuffer_Set8(flash_buf, FLASH_SR_SRWD | FLASH_SR_WEL);
-    flash_TransferBuffer_SetDir(flash_buf, FLASH_TX_TRANS);
-    flash_TransferBuffer_SetCommandLen(flash_buf, FLASH_COMMAND_SIZE);
-    flash_TransferBuffer_SetCommMethod(flash_buf, FLASH_COMM_METHOD_SINGLE);
+    flash_page_size = 256;
+    if (dwords >= 11)
+        flash_page_size = 1 << ((flash_Get32(bfpt + (10 * 4)) >> 4) & 0xf);
 
-    fe = flash_Transfer(flash_buf, initialised);
-    if (fe != FLASH_NO_ERROR)
+    quad = false;
+    if (dwords >= 15)
     {
-        flash_ClearWEL();
-        flash_writeLock();
-        return fe;
+        switch ((flash_Get32(bfpt + (14 * 4)) >> 20) & 7)
+        {
+            case 0:
+                part->quad_enable = FLASH_QE_NONE;
+                quad = true;
+                break;
+            case 1:
+            case 4:
+            case 5:
+                part->quad_enable = FLASH_QE_CR_BIT1;
+                quad = true;
+                break;
+            default:
+                break;
+        }
     }
+    if (!quad)
+        part->modes &= ~((1 << FLASH_READ_MODE_QUAD_OUT) |
+                         (1 << FLASH_READ_MODE_QUAD_IO));
 
-    flash_ClearWEL();
-    flash_writeLock();
-
-#if FLASH_FAST_READ
-    flash_read_dummies = 1;
+#if FLASH_4BYTE_ADDRESSING
+    /*
+     * The 4-byte address instruction table lists the 4 byte commands the
+     * part supports.
+     */
+    if (bait != NULL)
+    {
+        dw = flash_Get32(bait);
+        if ((dw & (1 << 2)) == 0)
+            part->modes &= ~(1 << FLASH_READ_MODE_DUAL_OUT);
+        if ((dw & (1 << 3)) == 0)
+            part->modes &= ~(1 << FLASH_READ_MODE_DUAL_IO);
+        if ((dw & (1 << 4)) == 0)
+            part->modes &= ~(1 << FLASH_READ_MODE_QUAD_OUT);
+        if ((dw & (1 << 5)) == 0)
+            part->modes &= ~(1 << FLASH_READ_MODE_QUAD_IO);
+    }
+#else
+    (void) bait;
 #endif
 
-    fe = flash_read(0, buffer, sizeof(buffer));
+    return FLASH_NO_ERROR;
+}
+
+/*
+ * Read the SFDP header and parameter headers and parse the basic flash
+ * parameter table.
+ */
+static flash_error
+flash_readSFDP(void)
+{
+    uint8_t     header[FLASH_SFDP_HEADER_SIZE];
+    uint8_t     bfpt[FLASH_SFDP_BFPT_DWORDS * 4];
+    uint8_t     bait[4];
+    size_t      bfpt_dwords = 0;
+    bool        bait_found = false;
+    uint32_t    headers;
+    uint32_t    p;
+    flash_error fe;
+
+    fe = flash_SfdpRead(0, header, sizeof(header));
+    if (fe != FLASH_NO_ERROR)
+        return fe;
+
+    if (flash_Get32(header) != FLASH_SFDP_SIGNATURE)
+        return FLASH_INVALID_DEVICE;
+
+    headers = header[6] + 1;
+
+    for (p = 0; p < headers; ++p)
+    {
+        uint8_t  param[FLASH_SFDP_HEADER_SIZE];
+        uint32_t id;
+        uint32_t dwords;
+        uint32_t table;
+
+        fe = flash_SfdpRead(FLASH_SFDP_HEADER_SIZE * (p + 1), param, sizeof(param));
+        if (fe != FLASH_NO_ERROR)
+            return fe;
+
+        id = (((uint32_t) param[7]) << 8) | param[0];
+        dwords = param[3];
+        table = flash_Get32(param + 4) & 0xffffff;
+
+        if ((id == FLASH_SFDP_BFPT_ID) && (bfpt_dwords == 0) && (dwords >= 9))
+        {
+            if (dwords > FLASH_SFDP_BFPT_DWORDS)
+                dwords = FLASH_SFDP_BFPT_DWORDS;
+            fe = flash_SfdpRead(table, bfpt, dwords * 4);
+            if (fe != FLASH_NO_ERROR)
+                return fe;
+            bfpt_dwords = dwords;
+        }
+        else if ((id == FLASH_SFDP_4BAIT_ID) && !bait_found && (dwords >= 1))
+        {
+            fe = flash_SfdpRead(table, bait, sizeof(bait));
+            if (fe != FLASH_NO_ERROR)
+                return fe;
+            bait_found = true;
+        }
+    }
+
+    if (bfpt_dwords == 0)
+        return FLASH_INVALID_DEVICE;
+
+    return flash_SfdpParse(bfpt, bfpt_dwords, bait_found ? bait : NULL);
+}
+
+/*
+ * An SFDP part has one region of sectors.
+ */
+static flash_error
+flash_SfdpRegions(void)
+{
+    if (!flash_regions)
+    {
+        flash_regions = FLASH_WORKSPACE_ALLOC(FLASH_WS_FLASH_REGIONS);
+        flash_num_regions = 1;
+        flash_regions[0].count = flash_size / flash_erase_sector_size;
+        flash_regions[0].size = flash_erase_sector_size;
+        flash_erase_buffer_size = flash_erase_sector_size;
+        flash_erase_buffer = FLASH_WORKSPACE_ALLOC(FLASH_WS_ERASE_BUFFER);
+    }
+    return FLASH_NO_ERROR;
+}
+
+/*
+ * Set the quad enable bit of parts that have one. Spansion parts have the
+ * QUAD bit in the configuration register, written with the status register.
+ */
+static flash_error
+flash_QuadEnable(const flash_read_part* part)
+{
+    uint16_t    status;
+    uint16_t    config;
+    uint16_t    values[2];
+    uint32_t    checks = 1000;
+    flash_error fe;
+
+    if (part->quad_enable != FLASH_QE_CR_BIT1)
+        return FLASH_NO_ERROR;
+
+    fe = flash_readRegister(FLASH_READ_CONFIG_CMD, &config);
+    if (fe != FLASH_NO_ERROR)
+        return fe;
+
+    if ((flash_StatusAll(config) & FLASH_CR_QUAD) != 0)
+        return FLASH_NO_ERROR;
+
+    fe = flash_readRegister(FLASH_READ_STATUS_CMD, &status);
+    if (fe != FLASH_NO_ERROR)
+        return fe;
+
+    flash_writeUnlock();
+
+    fe = flash_SetWEL();
+    if (fe != FLASH_NO_ERROR)
+    {
+        flash_writeLock();
+        return fe;
+    }
+
+    /*
+     * Each device keeps its own status and configuration bits.
+     */
+    values[0] = status;
+    values[1] = config | FLASH_REGISTER_ALL(FLASH_CR_QUAD);
+
+    fe = flash_writeRegister(FLASH_WRITE_STATUS_CMD, values, 2);
+
+    /*
+     * The configuration register is non-volatile, wait for the write.
+     */
+    while (fe == FLASH_NO_ERROR)
+    {
+        fe = flash_readRegister(FLASH_READ_STATUS_CMD, &status);
+        if (fe != FLASH_NO_ERROR || (flash_StatusAny(status) & FLASH_SR_WIP) == 0)
+            break;
+        if (checks == 0)
+            fe = FLASH_WRITE_ERASE_CMD_FAIL;
+        else
+            --checks;
+        usleep(1000);
+    }
+
+    flash_writeLock();
+
+    if (fe != FLASH_NO_ERROR)
+        return fe;
+
+    fe = flash_readRegister(FLASH_READ_CONFIG_CMD, &config);
+    if (fe != FLASH_NO_ERROR)
+        return fe;
+
+    if ((flash_StatusAll(config) & FLASH_CR_QUAD) == 0)
+        return FLASH_WRITE_ERASE_CMD_FAIL;
+
+    return FLASH_NO_ERROR;
+}
+
+static uint8_t
+flash_PartReadCommand(const flash_read_part* part, uint32_t mode)
+{
+    if (part->commands[mode] != 0)
+        return part->commands[mode];
+    return flash_read_ops[mode].command;
+}
+
+/*
+ * The fastest read mode of a part. Quad is faster than dual and sending
+ * the address on the data lanes is faster than sending it on one lane.
+ */
+static uint32_t
+flash_FastestReadMode(const flash_read_part* part)
+{
+    static const uint32_t order[] =
+    {
+        FLASH_READ_MODE_QUAD_IO,
+        FLASH_READ_MODE_QUAD_OUT,
+        FLASH_READ_MODE_DUAL_IO,
+        FLASH_READ_MODE_DUAL_OUT
+    };
+    size_t o;
+
+    for (o = 0; o < (sizeof(order) / sizeof(order[0])); ++o)
+    {
+        if ((part->modes & (1 << order[o])) != 0)
+            return order[o];
+    }
+
+    return FLASH_READ_MODE_SINGLE;
+}
+
+/*
+ * Select the read mode. A part that does not support FLASH_READ_MODE reads
+ * on one lane.
+ */
+static flash_error
+flash_SetReadMode(const flash_read_part* part)
+{
+    uint32_t    mode = FLASH_READ_MODE;
+    flash_error fe;
+
+    flash_read_mode = FLASH_READ_MODE_SINGLE;
+    flash_read_command = FLASH_READ_CMD;
+    flash_read_cycles = 0;
+
+    if (mode == FLASH_READ_MODE_AUTO)
+        mode = flash_FastestReadMode(part);
+
+    if ((mode == FLASH_READ_MODE_SINGLE) || (mode >= FLASH_READ_MODES)
+        || ((part->modes & (1 << mode)) == 0))
+        return FLASH_NO_ERROR;
+
+    if ((mode == FLASH_READ_MODE_QUAD_OUT) || (mode == FLASH_READ_MODE_QUAD_IO))
+    {
+        fe = flash_QuadEnable(part);
+        if (fe != FLASH_NO_ERROR)
+            return fe;
+    }
+
+    flash_read_mode = mode;
+    flash_read_command = flash_PartReadCommand(part, mode);
+    flash_read_dummies = 0;
+    flash_read_cycles = part->dummy_cycles[mode];
+
+    return FLASH_NO_ERROR;
+}
+
+#if FLASH_LINEAR_READ
+/*
+ * Set up linear mode reads with the quad output read command if the part
+ * supports it, else the single lane read command.
+ */
+static flash_error
+flash_SetLinearMode(const flash_read_part* part)
+{
+    flash_error fe;
+
+    flash_linear = false;
+
+    if ((part->modes & (1 << FLASH_READ_MODE_QUAD_OUT)) != 0)
+    {
+        fe = flash_QuadEnable(part);
+        if (fe != FLASH_NO_ERROR)
+            return fe;
+        flash_LinearSetup(flash_PartReadCommand(part, FLASH_READ_MODE_QUAD_OUT),
+                          part->dummy_cycles[FLASH_READ_MODE_QUAD_OUT] / 8);
+    }
+    else
+    {
+        flash_LinearSetup(FLASH_READ_CMD, flash_read_dummies);
+    }
+
+    flash_linear = true;
+
+    return FLASH_NO_ERROR;
+}
+#endif
+
+/*
+ * Dual parallel devices are detected by the second device returning the
+ * same ID as the first device.
+ */
+static void
+flash_DetectParallel(uint32_t manufacture_code,
+                     uint32_t mem_iface_type,
+                     uint32_t density)
+{
+#if FLASH_DUAL_PARALLEL
+    uint32_t second_code = 0;
+    uint32_t second_iface = 0;
+    uint32_t second_density = 0;
+    uint32_t second;
+
+    second = FLASH_COMM_METHOD_SINGLE == FLASH_COMM_METHOD_SINGLE_TOP ?
+        FLASH_COMM_METHOD_SINGLE_BOTTOM : FLASH_COMM_METHOD_SINGLE_TOP;
+
+    if ((flash_ReadIdFrom(second, &second_code,
+                          &second_iface, &second_density) == FLASH_NO_ERROR)
+        && (second_code == manufacture_code)
+        && (second_iface == mem_iface_type)
+        && (second_density == density))
+    {
+        flash_parallel = true;
+        flash_comm_all = FLASH_COMM_METHOD_PARALLEL;
+        flash_comm_reg = FLASH_COMM_METHOD_PARALLEL;
+    }
+#endif
+}
+
+flash_error flash_open(const char** label) {
+    uint8_t     buffer[64];
+    uint32_t    manufacture_code;
+    uint32_t    mem_iface_type;
+    uint32_t    density;
+    flash_error fe;
+    bool        found = false;
+
+    const flash_read_part* read_part = &flash_read_single;
+    const uint16_t         open_status[2] = {
+        0, FLASH_REGISTER_ALL(FLASH_SR_SRWD | FLASH_SR_WEL)
+    };
+
+    if (label == NULL) {
+        return FLASH_INVALID_DEVICE;
+    }
+
+    *label = NULL;
+
+    flash_parallel = false;
+    flash_sfdp = false;
+    flash_comm_all = FLASH_COMM_METHOD_ALL;
+    flash_comm_reg = FLASH_COMM_METHOD_SINGLE;
+
+    fe = flash_read_id(&manufacture_code,
+                      &mem_iface_type,
+                      &density);
+    if (fe != FLASH_NO_ERROR)
+    {
+        printf("flash: device id read failed: %d\n", fe);
+        return fe;
+    }
+
+    flash_DetectParallel(manufacture_code, mem_iface_type, density);
+
+    switch (manufacture_code) {
+        case 1:
+            if ((mem_iface_type == 0x20) && (density == 0x18))
+            {
+                *label = "S25FL128P_64K (16MiB)";
+                flash_size = 16UL * 1024UL * 1024UL;
+                flash_erase_sector_size = 64UL * 1024UL;
+                flash_page_size = 256;
+                found = true;
+            }
+            else if ((mem_iface_type == 0x02) && (density == 0x20))
+            {
+                *label = "S25FL512S_256K (64MiB)";
+                flash_size = 64UL * 1024UL * 1024UL;
+                flash_erase_sector_size = 256UL * 1024UL;
+                flash_page_size = 256;
+                read_part = &flash_read_spansion;
+                found = true;
+            }
+            break;
+        case  0x20:
+            read_part = &flash_read_micron;
+            switch (density) {
+                case 0x18:
+                    *label = "1x MT25QL128ABA";
+                    flash_size = 0x1000000; /* 128 Mb on one flash */
+                    flash_erase_sector_size = 0x10000UL;
+                    flash_page_size = 256;
+                    found = true;
+                    break;
+                case 0x19:
+                    *label = "1x N25Q256A";
+                    flash_size = 0x2000000; /* 256 Mb on one flash */
+                    flash_erase_sector_size = 0x10000UL;
+                    flash_page_size = 256;
+                    found = true;
+                    break;
+                case 0x20:
+                    *label = "MT25QU512ABB (64MiB)";
+                    flash_size = 64UL * 1024UL * 1024UL; /* 512 Mb on one flash */
+                    flash_erase_sector_size = 64UL * 1024UL;
+                    flash_page_size = 256;
+                    found = true;
+                    break;
+                case 0x21:
+                    *label = "N25Q00A (128MiB)";
+                    flash_size = 0x8000000UL; /* 1 Gib on one flash */
+                    flash_erase_sector_size = 0x10000UL;
+                    flash_page_size = 256;
+                    found = true;
+                    break;
+                case 0x22:
+                    *label = "mt25qu02g (256MiB)";
+                    flash_size = 0x10000000UL; /* 2Gib on one flash */
+                    flash_erase_sector_size = 0x10000UL;
+                    flash_page_size = 256;
+                    found = true;
+                    break;
+                default:
+                    break;
+            }
+            break;
+        default:
+            break;
+    }
+
+    /*
+     * A part not in the table is set up from its SFDP tables.
+     */
+    if (!found && (flash_readSFDP() == FLASH_NO_ERROR)) {
+        sprintf(flash_sfdp_label, "SFDP %02x %02x %02x (%uMiB)",
+                manufacture_code, mem_iface_type, density,
+                (unsigned int) (flash_size / (1024 * 1024)));
+        *label = flash_sfdp_label;
+        read_part = &flash_read_sfdp;
+        flash_sfdp = true;
+        found = true;
+    }
+
+    if (found && flash_parallel) {
+        flash_size *= 2;
+        flash_erase_sector_size *= 2;
+        flash_page_size *= 2;
+    }
+
+    if (!found && (flash_readCFI() == FLASH_NO_ERROR)) {
+        *label = "Unknown Flash";
+    }
+
+    if ((*label != NULL) && flash_parallel) {
+        sprintf(flash_label, "2x %s in parallel", *label);
+        *label = flash_label;
+    }
+
+    if (*label == NULL)
+    {
+        printf("error: flash: unknown device: 0x%02x 0x%02x 0x%02x\n",
+               manufacture_code, mem_iface_type, density);
+        return FLASH_INVALID_DEVICE;
+    }
+
+    flash_writeUnlock();
+
+    fe = flash_SetWEL();
+    if (fe != FLASH_NO_ERROR)
+    {
+        flash_writeLock();
+        return fe;
+    }
+
+    fe = flash_writeRegister(FLASH_WRITE_STATUS_CMD, open_status, 2);
+    if (fe != FLASH_NO_ERROR)
+    {
+        flash_ClearWEL();
+        flash_writeLock();
+        return fe;
+    }
+
+    flash_ClearWEL();
+    flash_writeLock();
+
+#if FLASH_FAST_READ
+    flash_read_dummies = 1;
+#endif
+
+    fe = flash_SetReadMode(read_part);
+    if (fe != FLASH_NO_ERROR)
+        return fe;
+
+    flash_max_mhz = read_part->max_mhz;
+#if defined(FLASH_CLOCK_MAX_MHZ)
+    if (flash_max_mhz > FLASH_CLOCK_MAX_MHZ)
+        flash_max_mhz = FLASH_CLOCK_MAX_MHZ;
+#endif
+
+#if FLASH_LINEAR_READ
+    fe = flash_SetLinearMode(read_part);
+    if (fe != FLASH_NO_ERROR)
+        return fe;
+#endif
+
+    fe = flash_read(0, buffer, sizeof(buffer));
     return fe;
 }
 
+/*
+ * Load the transfer buffer with a read command for size bytes of data.
+ */
+static flash_error
+flash_ReadCommand(uint32_t address, size_t size)
+{
+    flash_TransferBuffer_Clear(flash_buf);
+    flash_TransferBuffer_SetLength(flash_buf,
+                                   FLASH_COMMAND_SIZE + FLASH_ADDRESS_SIZE
+                                   + flash_read_dummies + size);
+    flash_TransferBuffer_Set8(flash_buf, flash_read_command);
+    flash_TransferBuffer_SetAddr(flash_buf, address);
+    flash_TransferBuffer_SetDir(flash_buf, FLASH_RX_TRANS);
+    flash_TransferBuffer_SetCommandLen(flash_buf, FLASH_COMMAND_SIZE
+        + FLASH_ADDRESS_SIZE + flash_read_dummies);
+    flash_TransferBuffer_SetCommMethod(flash_buf, flash_comm_all);
+    flash_TransferBuffer_SetLanes(flash_buf,
+                                  flash_read_ops[flash_read_mode].addr_lanes,
+                                  flash_read_ops[flash_read_mode].data_lanes,
+                                  flash_read_cycles);
+    return flash_TransferBuffer_Fill(flash_buf, 0, flash_read_dummies + size);
+}
+
 flash_error
 flash_read(uint32_t address, void* buffer, size_t length)
 {
-    uint8_t* data = buffer;
+    uint8_t*    data = buffer;
+    flash_error fe = FLASH_NO_ERROR;
 
-#ifdef FLARE_VERSAL
-    if (address%2) {
-        return FLASH_BAD_ADDRESS;
+    /*
+     * Parallel devices are read in byte pairs. Read the pair holding an odd
+     * first or last byte separately.
+     */
+    if (flash_parallel && (((address | length) & 1) != 0))
+    {
+        uint8_t pair[2];
+
+        if ((address & 1) != 0)
+        {
+            fe = flash_read(address - 1, pair, sizeof(pair));
+            if (fe != FLASH_NO_ERROR)
+                return fe;
+            *data = pair[1];
+            ++data;
+            ++address;
+            --length;
+        }
+
+        if ((length & 1) != 0)
+        {
+            fe = flash_read(address + length - 1, pair, sizeof(pair));
+            if (fe != FLASH_NO_ERROR)
+                return fe;
+            data[length - 1] = pair[0];
+            --length;
+        }
+
+        if (length == 0)
+            return FLASH_NO_ERROR;
     }
-    address = address / 2;
+
+#if FLASH_LINEAR_READ
+    /*
+     * Reads in the linear window are a memory copy.
+     */
+    if (flash_linear && (address < QSPI_LINEAR_SIZE)
+        && ((QSPI_LINEAR_SIZE - address) >= length))
+        return flash_LinearRead(address, buffer, length);
 #endif
 
+    /*
+     * The commands are read back to back in a session.
+     */
+    flash_SessionBegin();
+
     while (length)
     {
-        flash_error fe;
+        size_t size;
+#if FLASH_DMA_READ
+        size_t head;
+#endif
+
+        if (flash_page_size == 0) {
+          fe = FLASH_INVALID_DEVICE;
+          break;
+        }
+
+        /*
+         * One command reads up to the controller's limit with the data
+         * received directly into the caller's buffer.
+         */
+        size = length > FLASH_READ_MAX ? FLASH_READ_MAX : length;
+
+        fe = flash_ReadCommand(flash_DeviceAddress(address), 0);
+        if (fe != FLASH_NO_ERROR)
+            break;
+
+#if FLASH_DMA_READ
+        /*
+         * Whole cache lines use the DMA. The bytes before the first line
+         * boundary are read on their own through the RX FIFO so the rest
+         * of the read is line aligned, and the bytes after the last line
+         * boundary are left for the next command.
+         */
+        head = (FLASH_DMA_ALIGN - (((uintptr_t) data) & (FLASH_DMA_ALIGN - 1))) &
+            (FLASH_DMA_ALIGN - 1);
+        if (flash_dma_read && head == 0 && size >= FLASH_DMA_READ_MIN)
+        {
+            size &= ~(FLASH_DMA_ALIGN - 1);
+            if (size > FLASH_DMA_READ_MAX)
+                size = FLASH_DMA_READ_MAX;
+            flash_TransferBuffer_SetPayload(flash_buf, data, size);
+            fe = flash_TransferDMA(flash_buf, initialised);
+        }
+        else
+        {
+            if (flash_dma_read && head != 0 && size >= (head + FLASH_DMA_READ_MIN))
+                size = head;
+            flash_TransferBuffer_SetPayload(flash_buf, data, size);
+            fe = flash_Transfer(flash_buf, initialised);
+        }
+#else
+        flash_TransferBuffer_SetPayload(flash_buf, data, size);
+        fe = flash_Transfer(flash_buf, initialised);
+#endif
+        if (fe != FLASH_NO_ERROR)
+            break;
+
+        length -= size;
+        data += size;
+        address += size;
+    }
+
+    flash_SessionEnd();
+
+    return fe;
+}
+
+flash_error
+flash_blank(uint32_t address, size_t length)
+{
+    flash_error fe = FLASH_NO_ERROR;
+
+    if ((address >= flash_size) || ((address + length) > flash_size))
+        return FLASH_BAD_ADDRESS;
+
+    flash_SessionBegin();
+
+    while (length && (fe == FLASH_NO_ERROR))
+    {
         size_t      size;
 
         if (flash_page_size == 0) {
-          return FLASH_INVALID_DEVICE;
+          fe = FLASH_INVALID_DEVICE;
+          break;
         }
         size = length > flash_page_size ? flash_page_size : length;
 
-        flash_TransferBuffer_Clear(flash_buf);
-        flash_TransferBuffer_SetLength(flash_buf,
-                                       FLASH_COMMAND_SIZE + FLASH_ADDRESS_SIZE
-                                       + flash_read_dummies + size);
-        flash_TransferBuffer_Set8(flash_buf, FLASH_READ_CMD);
-        flash_TransferBuffer_SetAddr(flash_buf, address);
-        fe = flash_TransferBuffer_Fill(flash_buf, 0, flash_read_dummies + size);
-        if (fe != FLASH_NO_ERROR)
-            return fe;
-        flash_TransferBuffer_SetDir(flash_buf, FLASH_RX_TRANS);
-        flash_TransferBuffer_SetCommandLen(flash_buf, FLASH_COMMAND_SIZE
-            + FLASH_ADDRESS_SIZE + flash_read_dummies);
-        flash_TransferBuffer_SetCommMethod(flash_buf, FLASH_COMM_METHOD_ALL);
+        fe = flash_ReadCommand(flash_DeviceAddress(address), size);
+        if (fe != FLASH_NO_ERROR)
+                break;
+
+        fe = flash_Transfer(flash_buf, initialised);
+        if (fe != FLASH_NO_ERROR)
+            break;
+
+        flash_transfer_buffer_skip(flash_buf, FLASH_ADDRESS_SIZE);
+
+        length -= size;
+        address += size;
+
+        while (size)
+        {
+            uint8_t byte = 0;
+            flash_TransferBuffer_Get8(flash_buf, &byte);
+            if (byte != 0xff)
+            {
+                fe = FLASH_NOT_BLANK;
+                break;
+            }
+            --size;
+        }
+    }
+
+    flash_SessionEnd();
+
+    return fe;
+}
+
+void
+flash_queue_init(flash_queue* queue)
+{
+    queue->count = 0;
+    queue->error = FLASH_NO_ERROR;
+}
+
+flash_error
+flash_queue_add(flash_queue*    queue,
+                flash_step_type type,
+                uint32_t        address,
+                void*           data,
+                size_t          length)
+{
+    flash_step* step;
+
+    if (queue->error != FLASH_NO_ERROR)
+        return queue->error;
+
+    if (queue->count >= FLASH_QUEUE_STEPS)
+    {
+        queue->error = FLASH_BUFFER_OVERFLOW;
+        return queue->error;
+    }
+
+    step = &queue->steps[queue->count];
+    step->type = type;
+    step->address = address;
+    step->data = data;
+    step->length = length;
+
+    ++queue->count;
 
-        fe = flash_Transfer(flash_buf, initialised);
-        if (fe != FLASH_NO_ERROR)
-            return fe;
+    return FLASH_NO_ERROR;
+}
+
+static flash_error
+flash_QueueStep(const flash_step* step)
+{
+    flash_error fe;
 
-        flash_transfer_buffer_skip(flash_buf, FLASH_ADDRESS_SIZE + flash_read_dummies);
+    switch (step->type)
+    {
+    case FLASH_STEP_WRITE_ENABLE:
+        return flash_SetWEL();
 
-        fe = flash_TransferBuffer_CopyOut(flash_buf, data, size);
+    case FLASH_STEP_PROGRAM:
+        if (step->length > flash_page_size)
+            return FLASH_BUFFER_OVERFLOW;
+        flash_TransferBuffer_Clear(flash_buf);
+        flash_TransferBuffer_SetLength(flash_buf, FLASH_COMMAND_SIZE
+              + FLASH_ADDRESS_SIZE + step->length);
+        flash_TransferBuffer_Set8(flash_buf, FLASH_WRITE_CMD);
+        flash_TransferBuffer_SetAddr(flash_buf, flash_DeviceAddress(step->address));
+        flash_TransferBuffer_SetDir(flash_buf, FLASH_TX_TRANS);
+        flash_TransferBuffer_SetCommandLen(flash_buf,
+            FLASH_COMMAND_SIZE + FLASH_ADDRESS_SIZE);
+        flash_TransferBuffer_SetCommMethod(flash_buf, flash_comm_all);
+        fe = flash_TransferBuffer_CopyIn(flash_buf, step->data, step->length);
         if (fe != FLASH_NO_ERROR)
             return fe;
+        return flash_Transfer(flash_buf, initialised);
 
-        length -= size;
-        data += size;
-#ifdef FLARE_VERSAL
-        address = address + (size/2);
-#else
-        address += size;
-#endif
+    case FLASH_STEP_ERASE_SECTOR:
+        flash_TransferBuffer_Clear(flash_buf);
+        flash_TransferBuffer_SetLength(flash_buf, FLASH_COMMAND_SIZE + FLASH_ADDRESS_SIZE);
+        flash_TransferBuffer_Set8(flash_buf, FLASH_SEC_ERASE_CMD);
+        flash_TransferBuffer_SetAddr(flash_buf, flash_DeviceAddress(step->address));
+        flash_TransferBuffer_SetDir(flash_buf, FLASH_TX_TRANS);
+        flash_TransferBuffer_SetCommandLen(flash_buf, FLASH_COMMAND_SIZE + FLASH_ADDRESS_SIZE);
+        flash_TransferBuffer_SetCommMethod(flash_buf, flash_comm_all);
+        return flash_Transfer(flash_buf, initialised);
+
+    case FLASH_STEP_WAIT:
+        return flash_WaitForWrite(step->length);
+
+    case FLASH_STEP_READ:
+        return flash_read(step->address, step->data, step->length);
+
+    default:
+        break;
     }
 
-    return FLASH_NO_ERROR;
+    return FLASH_INVALID_DEVICE;
 }
 
 flash_error
-flash_blank(uint32_t address, size_t length)
+flash_queue_run(flash_queue* queue)
 {
     flash_error fe = FLASH_NO_ERROR;
+    bool        writes = false;
+    size_t      s;
 
-    if ((address >= flash_size) || ((address + length) > flash_size))
-        return FLASH_BAD_ADDRESS;
+    if (queue->error != FLASH_NO_ERROR)
+    {
+        fe = queue->error;
+        flash_queue_init(queue);
+        return fe;
+    }
 
-    while (length)
+    for (s = 0; s < queue->count; ++s)
     {
-        size_t      size;
+        if ((queue->steps[s].type == FLASH_STEP_PROGRAM)
+            || (queue->steps[s].type == FLASH_STEP_ERASE_SECTOR))
+            writes = true;
+    }
 
-        if (flash_page_size == 0) {
-          return FLASH_INVALID_DEVICE;
-        }
-        size = length > flash_page_size ? flash_page_size : length;
+    flash_SessionBegin();
 
-        flash_TransferBuffer_Clear(flash_buf);
-        flash_TransferBuffer_SetLength(flash_buf,
-                                       FLASH_COMMAND_SIZE + FLASH_ADDRESS_SIZE
-                                       + flash_read_dummies + size);
-        flash_TransferBuffer_Set8(flash_buf, FLASH_READ_CMD);
-        flash_TransferBuffer_SetAddr(flash_buf, address);
-        fe = flash_TransferBuffer_Fill(flash_buf, 0, flash_read_dummies + size);
-        if (fe != FLASH_NO_ERROR)
-                return fe;
-        flash_TransferBuffer_SetDir(flash_buf, FLASH_RX_TRANS);
-        flash_TransferBuffer_SetCommandLen(flash_buf, FLASH_COMMAND_SIZE + FLASH_ADDRESS_SIZE + flash_read_dummies);
-        flash_TransferBuffer_SetCommMethod(flash_buf, FLASH_COMM_METHOD_ALL);
+    if (writes)
+        flash_writeUnlock();
 
-        fe = flash_Transfer(flash_buf, initialised);
+    for (s = 0; s < queue->count; ++s)
+    {
+        fe = flash_QueueStep(&queue->steps[s]);
         if (fe != FLASH_NO_ERROR)
-            return fe;
+            break;
+    }
 
-        flash_transfer_buffer_skip(flash_buf, FLASH_ADDRESS_SIZE);
+    if (writes)
+    {
+        if (fe != FLASH_NO_ERROR)
+            flash_ClearWEL();
+        flash_writeLock();
+    }
 
-        length -= size;
-        address += size;
+    flash_SessionEnd();
 
-        while (size)
-        {
-            uint8_t byte = 0;
-            flash_TransferBuffer_Get8(flash_buf, &byte);
-            if (byte != 0xff)
-                return FLASH_NOT_BLANK;
-            --size;
-        }
-    }
+    queue->count = 0;
 
     return fe;
 }
@@ -816,6 +1812,7 @@ flash_blank(uint32_t address, size_t length)
 flash_error
 flash_erase_sector(uint32_t address)
 {
+    flash_queue queue;
     flash_error fe = FLASH_NO_ERROR;
     uint32_t    base = 0;
     size_t      length = 0;
@@ -827,40 +1824,18 @@ flash_erase_sector(uint32_t address)
     if (fe != FLASH_NO_ERROR)
         return fe;
 
-    flash_writeUnlock();
-
-    fe = flash_SetWEL();
-    if (fe != FLASH_NO_ERROR)
-    {
-        flash_writeLock();
-        return fe;
-    }
-
-    flash_TransferBuffer_Clear(flash_buf);
-    flash_TransferBuffer_SetLength(flash_buf, FLASH_COMMAND_SIZE + FLASH_ADDRESS_SIZE);
-    flash_TransferBuffer_Set8(flash_buf, FLASH_SEC_ERASE_CMD);
-    flash_TransferBuffer_SetAddr(flash_buf, address);
-    flash_TransferBuffer_SetDir(flash_buf, FLASH_TX_TRANS);
-    flash_TransferBuffer_SetCommandLen(flash_buf, FLASH_COMMAND_SIZE + FLASH_ADDRESS_SIZE);
-    flash_TransferBuffer_SetCommMethod(flash_buf, FLASH_COMM_METHOD_ALL);
-
-    fe = flash_Transfer(flash_buf, initialised);
+    flash_queue_init(&queue);
+    fe = flash_queue_add(&queue, FLASH_STEP_WRITE_ENABLE, 0, NULL, 0);
+    if (fe == FLASH_NO_ERROR)
+        fe = flash_queue_add(&queue, FLASH_STEP_ERASE_SECTOR, address, NULL, 0);
+    if (fe == FLASH_NO_ERROR)
+        fe = flash_queue_add(&queue, FLASH_STEP_WAIT, 0, NULL, 1000);
     if (fe != FLASH_NO_ERROR)
-    {
-        flash_ClearWEL();
-        flash_writeLock();
         return fe;
-    }
 
-    fe = flash_WaitForWrite(1000);
+    fe = flash_queue_run(&queue);
     if (fe != FLASH_NO_ERROR)
-    {
-        flash_ClearWEL();
-        flash_writeLock();
         return fe;
-    }
-
-    flash_writeLock();
 
     fe = flash_blank(base, length);
     if (fe != FLASH_NO_ERROR)
@@ -888,7 +1863,7 @@ flash_erase_device(void)
     flash_TransferBuffer_Set8(flash_buf, FLASH_BULK_ERASE_CMD);
     flash_TransferBuffer_SetDir(flash_buf, FLASH_TX_TRANS);
     flash_TransferBuffer_SetCommandLen(flash_buf, FLASH_COMMAND_SIZE + FLASH_ADDRESS_SIZE);
-    flash_TransferBuffer_SetCommMethod(flash_buf, FLASH_COMM_METHOD_ALL);
+    flash_TransferBuffer_SetCommMethod(flash_buf, flash_comm_all);
 
     fe = flash_Transfer(flash_buf, initialised);
     if (fe != FLASH_NO_ERROR)
@@ -911,16 +1886,31 @@ flash_erase_device(void)
     return fe;
 }
 
+/*
+ * A page is three steps and a sector erase the same.
+ */
+_Static_assert(FLASH_QUEUE_STEPS >= 3, "a flash queue holds less than a page write");
+
 flash_error
 flash_writeSector(uint32_t address, const void* buffer, size_t length)
 {
-    flash_error    fe = FLASH_NO_ERROR;
+    flash_queue    queue;
     const uint8_t* data = buffer;
 
     if ((address >= flash_size) || ((address + length) > flash_size))
         return FLASH_BAD_ADDRESS;
 
-    flash_writeUnlock();
+    /*
+     * Parallel devices are programmed in byte pairs.
+     */
+    if (flash_parallel && (((address | length) & 1) != 0))
+        return FLASH_BAD_ADDRESS;
+
+    /*
+     * Each page is a write enable, program and wait. The pages are queued
+     * and run in batches.
+     */
+    flash_queue_init(&queue);
 
     while (length)
     {
@@ -959,44 +1949,21 @@ flash_writeSector(uint32_t address, const void* buffer, size_t length)
 
         if (write_block)
         {
-            fe = flash_SetWEL();
-            if (fe != FLASH_NO_ERROR)
-            {
-                flash_writeLock();
-                return fe;
-            }
-
-            flash_TransferBuffer_Clear(flash_buf);
-            flash_TransferBuffer_SetLength(flash_buf, FLASH_COMMAND_SIZE
-                  + FLASH_ADDRESS_SIZE + size);
-            flash_TransferBuffer_Set8(flash_buf, FLASH_WRITE_CMD);
-            flash_TransferBuffer_SetAddr(flash_buf, address);
-            flash_TransferBuffer_SetDir(flash_buf, FLASH_TX_TRANS);
-            flash_TransferBuffer_SetCommandLen(flash_buf,
-                FLASH_COMMAND_SIZE + FLASH_ADDRESS_SIZE);
-            flash_TransferBuffer_SetCommMethod(flash_buf, FLASH_COMM_METHOD_ALL);
-            fe = flash_TransferBuffer_CopyIn(flash_buf, data, size);
-            if (fe != FLASH_NO_ERROR)
+            if ((queue.count + 3) > FLASH_QUEUE_STEPS)
             {
-                flash_writeLock();
-                return fe;
-            }
-
-            fe = flash_Transfer(flash_buf, initialised);
-            if (fe != FLASH_NO_ERROR)
-            {
-                flash_ClearWEL();
-                flash_writeLock();
-                return fe;
+                fe = flash_queue_run(&queue);
+                if (fe != FLASH_NO_ERROR)
+                    return fe;
             }
 
-            fe = flash_WaitForWrite(1000);
+            fe = flash_queue_add(&queue, FLASH_STEP_WRITE_ENABLE, 0, NULL, 0);
+            if (fe == FLASH_NO_ERROR)
+                fe = flash_queue_add(&queue, FLASH_STEP_PROGRAM,
+                                     address, (void*) data, size);
+            if (fe == FLASH_NO_ERROR)
+                fe = flash_queue_add(&queue, FLASH_STEP_WAIT, 0, NULL, 1000);
             if (fe != FLASH_NO_ERROR)
-            {
-                flash_ClearWEL();
-                flash_writeLock();
                 return fe;
-            }
         }
 
         address += size;
@@ -1004,15 +1971,14 @@ flash_writeSector(uint32_t address, const void* buffer, size_t length)
         length -= size;
     }
 
-    flash_writeLock();
-
-    return fe;
+    return flash_queue_run(&queue);
 }
 
-flash_error
-flash_read_id(uint32_t* manufactureCode,
-             uint32_t* memIfaceType,
-             uint32_t* density)
+static flash_error
+flash_ReadIdFrom(uint32_t  comm_method,
+                 uint32_t* manufactureCode,
+                 uint32_t* memIfaceType,
+                 uint32_t* density)
 {
     uint8_t     value = 0;
     flash_error fe;
@@ -1023,7 +1989,7 @@ flash_read_id(uint32_t* manufactureCode,
     flash_TransferBuffer_Fill(flash_buf, 0x00, 3);
     flash_TransferBuffer_SetDir(flash_buf, FLASH_RX_TRANS);
     flash_TransferBuffer_SetCommandLen(flash_buf, FLASH_COMMAND_SIZE);
-    flash_TransferBuffer_SetCommMethod(flash_buf, FLASH_COMM_METHOD_SINGLE);
+    flash_TransferBuffer_SetCommMethod(flash_buf, comm_method);
 
 
     fe = flash_Transfer(flash_buf, initialised);
@@ -1040,6 +2006,15 @@ flash_read_id(uint32_t* manufactureCode,
     return FLASH_NO_ERROR;
 }
 
+flash_error
+flash_read_id(uint32_t* manufactureCode,
+             uint32_t* memIfaceType,
+             uint32_t* density)
+{
+    return flash_ReadIdFrom(FLASH_COMM_METHOD_SINGLE,
+                            manufactureCode, memIfaceType, density);
+}
+
 size_t
 flash_device_size(void)
 {
@@ -1052,9 +2027,292 @@ flash_device_sector_erase_size(void)
     return flash_erase_sector_size;
 }
 
+/*
+ * The largest read sent to the flash as one command.
+ */
+size_t
+flash_device_read_max(void)
+{
+    return FLASH_READ_MAX;
+}
+
+flash_error
+flash_dma_check(void)
+{
+#if FLASH_DMA_READ
+    static uint8_t dma[FLASH_DMA_CHECK_SIZE] __attribute__((aligned(FLASH_DMA_ALIGN)));
+    static uint8_t fifo[FLASH_DMA_CHECK_SIZE] __attribute__((aligned(FLASH_DMA_ALIGN)));
+    const size_t   head = FLASH_DMA_ALIGN - FLASH_DMA_CHECK_HEAD;
+    const size_t   length = FLASH_DMA_CHECK_SIZE - head - FLASH_DMA_CHECK_TAIL;
+    size_t         i;
+    flash_error    fe;
+
+    if (flash_page_size == 0)
+        return FLASH_NOT_OPEN;
+
+    /*
+     * The buffers are written by the CPU so their lines are dirty when the
+     * DMA starts.
+     */
+    memset(dma, FLASH_DMA_CHECK_GUARD, sizeof(dma));
+    memset(fifo, FLASH_DMA_CHECK_GUARD, sizeof(fifo));
+
+    flash_dma_read = false;
+    fe = flash_read(0, fifo + head, length);
+    flash_dma_read = true;
+    if (fe != FLASH_NO_ERROR)
+        return fe;
+
+    fe = flash_read(0, dma + head, length);
+    if (fe != FLASH_NO_ERROR)
+        return fe;
+
+    for (i = 0; i < sizeof(dma); ++i)
+    {
+        if (dma[i] != fifo[i])
+        {
+            printf("error: flash: DMA check: offset %zu: DMA %02x FIFO %02x\n",
+                   i, dma[i], fifo[i]);
+            return FLASH_DMA_CHECK_FAIL;
+        }
+        if (((i < head) || (i >= (head + length))) &&
+            (dma[i] != FLASH_DMA_CHECK_GUARD))
+        {
+            printf("error: flash: DMA check: guard %zu changed\n", i);
+            return FLASH_DMA_CHECK_FAIL;
+        }
+    }
+#endif
+
+    return FLASH_NO_ERROR;
+}
+
 void
 flash_register_wait_handler(flash_wait_handler handler, void* user)
 {
     wait_Handler = handler;
     wait_Handler_User = user;
 }
+
+/*
+ * The fastest divisor the part can be read at.
+ */
+static int
+flash_ClockDivisorLimit(void)
+{
+    int divisor = FLASH_CLOCK_DIV_FASTEST;
+
+    while ((divisor < FLASH_CLOCK_DIV_DEFAULT) &&
+           ((FLASH_CLOCK_REF_MHZ >> (divisor + 1)) > flash_max_mhz))
+        ++divisor;
+
+    return divisor;
+}
+
+/*
+ * Read the calibration reference and return its CRC and the number of bytes
+ * that differ from the byte before them.
+ */
+static flash_error
+flash_ClockPattern(bool sfdp, CRC32* crc, uint32_t* changes)
+{
+    const uint32_t length = sfdp ? FLASH_CALIBRATE_SFDP_LENGTH : FLASH_CALIBRATE_LENGTH;
+    uint8_t        last = 0;
+    uint32_t       address;
+    flash_error    fe;
+
+    *crc = 0;
+    *changes = 0;
+
+    for (address = 0; address < length; address += FLASH_CALIBRATE_CHUNK)
+    {
+        uint8_t buffer[FLASH_CALIBRATE_CHUNK];
+        size_t  b;
+        if (sfdp)
+            fe = flash_SfdpRead(address, buffer, sizeof(buffer));
+        else
+            fe = flash_read(address, buffer, sizeof(buffer));
+        if (fe != FLASH_NO_ERROR)
+            return fe;
+        for (b = 0; b < sizeof(buffer); ++b)
+        {
+            if (buffer[b] != last)
+                ++*changes;
+            last = buffer[b];
+        }
+        crc32_update(crc, buffer, sizeof(buffer));
+    }
+
+    return FLASH_NO_ERROR;
+}
+
+/*
+ * Check the flash reads correctly with the current clock setting.
+ */
+static flash_error
+flash_ClockCheck(uint32_t manufacture_code,
+                 uint32_t mem_iface_type,
+                 uint32_t density,
+                 bool     sfdp,
+                 CRC32    crc)
+{
+    uint32_t    code = 0;
+    uint32_t    iface = 0;
+    uint32_t    dens = 0;
+    CRC32       check = 0;
+    uint32_t    changes;
+    flash_error fe;
+
+    fe = flash_read_id(&code, &iface, &dens);
+    if (fe != FLASH_NO_ERROR)
+        return fe;
+
+    if ((code != manufacture_code) || (iface != mem_iface_type) || (dens != density))
+        return FLASH_INVALID_CLOCK;
+
+    fe = flash_ClockPattern(sfdp, &check, &changes);
+    if (fe != FLASH_NO_ERROR)
+        return fe;
+
+    if (check != crc)
+        return FLASH_INVALID_CLOCK;
+
+    return FLASH_NO_ERROR;
+}
+
+flash_error
+flash_calibrate(uint32_t* setting)
+{
+    uint32_t    manufacture_code;
+    uint32_t    mem_iface_type;
+    uint32_t    density;
+    CRC32       crc = 0;
+    uint32_t    changes = 0;
+    bool        sfdp = false;
+    int         divisor;
+    int         fastest;
+    bool        found = false;
+    flash_error fe;
+
+    *setting = FLASH_CLOCK_SETTING(FLASH_CLOCK_DIV_DEFAULT,
+                                   FLASH_CLOCK_DELAY_DEFAULT);
+
+    if (flash_page_size == 0)
+        return FLASH_NOT_OPEN;
+
+    /*
+     * The reference is read at the default clock.
+     */
+    flash_SetClock(FLASH_CLOCK_DIV_DEFAULT, FLASH_CLOCK_DELAY_DEFAULT);
+
+    fe = flash_read_id(&manufacture_code, &mem_iface_type, &density);
+    if (fe != FLASH_NO_ERROR)
+        return fe;
+
+    fe = flash_ClockPattern(sfdp, &crc, &changes);
+    if (fe != FLASH_NO_ERROR)
+        return fe;
+
+    if (changes < FLASH_CALIBRATE_CHANGES_MIN)
+    {
+        sfdp = true;
+        fe = flash_ClockPattern(sfdp, &crc, &changes);
+        if (fe != FLASH_NO_ERROR)
+            return fe;
+        if (changes < FLASH_CALIBRATE_CHANGES_MIN)
+            return FLASH_INVALID_CLOCK;
+    }
+
+    fastest = flash_ClockDivisorLimit();
+
+    for (divisor = FLASH_CLOCK_DIV_DEFAULT; divisor >= fastest; --divisor)
+    {
+        uint32_t delay;
+        uint32_t run = 0;
+        uint32_t run_start = 0;
+        uint32_t window = 0;
+        uint32_t window_start = 0;
+
+        for (delay = 0; delay < FLASH_CLOCK_DELAYS; ++delay)
+        {
+            flash_SetClock(divisor, delay);
+            if (flash_ClockCheck(manufacture_code, mem_iface_type,
+                                 density, sfdp, crc) == FLASH_NO_ERROR)
+            {
+                if (run == 0)
+                    run_start = delay;
+                ++run;
+                if (run > window)
+                {
+                    window = run;
+                    window_start = run_start;
+                }
+            }
+            else
+            {
+                run = 0;
+            }
+        }
+
+        /*
+         * A faster clock will not work if this one does not, and a narrow
+         * window is not stable.
+         */
+        if (window < FLASH_CLOCK_WINDOW_MIN)
+            break;
+
+        *setting = FLASH_CLOCK_SETTING(divisor, window_start + (window / 2));
+        found = true;
+    }
+
+    flash_set_clock(*setting);
+
+    return found ? FLASH_NO_ERROR : FLASH_INVALID_CLOCK;
+}
+
+flash_error
+flash_restore_clock(uint32_t setting)
+{
+    uint32_t    manufacture_code;
+    uint32_t    mem_iface_type;
+    uint32_t    density;
+    uint32_t    code = 0;
+    uint32_t    iface = 0;
+    uint32_t    dens = 0;
+    flash_error fe;
+
+    flash_SetClock(FLASH_CLOCK_DIV_DEFAULT, FLASH_CLOCK_DELAY_DEFAULT);
+
+    fe = flash_read_id(&manufacture_code, &mem_iface_type, &density);
+    if (fe != FLASH_NO_ERROR)
+        return fe;
+
+    fe = flash_set_clock(setting);
+    if (fe != FLASH_NO_ERROR)
+        return fe;
+
+    fe = flash_read_id(&code, &iface, &dens);
+    if ((fe != FLASH_NO_ERROR) || (code != manufacture_code) ||
+        (iface != mem_iface_type) || (dens != density))
+    {
+        flash_SetClock(FLASH_CLOCK_DIV_DEFAULT, FLASH_CLOCK_DELAY_DEFAULT);
+        return FLASH_INVALID_CLOCK;
+    }
+
+    return FLASH_NO_ERROR;
+}
+
+flash_error
+flash_set_clock(uint32_t setting)
+{
+    const uint32_t divisor = FLASH_CLOCK_DIVISOR(setting);
+    const uint32_t delay = FLASH_CLOCK_DELAY(setting);
+
+    if (((int) divisor < flash_ClockDivisorLimit()) || (divisor > FLASH_CLOCK_DIV_DEFAULT)
+        || (delay >= FLASH_CLOCK_DELAYS))
+        return FLASH_INVALID_CLOCK;
+
+    flash_SetClock(divisor, delay);
+
+    return FLASH_NO_ERROR;
+}
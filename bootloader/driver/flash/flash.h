@@ -78,6 +78,18 @@
 #define FLASH_COMM_METHOD_SINGLE_TOP    1
 #define FLASH_COMM_METHOD_SINGLE_BOTTOM 2
 
+/*
+ * Read modes. The name is the lanes used for the command, the address and
+ * the data.
+ */
+#define FLASH_READ_MODE_SINGLE   0 /* 1-1-1 */
+#define FLASH_READ_MODE_DUAL_OUT 1 /* 1-1-2 */
+#define FLASH_READ_MODE_QUAD_OUT 2 /* 1-1-4 */
+#define FLASH_READ_MODE_DUAL_IO  3 /* 1-2-2 */
+#define FLASH_READ_MODE_QUAD_IO  4 /* 1-4-4 */
+#define FLASH_READ_MODES         5
+#define FLASH_READ_MODE_AUTO     FLASH_READ_MODES /* Fastest supported */
+
 /*
  * A region is a collection of sections in the flash device.
  */
@@ -108,7 +120,11 @@ typedef enum
     FLASH_WRITE_ACROSS_SECTION,
     FLASH_WRITE_ERASE_CMD_FAIL,
     FLASH_LOCK_FAIL,
-    FLASH_INVALID_DEVICE
+    FLASH_INVALID_DEVICE,
+    FLASH_DMA_TIMEOUT,
+    FLASH_POLL_TIMEOUT,
+    FLASH_INVALID_CLOCK,
+    FLASH_DMA_CHECK_FAIL
 } flash_error;
 
 flash_error flash_open(const char** label);
@@ -132,9 +148,95 @@ flash_error flash_get_regions(flash_region** regions, size_t* size);
 
 size_t flash_device_size(void);
 size_t flash_device_sector_erase_size(void);
+size_t flash_device_read_max(void);
+
+/*
+ * Check the DMA reads against RX FIFO reads of the start of the flash. The
+ * read starts and ends part way into a cache line so the FIFO head, the DMA
+ * lines and the FIFO tail are checked, and the bytes either side of the
+ * read must not change. Set FLASH_DMA_READ_CHECK to 1 to run it at boot, for
+ * example under QEMU's ZCU102 model. Without the DMA it always passes.
+ */
+#if !defined(FLASH_DMA_READ_CHECK)
+#define FLASH_DMA_READ_CHECK 0
+#endif
+
+flash_error flash_dma_check(void);
+
+/*
+ * QSPI clock calibration. A clock setting is a baud rate divisor and a
+ * loopback RX delay. The calibration steps the clock up from the default
+ * to the part's fastest clock and at each divisor sweeps the delays
+ * checking the ID and a CRC of the start of the flash, or of the SFDP
+ * tables if the start of the flash is blank. The result is the centre of
+ * the widest passing delay window of the fastest divisor with a window of
+ * at least FLASH_CLOCK_WINDOW_MIN delays. A narrower window is a marginal
+ * clock. A saved setting is restored with flash_restore_clock(), which
+ * reads the ID at the setting and returns to the default clock if it does
+ * not match.
+ */
+#if !defined(FLASH_CLOCK_CALIBRATE)
+#define FLASH_CLOCK_CALIBRATE 1
+#endif
+
+#if !defined(FLASH_CLOCK_WINDOW_MIN)
+#define FLASH_CLOCK_WINDOW_MIN 3
+#endif
+
+#define FLASH_CLOCK_SETTING(_div, _dly) ((((_div) & 0xff) << 8) | ((_dly) & 0xff))
+#define FLASH_CLOCK_DIVISOR(_s)        (((_s) >> 8) & 0xff)
+#define FLASH_CLOCK_DELAY(_s)          ((_s) & 0xff)
+
+flash_error flash_calibrate(uint32_t* setting);
+flash_error flash_set_clock(uint32_t setting);
+flash_error flash_restore_clock(uint32_t setting);
+
+/*
+ * A command queue. The steps run back to back in one controller session
+ * with the controller set up and the FIFOs flushed once. A queue holding
+ * program or erase steps unlocks the device for the run. A wait step
+ * polls for the program or erase to complete, the length is the delay in
+ * micro-seconds between the status checks. A step that cannot be added
+ * fails the queue and the run returns the error without running any step.
+ */
+typedef enum
+{
+    FLASH_STEP_WRITE_ENABLE,
+    FLASH_STEP_PROGRAM,
+    FLASH_STEP_ERASE_SECTOR,
+    FLASH_STEP_WAIT,
+    FLASH_STEP_READ
+} flash_step_type;
+
+typedef struct
+{
+    flash_step_type type;
+    uint32_t        address;
+    void*           data;
+    size_t          length;
+} flash_step;
+
+#define FLASH_QUEUE_STEPS 16
+
+typedef struct
+{
+    flash_step  steps[FLASH_QUEUE_STEPS];
+    size_t      count;
+    flash_error error;
+} flash_queue;
+
+void flash_queue_init(flash_queue* queue);
+flash_error flash_queue_add(flash_queue*    queue,
+                            flash_step_type type,
+                            uint32_t        address,
+                            void*           data,
+                            size_t          length);
+flash_error flash_queue_run(flash_queue* queue);
 
 /*
- * A transfer buffer has a buffer and length.
+ * A transfer buffer has a buffer and length. A read can scatter the data to
+ * a payload, the buffer then only holds the command, address and dummy
+ * bytes and the received data lands directly in the payload.
  */
 typedef struct
 {
@@ -146,6 +248,11 @@ typedef struct
     uint32_t  trans_dir;
     uint32_t  command_len;
     uint32_t  comm_method;
+    uint32_t  addr_lanes;   /* Lanes for the bytes after the command */
+    uint32_t  data_lanes;   /* Lanes for the data */
+    uint32_t  dummy_cycles; /* Clocks between the header and the data */
+    uint8_t*  payload;      /* RX data destination, NULL to use buffer */
+    size_t    payload_length;
 } flash_transfer_buffer;
 /*
  * Special handler function used by the tester.
@@ -0,0 +1,113 @@
+/*
+ * Copyright 2026 Contemporary Software
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+/*
+ * Host flash. The flash is an image file mapped into memory.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <board.h>
+
+#include "flash.h"
+
+static const uint8_t* image;
+static size_t         image_size;
+static size_t         erase_size = HOST_FLASH_ERASE_SIZE;
+static bool           opened;
+
+int
+host_flash_attach(const char* path, size_t erase)
+{
+    struct stat sb;
+    void*       data;
+    int         fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return errno;
+    if (fstat(fd, &sb) < 0)
+    {
+        int err = errno;
+        close(fd);
+        return err;
+    }
+    if (erase == 0 || sb.st_size == 0 || (sb.st_size % erase) != 0)
+    {
+        close(fd);
+        return EINVAL;
+    }
+    data = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return errno;
+    image = data;
+    image_size = sb.st_size;
+    erase_size = erase;
+    return 0;
+}
+
+flash_error
+flash_open(const char** label)
+{
+    if (image == NULL)
+        return FLASH_INVALID_DEVICE;
+    *label = "host image";
+    opened = true;
+    return FLASH_NO_ERROR;
+}
+
+flash_error
+flash_close(void)
+{
+    opened = false;
+    return FLASH_NO_ERROR;
+}
+
+flash_error
+flash_read(uint32_t address, void* buffer, size_t length)
+{
+    if (!opened)
+        return FLASH_NOT_OPEN;
+    if (address > image_size || length > (image_size - address))
+        return FLASH_BAD_ADDRESS;
+    memcpy(buffer, image + address, length);
+    return FLASH_NO_ERROR;
+}
+
+size_t
+flash_device_size(void)
+{
+    return image_size;
+}
+
+size_t
+flash_device_sector_erase_size(void)
+{
+    return erase_size;
+}
+
+size_t
+flash_device_read_max(void)
+{
+    return image_size;
+}
@@ -14,6 +14,12 @@
  *     limitations under the License.
  */
 
+#include <string.h>
+
+#include <cache.h>
+
+#include <driver/timer/board-timer.h>
+
 #include "flash-board.h"
 #include "zynq7000-flash.h"
 
@@ -63,6 +69,20 @@ flash_writeLock(void)
                     (GPIO_FLASH_WD_EN << GPIO_FLASH_WD_PIN));
 }
 
+/*
+ * The baud rate divisor and loopback delay written when the controller is
+ * initialised.
+ */
+static uint32_t qspi_baud = QSPI_CR_BAUD_RATE;
+static uint32_t qspi_lpbk = QSPI_LPBK_USE_LPBK | FLASH_CLOCK_DELAY_DEFAULT;
+
+void
+flash_SetClock(uint32_t divisor, uint32_t delay)
+{
+    qspi_baud = (divisor << QSPI_CR_BAUD_RATE_SHIFT) & QSPI_CR_BAUD_RATE_MASK;
+    qspi_lpbk = QSPI_LPBK_USE_LPBK | (delay & QSPI_LPBK_DLY_MASK);
+}
+
 static void
 qspi_FlushRx(void)
 {
@@ -74,10 +94,41 @@ qspi_FlushRx(void)
     }
 }
 
+static void
+qspi_Init(void)
+{
+    qspi_reg_write(QSPI_REG_EN, 0);
+    qspi_reg_write(QSPI_REG_LSPI_CFG, 0x00a002eb);
+    qspi_reg_write(QSPI_REG_LPBK_DLY_ADJ, qspi_lpbk);
+    qspi_FlushRx();
+    qspi_reg_write(QSPI_REG_CONFIG,
+                   QSPI_CR_SSFORCE | QSPI_CR_MANSTRTEN | QSPI_CR_HOLDB_DR |
+                   qspi_baud | QSPI_CR_MODE_SEL);
+}
+
+/*
+ * SPI is enabled for each transfer as it releases the slave select so a
+ * session only holds the configuration.
+ */
+void
+flash_SessionOpen(void)
+{
+    qspi_Init();
+}
+
+void
+flash_SessionClose(void)
+{
+    qspi_reg_write(QSPI_REG_EN, 0);
+}
+
 flash_error flash_Transfer(flash_transfer_buffer* transfer, bool initialised)
 {
     uint32_t* tx_data;
     uint32_t* rx_data;
+    uint32_t* header_end;
+    uint8_t*  payload = transfer->payload;
+    size_t    payload_length = 0;
     size_t    tx_length;
     size_t    rx_length;
     uint32_t  tx_reg;
@@ -87,13 +138,7 @@ flash_error flash_Transfer(flash_transfer_buffer* transfer, bool initialised)
 
     if (initialised == false)
     {
-      qspi_reg_write(QSPI_REG_EN, 0);
-      qspi_reg_write(QSPI_REG_LSPI_CFG, 0x00a002eb);
-      qspi_FlushRx();
-      qspi_reg_write(QSPI_REG_CONFIG,
-                     QSPI_CR_SSFORCE | QSPI_CR_MANSTRTEN | QSPI_CR_HOLDB_DR |
-                     QSPI_CR_BAUD_RATE | QSPI_CR_MODE_SEL);
-      initialised = true;
+      qspi_Init();
     }
 
     flash_transfer_trace("transfer:TX", transfer);
@@ -117,6 +162,19 @@ flash_error flash_Transfer(flash_transfer_buffer* transfer, bool initialised)
     tx_length = transfer->length;
     rx_length = transfer->length;
 
+    /*
+     * A payload is clocked in with zero TX words after the header. The
+     * padding word aligns the end of the header so the payload starts on a
+     * RX word.
+     */
+    header_end = (uint32_t*) (transfer->buffer + transfer->padding + transfer->length);
+    if ((transfer->trans_dir == FLASH_RX_TRANS) && (payload != NULL))
+    {
+        payload_length = transfer->payload_length;
+        tx_length += (payload_length + 3) & ~3;
+        rx_length += (payload_length + 3) & ~3;
+    }
+
     /*
      * The buffer to right aligned, that is padding is add to the front of the
      * buffer to get the correct aligment for the instruction size. This means
@@ -180,8 +238,20 @@ flash_error flash_Transfer(flash_transfer_buffer* transfer, bool initialised)
             {
                 if ((sr & QSPI_IXR_RXNEMPTY) != 0)
                 {
-                    *rx_data = qspi_reg_read(QSPI_REG_RX_DATA);
-                    ++rx_data;
+                    if (rx_data < header_end)
+                    {
+                        *rx_data = qspi_reg_read(QSPI_REG_RX_DATA);
+                        ++rx_data;
+                    }
+                    else
+                    {
+                        uint32_t word = qspi_reg_read(QSPI_REG_RX_DATA);
+                        size_t   size = payload_length > sizeof(uint32_t) ?
+                            sizeof(uint32_t) : payload_length;
+                        memcpy(payload, &word, size);
+                        payload += size;
+                        payload_length -= size;
+                    }
                     if (rx_length > sizeof(uint32_t))
                         rx_length -= sizeof(uint32_t);
                     else
@@ -201,8 +271,15 @@ flash_error flash_Transfer(flash_transfer_buffer* transfer, bool initialised)
             start = false;
             while (tx_length && ((sr & QSPI_IXR_TXFULL) == 0))
             {
-                qspi_reg_write (QSPI_REG_TXD0, *tx_data);
-                ++tx_data;
+                if (tx_data < header_end)
+                {
+                    qspi_reg_write (QSPI_REG_TXD0, *tx_data);
+                    ++tx_data;
+                }
+                else
+                {
+                    qspi_reg_write (QSPI_REG_TXD0, 0);
+                }
                 if (tx_length > sizeof(uint32_t))
                     tx_length -= sizeof(uint32_t);
                 else
@@ -241,3 +318,121 @@ flash_error flash_Transfer(flash_transfer_buffer* transfer, bool initialised)
 
     return FLASH_NO_ERROR;
 }
+
+/*
+ * Read a byte with the slave select held. The byte written to TXD1 is
+ * received in the top byte of the RX word.
+ */
+static uint8_t
+qspi_ByteTransfer(uint8_t data)
+{
+    qspi_reg_write(QSPI_REG_TXD1, data);
+    qspi_reg_write(QSPI_REG_CONFIG,
+                   qspi_reg_read(QSPI_REG_CONFIG) | QSPI_CR_MANSTRT);
+    while ((qspi_reg_read(QSPI_REG_INTR_STATUS) & QSPI_IXR_RXNEMPTY) == 0)
+        ;
+    return (uint8_t) (qspi_reg_read(QSPI_REG_RX_DATA) >> 24);
+}
+
+/*
+ * The flash repeats the status register for as long as the slave select is
+ * held so the command is sent once and the status bytes are clocked in until
+ * the value matches.
+ */
+flash_error
+flash_PollStatus(uint32_t comm_method, uint8_t command,
+                 uint8_t mask, uint8_t value, uint32_t timeout_usecs,
+                 bool initialised)
+{
+    uint64_t    start;
+    uint64_t    now;
+    flash_error fe = FLASH_NO_ERROR;
+
+    (void) comm_method;
+
+    if (initialised == false)
+    {
+      qspi_Init();
+    }
+
+    qspi_FlushRx();
+
+    /*
+     * Set the slave select and enable SPI.
+     */
+    qspi_reg_write(QSPI_REG_CONFIG,
+                   qspi_reg_read(QSPI_REG_CONFIG) & ~QSPI_CR_PCS);
+    qspi_reg_write(QSPI_REG_EN, QSPI_EN_SPI_ENABLE);
+
+    qspi_ByteTransfer(command);
+
+    board_timer_get(&start);
+    while ((qspi_ByteTransfer(0) & mask) != value)
+    {
+        board_timer_get(&now);
+        if ((now - start) > timeout_usecs)
+        {
+            fe = FLASH_POLL_TIMEOUT;
+            break;
+        }
+    }
+
+    /*
+     * Disable the slave select and SPI.
+     */
+    qspi_reg_write(QSPI_REG_CONFIG,
+                   qspi_reg_read(QSPI_REG_CONFIG) | QSPI_CR_PCS);
+    qspi_reg_write(QSPI_REG_EN, 0);
+
+    return fe;
+}
+
+#if FLASH_LINEAR_READ
+/*
+ * The linear mode read command and dummy bytes. The controller selects the
+ * lanes from the command.
+ */
+static uint32_t linear_cfg;
+
+void
+flash_LinearSetup(uint8_t command, uint32_t dummy_bytes)
+{
+    linear_cfg = QSPI_LCFG_INST(command) | QSPI_LCFG_DUMMY(dummy_bytes);
+}
+
+flash_error
+flash_LinearRead(uint32_t address, void* buffer, size_t length)
+{
+    const uint8_t* window = (const uint8_t*) QSPI_LINEAR_BASE;
+
+    if ((linear_cfg == 0) || (address >= QSPI_LINEAR_SIZE)
+        || ((QSPI_LINEAR_SIZE - address) < length))
+        return FLASH_BAD_ADDRESS;
+
+    /*
+     * The linear controller drives the chip select and starts the transfers.
+     */
+    qspi_reg_write(QSPI_REG_EN, 0);
+    qspi_reg_write(QSPI_REG_CONFIG,
+                   QSPI_CR_IFMODE | QSPI_CR_HOLDB_DR |
+                   qspi_baud | QSPI_CR_MODE_SEL);
+    qspi_reg_write(QSPI_REG_LSPI_CFG, QSPI_LCFG_LQ_MODE | linear_cfg);
+    qspi_reg_write(QSPI_REG_EN, QSPI_EN_SPI_ENABLE);
+
+    /*
+     * The window is cached and may hold data from before a program or
+     * erase.
+     */
+    cache_invalidate_range(window + address, length);
+
+    memcpy(buffer, window + address, length);
+
+    /*
+     * Back to the I/O mode configuration. A read in a session is followed
+     * by I/O transfers that do not initialise the controller.
+     */
+    qspi_Init();
+
+    return FLASH_NO_ERROR;
+}
+#endif
@@ -28,6 +28,18 @@
 #define FLASH_COMM_METHOD_ALL 0 /* Unused */
 #define FLASH_4BYTE_ADDRESSING  0
 #define FLASH_FAST_READ         1
+#define FLASH_READ_MODE         FLASH_READ_MODE_SINGLE /* I/O mode is one lane */
+#define FLASH_READ_MAX          (1024 * 1024)
+
+/*
+ * Linear mode reads. Reads in the linear window are a copy from the memory
+ * mapped flash. Set FLASH_LINEAR_READ to 0 to read in I/O mode.
+ */
+#if !defined(FLASH_LINEAR_READ)
+#define FLASH_LINEAR_READ       1
+#endif
+#define QSPI_LINEAR_BASE        (0xfc000000)
+#define QSPI_LINEAR_SIZE        (16 * 1024 * 1024)
 
 /*
  * QSPI registers.
@@ -61,6 +73,7 @@
 /*
  * Control register.
  */
+#define QSPI_CR_IFMODE          (1 << 31)
 #define QSPI_CR_HOLDB_DR        (1 << 19)
 #define QSPI_CR_MANSTRT         (1 << 16)
 #define QSPI_CR_MANSTRTEN       (1 << 15)
@@ -70,12 +83,21 @@
 #define QSPI_CR_BAUD_RATE_DIV_4 (1 << 3)
 #define QSPI_CR_BAUD_RATE_DIV_8 (2 << 3)
 #define QSPI_CR_MODE_SEL        (1 << 0)
+#define QSPI_CR_BAUD_RATE_MASK  (7 << 3)
+#define QSPI_CR_BAUD_RATE_SHIFT 3
 
 /*
  * Fast clock rate of 100MHz for fast reads.
  */
 #define QSPI_CR_BAUD_RATE_FAST  QSPI_CR_BAUD_RATE_DIV_2
 
+/*
+ * Linear configuration register.
+ */
+#define QSPI_LCFG_LQ_MODE       (1 << 31)
+#define QSPI_LCFG_DUMMY(_d)     (((_d) & 7) << 8)
+#define QSPI_LCFG_INST(_i)      ((_i) & 0xff)
+
 /*
  * Status register.
  */
@@ -88,6 +110,12 @@
  */
 #define QSPI_EN_SPI_ENABLE  (1 << 0)
 
+/*
+ * Loopback delay register.
+ */
+#define QSPI_LPBK_USE_LPBK  (1 << 5)
+#define QSPI_LPBK_DLY_MASK  (0x1f)
+
 /*
  * Clock rate is 200MHz and 50MHz is the normal rate and 100MHz the fast rate.
  */
@@ -97,6 +125,21 @@
  #define QSPI_CR_BAUD_RATE QSPI_CR_BAUD_RATE_DIV_4
 #endif
 
+/*
+ * QSPI clock calibration. The baud rate divisor divides the reference clock
+ * by 2^(n + 1). The delay is the loopback RX delay, DLY1 and DLY0 in
+ * QSPI_REG_LPBK_DLY_ADJ. The default delay is the register's reset value.
+ * FLASH_CLOCK_REF_MHZ is the reference clock and limits the divisor to the
+ * part's fastest clock.
+ */
+#if !defined(FLASH_CLOCK_REF_MHZ)
+#define FLASH_CLOCK_REF_MHZ       200
+#endif
+#define FLASH_CLOCK_DIV_DEFAULT   (QSPI_CR_BAUD_RATE >> QSPI_CR_BAUD_RATE_SHIFT)
+#define FLASH_CLOCK_DIV_FASTEST   0
+#define FLASH_CLOCK_DELAY_DEFAULT 0x13
+#define FLASH_CLOCK_DELAYS        32
+
 
 
 /*
@@ -118,4 +161,26 @@ void flash_writeLock(void);
 
 flash_error flash_Transfer(flash_transfer_buffer* transfer, bool initialised);
 
+void flash_SetClock(uint32_t divisor, uint32_t delay);
+
+/*
+ * A session holds the controller up across transfers. Transfers made
+ * with initialised set skip the controller set up.
+ */
+void flash_SessionOpen(void);
+void flash_SessionClose(void);
+
+/*
+ * Poll a status register until (status & mask) == value. The slave select
+ * is held and the register is read back to back in one command.
+ */
+flash_error flash_PollStatus(uint32_t comm_method, uint8_t command,
+                             uint8_t mask, uint8_t value,
+                             uint32_t timeout_usecs, bool initialised);
+
+#if FLASH_LINEAR_READ
+void flash_LinearSetup(uint8_t command, uint32_t dummy_bytes);
+flash_error flash_LinearRead(uint32_t address, void* buffer, size_t length);
+#endif
+
 #endif /* _BOOTLOADER_FLASH_ZYNQ_H_ */
@@ -14,10 +14,15 @@
  *     limitations under the License.
  */
 
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
+#include <cache.h>
+
 #include <driver/io/board-io.h>
+#include <driver/timer/board-timer.h>
 
 #include "zynqmp-flash.h"
 
@@ -106,8 +111,23 @@ static uint32_t command_word_generator(
   return command;
 }
 
+/*
+ * The generic FIFO mode for the number of lanes.
+ */
+static uint8_t qspi_LaneMode(uint32_t lanes)
+{
+  if (lanes == 4) {
+    return (uint8_t)(GQSPI_GENFIFO_MODE_QUADSPI >> CMD_OFFSET_MODE);
+  }
+  if (lanes == 2) {
+    return (uint8_t)(GQSPI_GENFIFO_MODE_DUALSPI >> CMD_OFFSET_MODE);
+  }
+  return (uint8_t)(GQSPI_GENFIFO_MODE_SPI >> CMD_OFFSET_MODE);
+}
+
 static uint32_t command_wrapper(
   uint8_t parallel,
+  uint8_t lanes,
   uint8_t imm_data,
   uint8_t exp,
   uint8_t txrx,
@@ -136,7 +156,7 @@ static uint32_t command_wrapper(
     imm_data,
     (uint8_t)1,
     exp,
-    (uint8_t)GQSPI_SELECT_MODE_SPI,
+    qspi_LaneMode(lanes),
     cs_lower,
     cs_upper,
     bus,
@@ -159,6 +179,22 @@ flash_writeLock(void)
   return;
 }
 
+/*
+ * The configuration and loopback delay written when the controller is
+ * initialised.
+ */
+static uint32_t qspi_config = QSPI_CONFIG_INIT_VAL;
+static uint32_t qspi_lpbk = GQSPI_LPBK_DLY_ADJ_USE_LPBK_MASK;
+
+void
+flash_SetClock(uint32_t divisor, uint32_t delay)
+{
+    qspi_config = (QSPI_CONFIG_INIT_VAL & ~GQSPI_CFG_BAUD_RATE_DIV_MASK) |
+      ((divisor << GQSPI_CFG_BAUD_RATE_DIV_SHIFT) & GQSPI_CFG_BAUD_RATE_DIV_MASK);
+    qspi_lpbk = GQSPI_LPBK_DLY_ADJ_USE_LPBK_MASK |
+      (delay & GQSPI_LPBK_DLY_ADJ_DLY_MASK);
+}
+
 size_t flash_get_padding(size_t length) {
     return 0;
 }
@@ -201,97 +237,83 @@ qspi_FlushAll(void)
     qspi_FlushGen();
 }
 
-flash_error flash_Transfer(flash_transfer_buffer* transfer, bool initialised)
+/*
+ * Bring the controller up and flush the FIFOs. A transfer in a session
+ * finds the controller up and the FIFOs empty.
+ */
+static void
+qspi_TransferBegin(bool initialised)
 {
-    uint32_t* tx_data;
-    uint32_t* rx_data;
-    size_t    tx_length;
-    size_t    rx_length;
-    uint32_t  sr;
-    uint32_t  controller_command;
-    uint8_t   trans_dir;
-    size_t    length;
-    size_t    transfer_length = 0;
-    uint32_t  x;
-    uint32_t  header_len;
-    uint32_t  communication_method;
-
-    /*
-     * Enable QSPI.
-     */
-    qspi_reg_write(GQSPI_EN_OFST, GQSPI_EN_MASK);
-
-
-    if (initialised == false || true)
+    if (initialised == false)
     {
-      qspi_reg_write(GQSPI_CONFIG_OFST, QSPI_CONFIG_INIT_VAL);
+      qspi_reg_write(GQSPI_EN_OFST, GQSPI_EN_MASK);
+      qspi_reg_write(GQSPI_CONFIG_OFST, qspi_config);
       qspi_reg_write(GQSPI_SEL_OFST, GQSPI_SEL_MASK);
       qspi_reg_write(GQSPI_IDR_OFST, GQSPI_IDR_ALL_MASK);
-      qspi_reg_write(GQSPI_LPBK_DLY_ADJ_OFST, GQSPI_LPBK_DLY_ADJ_USE_LPBK_MASK);
-      initialised = true;
+      qspi_reg_write(GQSPI_LPBK_DLY_ADJ_OFST, qspi_lpbk);
+      qspi_FlushAll();
     }
+}
 
-    if (transfer->trans_dir == FLASH_TX_TRANS) {
-      flash_transfer_trace("transfer:TX", transfer);
-    } else {
-      flash_transfer_trace("transfer:RX", transfer);
-    }
-
-    /*
-     * Flush Rx, Tx and Command Generator FIFOs
-     */
-    qspi_FlushAll();
-
-    /*
-     * The RX pointer can never catch up and overtake the TX pointer.
-     */
-    tx_data = (uint32_t*) transfer->buffer;
-    rx_data = (uint32_t*) transfer->buffer;
-    tx_length = transfer->length - transfer->command_len;
-    rx_length = transfer->length - transfer->command_len;
-    length = transfer->length;
-
-    trans_dir = (uint8_t)transfer->trans_dir;
-    header_len = transfer->command_len;
-    communication_method = transfer->comm_method;
+/*
+ * Deassert the chip selects after the hold time and wait for the generic
+ * FIFO to empty. The controller is left up in a session.
+ */
+static void
+qspi_TransferEnd(uint32_t communication_method, bool initialised)
+{
+    uint32_t controller_command;
 
-    /* Send command and address bytes if present */
     controller_command = command_wrapper
       (
         communication_method,
-        header_len,
+        1,
+        GQSPI_GENFIFO_CS_HOLD,
         IMMD_SIZE,
         FLASH_TX_TRANS,
         NOSTRIPE
       );
+    controller_command &= ~((1UL << CMD_OFFSET_DATA_XFER) |
+                            (1UL << CMD_OFFSET_TX) |
+                            (1UL << CMD_OFFSET_CS_LOWER) |
+                            (1UL << CMD_OFFSET_CS_UPPER));
     qspi_reg_write(GQSPI_GEN_FIFO_OFST, controller_command);
 
-    x = 0;
-    while (x < header_len) {
-        qspi_reg_write(GQSPI_TXD_OFST, *tx_data);
-        ++tx_data;
-        sr = qspi_reg_read(GQSPI_ISR_OFST);
-        while ((sr & GQSPI_ISR_TXEMPTY_MASK) != 0) {
-          sr = qspi_reg_read(GQSPI_ISR_OFST);
-        }
-        x = x + sizeof(uint32_t);
-    }
+    qspi_reg_write(GQSPI_CONFIG_OFST,
+                   qspi_reg_read(GQSPI_CONFIG_OFST) | GQSPI_CFG_START_GEN_FIFO_MASK);
+    while ((qspi_reg_read(GQSPI_ISR_OFST) & GQSPI_ISR_GENFIFOEMPTY_MASK) == 0)
+      ;
 
-    if (trans_dir == FLASH_TX_TRANS) {
-      if (tx_length < x) {
-        tx_length = 0;
-      } else {
-        tx_length = tx_length - x;
-      }
-    }
+    if (initialised == false)
+      qspi_reg_write(GQSPI_EN_OFST, 0);
+}
 
-    length = tx_length;
-    if (length == 0) {
-      qspi_reg_write(GQSPI_CONFIG_OFST,
-                   qspi_reg_read(GQSPI_CONFIG_OFST) | GQSPI_CFG_START_GEN_FIFO_MASK);
-    }
+void
+flash_SessionOpen(void)
+{
+    qspi_TransferBegin(false);
+}
+
+void
+flash_SessionClose(void)
+{
+    qspi_reg_write(GQSPI_EN_OFST, 0);
+}
+
+/*
+ * Queue generic FIFO entries to transfer the data. Lengths over 255 bytes
+ * are split into power of two transfers using the exponent form.
+ */
+static flash_error
+qspi_GenFifoData(uint32_t communication_method,
+                 uint32_t lanes,
+                 size_t   length,
+                 uint8_t  trans_dir)
+{
+    uint32_t controller_command;
+    size_t   transfer_length = 0;
+    uint32_t sr;
 
-    /* Command generation */
     while (length != 0) {
         if (length <= 0xFF) {
           /*
@@ -304,6 +326,7 @@ flash_error flash_Transfer(flash_transfer_buffer* transfer, bool initialised)
           controller_command = command_wrapper
             (
                communication_method,
+               lanes,
                transfer_length,
                IMMD_SIZE,
                trans_dir,
@@ -327,6 +350,7 @@ flash_error flash_Transfer(flash_transfer_buffer* transfer, bool initialised)
           controller_command = command_wrapper
             (
                communication_method,
+               lanes,
                transfer_length,
                EXP_SIZE,
                trans_dir,
@@ -342,6 +366,204 @@ flash_error flash_Transfer(flash_transfer_buffer* transfer, bool initialised)
         }
     }
 
+    return FLASH_NO_ERROR;
+}
+
+/*
+ * Queue the generic FIFO entries for the command, the address and any dummy
+ * cycles, and write the header to the TX FIFO. The command byte is always
+ * sent on one lane. Returns the number of bytes written to the TX FIFO.
+ */
+static uint32_t
+qspi_GenFifoHeader(const flash_transfer_buffer* transfer)
+{
+    const uint32_t* tx_data = (const uint32_t*) transfer->buffer;
+    uint32_t        header_len = transfer->command_len;
+    uint32_t        controller_command;
+    uint32_t        sr;
+    uint32_t        x = 0;
+
+    if (transfer->addr_lanes > 1 && header_len > 1) {
+      controller_command = command_wrapper
+        (
+          transfer->comm_method,
+          1,
+          1,
+          IMMD_SIZE,
+          FLASH_TX_TRANS,
+          NOSTRIPE
+        );
+      qspi_reg_write(GQSPI_GEN_FIFO_OFST, controller_command);
+      controller_command = command_wrapper
+        (
+          transfer->comm_method,
+          transfer->addr_lanes,
+          header_len - 1,
+          IMMD_SIZE,
+          FLASH_TX_TRANS,
+          NOSTRIPE
+        );
+      qspi_reg_write(GQSPI_GEN_FIFO_OFST, controller_command);
+    } else {
+      controller_command = command_wrapper
+        (
+          transfer->comm_method,
+          1,
+          header_len,
+          IMMD_SIZE,
+          FLASH_TX_TRANS,
+          NOSTRIPE
+        );
+      qspi_reg_write(GQSPI_GEN_FIFO_OFST, controller_command);
+    }
+
+    /*
+     * A data transfer with TX and RX clear clocks the immediate data
+     * number of dummy cycles.
+     */
+    if (transfer->dummy_cycles != 0) {
+      controller_command = command_wrapper
+        (
+          transfer->comm_method,
+          transfer->data_lanes,
+          transfer->dummy_cycles,
+          IMMD_SIZE,
+          FLASH_TX_TRANS,
+          NOSTRIPE
+        );
+      controller_command &= ~((1UL << CMD_OFFSET_TX) | (1UL << CMD_OFFSET_RX));
+      qspi_reg_write(GQSPI_GEN_FIFO_OFST, controller_command);
+    }
+
+    while (x < header_len) {
+        qspi_reg_write(GQSPI_TXD_OFST, *tx_data);
+        ++tx_data;
+        sr = qspi_reg_read(GQSPI_ISR_OFST);
+        while ((sr & GQSPI_ISR_TXEMPTY_MASK) != 0) {
+          sr = qspi_reg_read(GQSPI_ISR_OFST);
+        }
+        x = x + sizeof(uint32_t);
+    }
+
+    return x;
+}
+
+/*
+ * Receive the payload with one command. The RX FIFO is drained straight
+ * into the payload.
+ */
+static flash_error
+qspi_TransferPayload(flash_transfer_buffer* transfer, bool initialised)
+{
+    uint8_t*    data = transfer->payload;
+    size_t      length = transfer->payload_length;
+    uint32_t    sr;
+    uint32_t    word;
+    flash_error fe;
+
+    qspi_TransferBegin(initialised);
+
+    flash_transfer_trace("transfer:RX", transfer);
+
+    qspi_GenFifoHeader(transfer);
+
+    fe = qspi_GenFifoData(transfer->comm_method, transfer->data_lanes,
+                          length, FLASH_RX_TRANS);
+    if (fe != FLASH_NO_ERROR) {
+      qspi_FlushAll();
+      qspi_TransferEnd(transfer->comm_method, initialised);
+      return fe;
+    }
+
+    qspi_reg_write(GQSPI_CONFIG_OFST,
+                   qspi_reg_read(GQSPI_CONFIG_OFST) | GQSPI_CFG_START_GEN_FIFO_MASK);
+
+    while (length) {
+        sr = qspi_reg_read(GQSPI_ISR_OFST);
+        if ((sr & GQSPI_ISR_RXEMPTY_MASK) != 0) {
+            continue;
+        }
+        word = qspi_reg_read(GQSPI_RXD_OFST);
+        if (length >= sizeof(uint32_t)) {
+            memcpy(data, &word, sizeof(uint32_t));
+            data += sizeof(uint32_t);
+            length -= sizeof(uint32_t);
+        } else {
+            /*
+             * The last word is padded.
+             */
+            memcpy(data, &word, length);
+            length = 0;
+        }
+    }
+
+    qspi_TransferEnd(transfer->comm_method, initialised);
+
+    return FLASH_NO_ERROR;
+}
+
+flash_error flash_Transfer(flash_transfer_buffer* transfer, bool initialised)
+{
+    uint32_t* tx_data;
+    uint32_t* rx_data;
+    size_t    tx_length;
+    size_t    rx_length;
+    uint32_t  sr;
+    uint8_t   trans_dir;
+    size_t    length;
+    uint32_t  x;
+    uint32_t  communication_method;
+
+    if ((transfer->trans_dir == FLASH_RX_TRANS) && (transfer->payload != NULL)) {
+      return qspi_TransferPayload(transfer, initialised);
+    }
+
+    qspi_TransferBegin(initialised);
+
+    if (transfer->trans_dir == FLASH_TX_TRANS) {
+      flash_transfer_trace("transfer:TX", transfer);
+    } else {
+      flash_transfer_trace("transfer:RX", transfer);
+    }
+
+    /*
+     * The RX pointer can never catch up and overtake the TX pointer.
+     */
+    tx_data = (uint32_t*) transfer->buffer;
+    rx_data = (uint32_t*) transfer->buffer;
+    tx_length = transfer->length - transfer->command_len;
+    rx_length = transfer->length - transfer->command_len;
+    length = transfer->length;
+
+    trans_dir = (uint8_t)transfer->trans_dir;
+    communication_method = transfer->comm_method;
+
+    /* Send command and address bytes if present */
+    x = qspi_GenFifoHeader(transfer);
+    tx_data += x / sizeof(uint32_t);
+
+    if (trans_dir == FLASH_TX_TRANS) {
+      if (tx_length < x) {
+        tx_length = 0;
+      } else {
+        tx_length = tx_length - x;
+      }
+    }
+
+    length = tx_length;
+    if (length == 0) {
+      qspi_reg_write(GQSPI_CONFIG_OFST,
+                   qspi_reg_read(GQSPI_CONFIG_OFST) | GQSPI_CFG_START_GEN_FIFO_MASK);
+    }
+
+    /* Command generation */
+    if (qspi_GenFifoData(communication_method, transfer->data_lanes,
+                         length, trans_dir) != FLASH_NO_ERROR) {
+      qspi_FlushAll();
+      qspi_TransferEnd(communication_method, initialised);
+      return FLASH_BUFFER_OVERFLOW;
+    }
+
     sr = qspi_reg_read(GQSPI_ISR_OFST);
 
     if (trans_dir == FLASH_TX_TRANS) {
@@ -387,10 +609,7 @@ flash_error flash_Transfer(flash_transfer_buffer* transfer, bool initialised)
         }
     }
 
-    /*
-     * Disable QSPI
-     */
-    qspi_reg_write(GQSPI_EN_OFST, 0);
+    qspi_TransferEnd(communication_method, initialised);
 
     if (transfer->trans_dir == FLASH_RX_TRANS) {
       flash_transfer_trace("transfer end:RX", transfer);
@@ -398,3 +617,173 @@ flash_error flash_Transfer(flash_transfer_buffer* transfer, bool initialised)
 
     return FLASH_NO_ERROR;
 }
+
+/*
+ * Poll a status register with the generic FIFO poll mode. The command byte
+ * is sent as immediate data and the poll entry has the controller read the
+ * status until (status & mask) == value on each selected bus. The matching
+ * status is written to the RX FIFO.
+ */
+flash_error
+flash_PollStatus(uint32_t comm_method, uint8_t command,
+                 uint8_t mask, uint8_t value, uint32_t timeout_usecs,
+                 bool initialised)
+{
+    uint32_t    controller_command;
+    uint32_t    poll_cfg;
+    uint64_t    start;
+    uint64_t    now;
+    flash_error fe = FLASH_NO_ERROR;
+
+    qspi_TransferBegin(initialised);
+
+    poll_cfg = ((uint32_t) value << GQSPI_POLL_CFG_DATA_VALUE_SHIFT) |
+      ((uint32_t) mask << GQSPI_POLL_CFG_MASK_EN_SHIFT);
+    if (comm_method != FLASH_COMM_METHOD_SINGLE_TOP) {
+      poll_cfg |= GQSPI_POLL_CFG_EN_MASK_LOWER;
+    }
+    if (comm_method != FLASH_COMM_METHOD_SINGLE_BOTTOM) {
+      poll_cfg |= GQSPI_POLL_CFG_EN_MASK_UPPER;
+    }
+    qspi_reg_write(GQSPI_POLL_CFG_OFST, poll_cfg);
+
+    /*
+     * Without a data transfer the immediate data is the byte sent.
+     */
+    controller_command = command_wrapper
+      (
+        comm_method,
+        1,
+        command,
+        IMMD_SIZE,
+        FLASH_TX_TRANS,
+        NOSTRIPE
+      );
+    controller_command &= ~(1UL << CMD_OFFSET_DATA_XFER);
+    qspi_reg_write(GQSPI_GEN_FIFO_OFST, controller_command);
+
+    controller_command = command_wrapper
+      (
+        comm_method,
+        1,
+        0,
+        IMMD_SIZE,
+        FLASH_RX_TRANS,
+        STRIPE
+      );
+    controller_command &= ~(1UL << CMD_OFFSET_DATA_XFER);
+    controller_command |= 1UL << CMD_OFFSET_POLL;
+    qspi_reg_write(GQSPI_GEN_FIFO_OFST, controller_command);
+
+    qspi_reg_write(GQSPI_CONFIG_OFST,
+                   qspi_reg_read(GQSPI_CONFIG_OFST) | GQSPI_CFG_START_GEN_FIFO_MASK);
+
+    board_timer_get(&start);
+    while ((qspi_reg_read(GQSPI_ISR_OFST) & GQSPI_ISR_RXEMPTY_MASK) != 0) {
+        board_timer_get(&now);
+        if ((now - start) > timeout_usecs) {
+            fe = FLASH_POLL_TIMEOUT;
+            break;
+        }
+    }
+
+    /*
+     * A poll that has not matched is still running, the flush stops it.
+     */
+    if (fe == FLASH_NO_ERROR) {
+        (void) qspi_reg_read(GQSPI_RXD_OFST);
+    }
+    qspi_FlushAll();
+
+    qspi_TransferEnd(comm_method, initialised);
+
+    return fe;
+}
+
+#if FLASH_DMA_READ
+/*
+ * Wait for the DMA done interrupt status. The interrupt is not enabled, the
+ * status is polled.
+ */
+static flash_error
+qspi_DMAWait(void)
+{
+    uint64_t start;
+    uint64_t now;
+
+    board_timer_get(&start);
+    while ((qspi_reg_read(GQSPI_QSPIDMA_DST_I_STS_OFST) &
+            GQSPI_QSPIDMA_DST_I_STS_DONE_MASK) == 0) {
+        board_timer_get(&now);
+        if ((now - start) > FLASH_DMA_TIMEOUT_USECS) {
+            return FLASH_DMA_TIMEOUT;
+        }
+    }
+
+    qspi_reg_write(GQSPI_QSPIDMA_DST_I_STS_OFST,
+                   qspi_reg_read(GQSPI_QSPIDMA_DST_I_STS_OFST));
+
+    return FLASH_NO_ERROR;
+}
+
+flash_error flash_TransferDMA(flash_transfer_buffer* transfer, bool initialised)
+{
+    void*          buffer = transfer->payload;
+    size_t         length = transfer->payload_length;
+    const uint64_t dst = (uintptr_t) buffer;
+    flash_error    fe;
+
+    if (((dst & (FLASH_DMA_ALIGN - 1)) != 0) || ((length & (FLASH_DMA_ALIGN - 1)) != 0)) {
+      return FLASH_BAD_ADDRESS;
+    }
+
+    qspi_TransferBegin(initialised);
+
+    flash_transfer_trace("transfer:DMA", transfer);
+
+    /*
+     * Write back any dirty lines covering the buffer so they cannot be
+     * evicted over the DMA data.
+     */
+    cache_flush_range(buffer, length);
+
+    qspi_reg_write(GQSPI_QSPIDMA_DST_CTRL_OFST, GQSPI_QSPIDMA_DST_CTRL_RESET_VAL);
+    qspi_reg_write(GQSPI_QSPIDMA_DST_I_DIS_OFST, GQSPI_QSPIDMA_DST_INTR_ALL_MASK);
+    qspi_reg_write(GQSPI_QSPIDMA_DST_I_STS_OFST,
+                   qspi_reg_read(GQSPI_QSPIDMA_DST_I_STS_OFST));
+    qspi_reg_write(GQSPI_QSPIDMA_DST_ADDR_OFST, (uint32_t) (dst & 0xfffffffc));
+    qspi_reg_write(GQSPI_QSPIDMA_DST_ADDR_MSB_OFST, (uint32_t) ((dst >> 32) & 0xfff));
+    qspi_reg_write(GQSPI_QSPIDMA_DST_SIZE_OFST, length);
+
+    qspi_reg_write(GQSPI_CONFIG_OFST,
+                   (qspi_reg_read(GQSPI_CONFIG_OFST) & ~GQSPI_CFG_MODE_EN_MASK) |
+                   GQSPI_CFG_MODE_EN_DMA_MASK);
+
+    qspi_GenFifoHeader(transfer);
+
+    fe = qspi_GenFifoData(transfer->comm_method, transfer->data_lanes,
+                          length, FLASH_RX_TRANS);
+    if (fe == FLASH_NO_ERROR) {
+        qspi_reg_write(GQSPI_CONFIG_OFST,
+                       qspi_reg_read(GQSPI_CONFIG_OFST) | GQSPI_CFG_START_GEN_FIFO_MASK);
+        fe = qspi_DMAWait();
+    }
+
+    /*
+     * Back to IO mode. A DMA that did not finish is stopped.
+     */
+    if (fe != FLASH_NO_ERROR) {
+        qspi_FlushAll();
+    }
+    qspi_reg_write(GQSPI_CONFIG_OFST,
+                   qspi_reg_read(GQSPI_CONFIG_OFST) & ~GQSPI_CFG_MODE_EN_MASK);
+    qspi_TransferEnd(transfer->comm_method, initialised);
+
+    /*
+     * Drop any lines loaded by speculation while the DMA was writing.
+     */
+    cache_invalidate_range(buffer, length);
+
+    return fe;
+}
+#endif /* FLASH_DMA_READ */
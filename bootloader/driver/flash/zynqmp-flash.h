@@ -31,6 +31,22 @@
 #define FLASH_4BYTE_ADDRESSING  1
 #define FLASH_FAST_READ         1
 
+/*
+ * A second device with the same ID as the first is used in parallel.
+ */
+#if !defined(FLASH_DUAL_PARALLEL)
+#define FLASH_DUAL_PARALLEL     1
+#endif
+
+/*
+ * The read mode. A part that does not support the mode reads with
+ * FLASH_READ_MODE_SINGLE. FLASH_READ_MODE_AUTO uses the fastest mode the
+ * part supports.
+ */
+#if !defined(FLASH_READ_MODE)
+#define FLASH_READ_MODE         FLASH_READ_MODE_AUTO
+#endif
+
 /*
  * Flash Status bits.
  */
@@ -75,6 +91,8 @@
 #define GQSPI_SEL_OFST                    0x00000144
 #define GQSPI_GF_THRESHOLD_OFST           0x00000150
 #define GQSPI_FIFO_CTRL_OFST              0x0000014C
+#define GQSPI_POLL_CFG_OFST               0x00000154
+#define GQSPI_P_TIMEOUT_OFST              0x00000158
 #define GQSPI_QSPIDMA_DST_SIZE_OFST       0x00000804
 #define GQSPI_QSPIDMA_DST_STS_OFST        0x00000808
 #define GQSPI_QSPIDMA_DST_CTRL_OFST       0x0000080C
@@ -148,8 +166,13 @@
 #define GQSPI_FIFO_CTRL_RST_TX_MASK         0x00000002
 #define GQSPI_FIFO_CTRL_RST_RX_MASK         0x00000003
 #define GQSPI_FIFO_CTRL_RST_ALL_MASK        0x00000007
+#define GQSPI_POLL_CFG_EN_MASK_UPPER        0x80000000
+#define GQSPI_POLL_CFG_EN_MASK_LOWER        0x40000000
+#define GQSPI_POLL_CFG_MASK_EN_SHIFT        8
+#define GQSPI_POLL_CFG_DATA_VALUE_SHIFT     0
 
 #define GQSPI_CFG_BAUD_RATE_DIV_SHIFT       3
+#define GQSPI_LPBK_DLY_ADJ_DLY_MASK         0x0000001F
 #define GQSPI_GENFIFO_CS_SETUP              0x4
 #define GQSPI_GENFIFO_CS_HOLD               0x3
 #define GQSPI_TXD_DEPTH                     64
@@ -175,10 +198,68 @@
 #define GQSPI_DEFAULT_NUM_CS                1  /* Default number of chip selects */
 #define GQSPI_MAX_NUM_CS                    2  /* Maximum number of chip selects */
 
+/*
+ * The largest read sent as one command.
+ */
+#define FLASH_READ_MAX           (1024 * 1024)
+
+/*
+ * Read the payload with the GQSPI DMA. The DMA writes whole cache lines so
+ * the invalidate after it cannot drop the CPU's writes to a line it shares
+ * with other data. The part of a payload before the first cache line
+ * boundary, the part after the last, and payloads shorter than
+ * FLASH_DMA_READ_MIN use the RX FIFO. Set FLASH_DMA_READ to 0 to always use
+ * the RX FIFO.
+ */
+#if !defined(FLASH_DMA_READ)
+#define FLASH_DMA_READ           1
+#endif
+#define FLASH_DMA_ALIGN          (64)
+#define FLASH_DMA_READ_MIN       (64)
+#define FLASH_DMA_READ_MAX       (1024 * 1024)
+#define FLASH_DMA_TIMEOUT_USECS  (1000000)
+
+/*
+ * QSPI clock calibration. The baud rate divisor divides the reference clock
+ * by 2^(n + 1). The delay is the loopback RX tap delay, DLY1 and DLY0 in
+ * GQSPI_LPBK_DLY_ADJ. FLASH_CLOCK_REF_MHZ is the QSPI_REF_CLK set by the
+ * design and limits the divisor to the part's fastest clock.
+ */
+#if !defined(FLASH_CLOCK_REF_MHZ)
+#define FLASH_CLOCK_REF_MHZ       300
+#endif
+#define FLASH_CLOCK_DIV_DEFAULT   ((QSPI_CONFIG_INIT_VAL & \
+                                    GQSPI_CFG_BAUD_RATE_DIV_MASK) >> \
+                                   GQSPI_CFG_BAUD_RATE_DIV_SHIFT)
+#define FLASH_CLOCK_DIV_FASTEST   0
+#define FLASH_CLOCK_DELAY_DEFAULT 0
+#define FLASH_CLOCK_DELAYS        32
+
 void flash_writeUnlock(void);
 
 void flash_writeLock(void);
 
 flash_error flash_Transfer(flash_transfer_buffer* transfer, bool initialised);
 
+void flash_SetClock(uint32_t divisor, uint32_t delay);
+
+/*
+ * A session holds the controller up across transfers. Transfers made
+ * with initialised set skip the controller set up.
+ */
+void flash_SessionOpen(void);
+void flash_SessionClose(void);
+
+/*
+ * Poll a status register until (status & mask) == value. The generic FIFO
+ * poll mode reads the register, the CPU waits for the matching status.
+ */
+flash_error flash_PollStatus(uint32_t comm_method, uint8_t command,
+                             uint8_t mask, uint8_t value,
+                             uint32_t timeout_usecs, bool initialised);
+
+#if FLASH_DMA_READ
+flash_error flash_TransferDMA(flash_transfer_buffer* transfer, bool initialised);
+#endif
+
 #endif /* _BOOTLOADER_FLASH_ZYNQMP_H_ */
@@ -18,9 +18,10 @@
  * JFFS2 File reader. This is designed for bootloaders.
  *
  * This code does an ok job. There are cases where a file deep in a directory
- * tree with common path parts may fill the directory cache. If you keep the
- * files the boot loader needs to find in a specific directory and not common
- * names the cache will not fill.
+ * tree with common path parts may fill the directory cache. The cache then
+ * drops the entries waiting for a parent and the flash is scanned again. If
+ * you keep the files the boot loader needs to find in a specific directory
+ * and not common names the cache will not fill.
  */
 
 #include <limits.h>
@@ -28,10 +29,15 @@
 #include <stdlib.h>
 
 #include <string.h>
+#if FLARE_HOST
+#include <endian.h>
+#else
 #include <machine/endian.h>
+#endif
 #include <sys/stat.h>
 
 #include <driver/flash/flash.h>
+#include <driver/timer/board-timer.h>
 #include <driver/zlib/tzlib.h>
 
 #include "jffs2.h"
@@ -67,10 +73,13 @@
 #define trace_inode_copy_inodes_zlib          JFFS2_TRACE_OFF
 #define trace_inode_copy_inodes_data          JFFS2_TRACE_OFF
 #define trace_inode_copy_stats                JFFS2_TRACE_OFF
+#define trace_inode_copy_frags                JFFS2_TRACE_OFF
 #define trace_bad_hdr_crc                     JFFS2_TRACE_OFF
 #define trace_bad_dir_crc                     JFFS2_TRACE_OFF
 #define trace_bad_inode_crc                   JFFS2_TRACE_OFF
 #define trace_boot_read                       JFFS2_TRACE_OFF
+#define trace_index                           JFFS2_TRACE_OFF
+#define trace_index_summary                   JFFS2_TRACE_OFF
 
 #if JFFS2_TRACE
  #if !defined(jffs2_print_decl)
@@ -85,13 +94,13 @@
 
 #define target_endian BYTE_ORDER
 
-static inline uint32_t __bswap_32(uint32_t i)
+static inline uint32_t jffs2_bswap_32(uint32_t i)
 {
   const uint8_t* p = (const uint8_t*) &i;
   return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
 }
 
-static inline uint16_t __bswap_16(uint16_t i)
+static inline uint16_t jffs2_bswap_16(uint16_t i)
 {
   const uint8_t* p = (const uint8_t*) &i;
   return (p[0] << 8) | p[1];
@@ -104,8 +113,8 @@ static inline uint16_t __bswap_16(uint16_t i)
 #undef je32_to_cpu
 #undef jemode_to_cpu
 
-#define t16(x) ({ uint16_t __b = (x); (target_endian==BYTE_ORDER)?__b:__bswap_16(__b); })
-#define t32(x) ({ uint32_t __b = (x); (target_endian==BYTE_ORDER)?__b:__bswap_32(__b); })
+#define t16(x) ({ uint16_t __b = (x); (target_endian==BYTE_ORDER)?__b:jffs2_bswap_16(__b); })
+#define t32(x) ({ uint32_t __b = (x); (target_endian==BYTE_ORDER)?__b:jffs2_bswap_32(__b); })
 
 #define cpu_to_je16(x) ((jint16_t){t16(x)})
 #define cpu_to_je32(x) ((jint32_t){t32(x)})
@@ -115,10 +124,10 @@ static inline uint16_t __bswap_16(uint16_t i)
 #define je32_to_cpu(x) (t32((x).v32))
 #define jemode_to_cpu(x) (t32((x).m))
 
-#define le16_to_cpu(x)	(BYTE_ORDER==LITTLE_ENDIAN ? (x) : __bswap_16(x))
-#define le32_to_cpu(x)	(BYTE_ORDER==LITTLE_ENDIAN ? (x) : __bswap_32(x))
-#define cpu_to_le16(x)	(BYTE_ORDER==LITTLE_ENDIAN ? (x) : __bswap_16(x))
-#define cpu_to_le32(x)	(BYTE_ORDER==LITTLE_ENDIAN ? (x) : __bswap_32(x))
+#define le16_to_cpu(x)	(BYTE_ORDER==LITTLE_ENDIAN ? (x) : jffs2_bswap_16(x))
+#define le32_to_cpu(x)	(BYTE_ORDER==LITTLE_ENDIAN ? (x) : jffs2_bswap_32(x))
+#define cpu_to_le16(x)	(BYTE_ORDER==LITTLE_ENDIAN ? (x) : jffs2_bswap_16(x))
+#define cpu_to_le32(x)	(BYTE_ORDER==LITTLE_ENDIAN ? (x) : jffs2_bswap_32(x))
 
 /*
  * File types
@@ -144,6 +153,31 @@ static inline uint16_t __bswap_16(uint16_t i)
 
 #define JFFS2_EMPTY_SCAN_SIZE (256)
 
+/*
+ * Find the next directory entry or inode node.
+ */
+#define JFFS2_NODETYPE_ANY (0)
+
+/*
+ * The end of an index node list. The hash tables are filled to 3/4 of the
+ * slots so a probe always finds a free slot.
+ */
+#define JFFS2_INDEX_NONE       (0xffffffff)
+#define JFFS2_INDEX_LIMIT(_s)  (((_s) / 4) * 3)
+
+/*
+ * JFFS2 writes a file's data in nodes that do not cross a page.
+ */
+#define JFFS2_FRAG_PAGE_SIZE   (4096)
+
+/*
+ * An empty directory cache table slot. The tables have twice the slots of
+ * the nodes so a probe always finds an empty slot.
+ */
+#define JFFS2_DIR_SLOT_EMPTY      (0xffff)
+#define JFFS2_DIR_SLOT(_k)        (jffs2_index_hash(_k, 0) & (JFFS2_DIR_CACHE_SLOTS - 1))
+#define JFFS2_DIR_SLOT_NEXT(_s)   (((_s) + 1) & (JFFS2_DIR_CACHE_SLOTS - 1))
+
 static void
 jffs2_dump_memory(const char* message, uint32_t base, const void* buffer, size_t size)
 {
@@ -233,9 +267,14 @@ jffs2_buffer_erase_sector_boundary(jffs2_buffer* buffer)
   return (jffs2_buffer_offset(buffer) & (buffer->erase_sector_size - 1)) == 0;
 }
 
+/*
+ * The buffer's data is a view of the cache if there is a cache.
+ */
 static inline void*
 jffs2_buffer_data(jffs2_buffer* buffer)
 {
+  if (buffer->cache != NULL)
+    return buffer->cache + buffer->offset + buffer->out;
   return buffer->buffer + buffer->out;
 }
 
@@ -271,131 +310,161 @@ jffs2_buffer_skip(jffs2_buffer* buffer, size_t size)
     buffer->out = buffer->level;
 }
 
-static jffs2_error
-jffs2_buffer_flash_read(jffs2_buffer* buffer,
-                        uint32_t      address,
-                        void*         buf,
-                        size_t        length)
+/*
+ * Check a cache page is loaded. If the cache's pages have CRCs the page's
+ * CRC is checked and a page that has changed is not loaded.
+ */
+static bool
+jffs2_buffer_cache_valid(jffs2_buffer* buffer, uint32_t page)
 {
-  flash_error fe;
+  const uint32_t boff = page / 32;
+  const uint32_t bit = page & (32 - 1);
 
-  if (trace_flash_read)
-    jffs2_print("buffer_flash_read: address=%08x length=%zu\n",
-                address, length);
+  if ((buffer->cache_bitmap[boff] & (1 << bit)) == 0)
+    return false;
 
-  if (buffer->cache)
+  if (buffer->cache_crcmap != NULL)
   {
-    size_t   pages;
-    uint32_t page;
-    uint32_t epage;
-    uint32_t boff;
-    uint32_t bit;
-    uint32_t poff;
-    size_t   p;
-
-    /*
-     * Compute the page and bit off set in the cache bitmap.
-     */
-    page = address / JFFS2_CACHE_PAGE_SIZE;
-    epage = (address + length - 1) / JFFS2_CACHE_PAGE_SIZE;
-    pages = epage - page + 1;
-    poff = page * JFFS2_CACHE_PAGE_SIZE;
-    boff = page / 32;
-    bit = page & (32 - 1);
+    uint32_t crc;
 
-    #if 0
-    bool trace_buffer_flash_read_cache = poff == 0x02d00000;
+    crc = jffs2_crc32(0, buffer->cache + (page * JFFS2_CACHE_PAGE_SIZE),
+                      JFFS2_CACHE_PAGE_SIZE);
 
-    if (trace_buffer_flash_read_cache)
+    if (crc != buffer->cache_crcmap[page])
     {
-      static bool here;
-      if (!here)
-      {
-        jffs2_print("At the address\n");
-        here = true;
-      }
+      buffer->cache_bitmap[boff] &= ~(1 << bit);
+      return false;
     }
-    #else
-     #if !defined(trace_buffer_flash_read_cache)
-      #define trace_buffer_flash_read_cache 1
-     #endif
-    #endif
+  }
+
+  return true;
+}
+
+/*
+ * Load the cache pages holding the flash from the address for the
+ * length. The missing pages are read in one flash read. A miss on the page
+ * after the last read is a sequential read and the read continues ahead of
+ * the pages needed, stopping at a loaded page. Each sequential read reads
+ * ahead four times the pages of the last read up to the end of the erase
+ * block, or JFFS2_CACHE_READAHEAD pages. The first page of an erase block
+ * is read on its own because a blank block is skipped after its first
+ * bytes are checked.
+ */
+static jffs2_error
+jffs2_buffer_cache_load(jffs2_buffer* buffer, uint32_t address, size_t length)
+{
+  const uint32_t pages = JFFS2_BUFFER_CACHE_PAGES(buffer->size);
+  const uint32_t block_pages = buffer->erase_sector_size / JFFS2_CACHE_PAGE_SIZE;
+  const uint32_t epage = (address + length - 1) / JFFS2_CACHE_PAGE_SIZE;
+  uint32_t       page = address / JFFS2_CACHE_PAGE_SIZE;
+
+  if (trace_buffer_flash_read_cache)
+    jffs2_print("buffer_cache_load: address=%08x length=%zu page=%u epage=%u\n",
+                address, length, page, epage);
 
-    if (trace_buffer_flash_read_cache)
-      jffs2_print("buffer_flash_read: cache: page=%u epage=%u pages=%zu\n",
-                  page, epage, pages);
+  while (page <= epage)
+  {
+    flash_error fe;
+    uint32_t    limit;
+    uint32_t    last;
+    uint32_t    p;
 
-    for (p = 0; p < pages; ++p)
+    if (jffs2_buffer_cache_valid(buffer, page))
     {
-      if (trace_buffer_flash_read_cache)
-        jffs2_print("buffer_flash_read: cache: page=%u bm=%u/%u poff=%08x\n",
-                    page, boff, bit, poff);
+      ++buffer->cache_hit;
+      ++page;
+      continue;
+    }
 
-      if ((buffer->cache_crcmap != NULL) &&
-          (buffer->cache_bitmap[boff] & (1 << bit)) != 0)
-      {
-        uint32_t crc;
+    limit = epage + 1;
 
-        crc = jffs2_crc32(0, buffer->cache + poff, JFFS2_CACHE_PAGE_SIZE);
+    if ((page == buffer->next_page) && ((page % block_pages) != 0))
+    {
+      uint32_t ahead = buffer->ahead * 4;
+      uint32_t end = ((page / block_pages) + 1) * block_pages;
 
-        if (crc != buffer->cache_crcmap[page])
-          buffer->cache_bitmap[boff] &= ~(1 << bit);
-      }
+#if JFFS2_CACHE_READAHEAD > 0
+      if (ahead > JFFS2_CACHE_READAHEAD)
+        ahead = JFFS2_CACHE_READAHEAD;
+#endif
+      ahead += page;
+      if (ahead > end)
+        ahead = end;
+      if (ahead > pages)
+        ahead = pages;
+      if (ahead > limit)
+        limit = ahead;
+    }
 
-      if ((buffer->cache_bitmap[boff] & (1 << bit)) == 0)
-      {
-        if (trace_flash_read)
-          jffs2_print("buffer_flash_read: flash read: o=0x%08x s=%u (cache)\n",
-                      poff, JFFS2_CACHE_PAGE_SIZE);
-        fe = flash_read(buffer->base + poff,
-                        buffer->cache + poff,
-                        JFFS2_CACHE_PAGE_SIZE);
-        if (fe != FLASH_NO_ERROR)
-          return JFFS2_FLASH_READ_ERROR;
-        buffer->cache_bitmap[boff] |= 1 << bit;
-        if (buffer->cache_crcmap != NULL)
-          buffer->cache_crcmap[page] =
-            jffs2_crc32(0, buffer->cache + poff, JFFS2_CACHE_PAGE_SIZE);
-        ++buffer->cache_miss;
-      }
-      else
+    last = page + 1;
+    while (last < limit)
+    {
+      if (last <= epage)
       {
-        ++buffer->cache_hit;
+        if (jffs2_buffer_cache_valid(buffer, last))
+          break;
       }
-
-      ++bit;
-      if (bit == 32)
+      else if ((buffer->cache_bitmap[last / 32] & (1 << (last & (32 - 1)))) != 0)
       {
-        ++boff;
-        bit = 0;
+        break;
       }
-
-      ++page;
-      poff += JFFS2_CACHE_PAGE_SIZE;
+      ++last;
     }
 
-    if (trace_buffer_flash_read_cache)
-      jffs2_print("buffer_flash_read: copy: buf=%p addr=%08u length=%zu\n",
-                  buf, address, length);
-    if (length > JFFS2_INODE_BUF_SIZE)
-      jffs2_print("buffer_flash_read: length too big: %zu\n", length);
-
-    memcpy(buf, buffer->cache + address, length);
-  }
-  else
-  {
     if (trace_flash_read)
-      jffs2_print("buffer_flash_read: flash read: o=0x%08x s=%zu\n",
-                  address, length);
+      jffs2_print("buffer_cache_load: flash read: o=0x%08x s=%u (cache)\n",
+                  page * JFFS2_CACHE_PAGE_SIZE,
+                  (last - page) * JFFS2_CACHE_PAGE_SIZE);
 
-    fe = flash_read(buffer->base + address, buf, length);
+    fe = flash_read(buffer->base + (page * JFFS2_CACHE_PAGE_SIZE),
+                    buffer->cache + (page * JFFS2_CACHE_PAGE_SIZE),
+                    (last - page) * JFFS2_CACHE_PAGE_SIZE);
     if (fe != FLASH_NO_ERROR)
       return JFFS2_FLASH_READ_ERROR;
+    ++buffer->flash_reads;
+    buffer->flash_bytes += (last - page) * JFFS2_CACHE_PAGE_SIZE;
+
+    for (p = page; p < last; ++p)
+    {
+      buffer->cache_bitmap[p / 32] |= 1 << (p & (32 - 1));
+      if (buffer->cache_crcmap != NULL)
+        buffer->cache_crcmap[p] =
+          jffs2_crc32(0, buffer->cache + (p * JFFS2_CACHE_PAGE_SIZE),
+                      JFFS2_CACHE_PAGE_SIZE);
+      if (p <= epage)
+        ++buffer->cache_miss;
+    }
+
+    buffer->next_page = last;
+    buffer->ahead = last - page;
+    page = last;
   }
 
   return JFFS2_NO_ERROR;
 }
 
+static jffs2_error
+jffs2_buffer_flash_read(jffs2_buffer* buffer,
+                        uint32_t      address,
+                        void*         buf,
+                        size_t        length)
+{
+  flash_error fe;
+
+  if (trace_flash_read)
+    jffs2_print("buffer_flash_read: flash read: o=0x%08x s=%zu\n",
+                address, length);
+
+  fe = flash_read(buffer->base + address, buf, length);
+  if (fe != FLASH_NO_ERROR)
+    return JFFS2_FLASH_READ_ERROR;
+  ++buffer->flash_reads;
+  buffer->flash_bytes += length;
+  buffer->next_address = address + length;
+
+  return JFFS2_NO_ERROR;
+}
+
 static jffs2_error
 jffs2_buffer_fill(jffs2_buffer* buffer, size_t need)
 {
@@ -420,11 +489,12 @@ jffs2_buffer_fill(jffs2_buffer* buffer, size_t need)
 
     /*
      * If some data has been read out of the buffer and there is still some
-     * remaining move it to the bottom of the buffer.
+     * remaining move it to the bottom of the buffer. A view of the cache
+     * only moves its offset.
      */
     if (buffer->out)
     {
-      if (remaining)
+      if (remaining && (buffer->cache == NULL))
       {
         if (trace_buffer_fill)
           jffs2_print("buffer_fill: compact\n");
@@ -438,9 +508,13 @@ jffs2_buffer_fill(jffs2_buffer* buffer, size_t need)
     }
 
     /*
-     * Read in the part we are missing. Pad the size.
+     * Read in the part we are missing. Pad the size. If the buffer is read
+     * sequentially fill it.
      */
     size = PAD_512(need - buffer->level);
+    if ((buffer->cache == NULL) &&
+        ((buffer->offset + buffer->level) == buffer->next_address))
+      size = jffs2_buffer_size(buffer) - buffer->level;
 
     /*
      * Compacting the buffer may result in the size exceeding the the actual
@@ -459,10 +533,15 @@ jffs2_buffer_fill(jffs2_buffer* buffer, size_t need)
     if (size == 0)
       return JFFS2_FLASH_READ_PAST_END;
 
-    je = jffs2_buffer_flash_read(buffer,
-                                 buffer->offset + buffer->level,
-                                 buffer->buffer + buffer->level,
-                                 size);
+    if (buffer->cache != NULL)
+      je = jffs2_buffer_cache_load(buffer,
+                                   buffer->offset + buffer->level,
+                                   size);
+    else
+      je = jffs2_buffer_flash_read(buffer,
+                                   buffer->offset + buffer->level,
+                                   buffer->buffer + buffer->level,
+                                   size);
     if (je != JFFS2_NO_ERROR)
         return je;
 
@@ -552,6 +631,7 @@ jffs2_buffer_find_node(jffs2_buffer* buffer, uint32_t type)
         fill_size = sizeof(*node);
 
         ++buffer->node_count;
+        ++buffer->nodes_scanned;
 
         noffset = jffs2_buffer_offset(buffer);
         ntype = je16_to_cpu(node->nodetype);
@@ -572,7 +652,11 @@ jffs2_buffer_find_node(jffs2_buffer* buffer, uint32_t type)
             uint32_t* blank;
             size_t    b;
 
+            /*
+             * The cleanmarker has been skipped and the next node follows.
+             */
             jffs2_buffer_skip(buffer, sizeof(*node));
+            len = 0;
             je = jffs2_buffer_fill(buffer, JFFS2_EMPTY_SCAN_SIZE);
             if (je != JFFS2_NO_ERROR)
               return je;
@@ -594,7 +678,10 @@ jffs2_buffer_find_node(jffs2_buffer* buffer, uint32_t type)
               break;
             }
           }
-          else if (type == ntype)
+          else if ((type == ntype) ||
+                   ((type == JFFS2_NODETYPE_ANY) &&
+                    ((ntype == JFFS2_NODETYPE_DIRENT) ||
+                     (ntype == JFFS2_NODETYPE_INODE))))
           {
             if (trace_find_node)
               jffs2_print("buffer_find_node: found\n");
@@ -676,70 +763,113 @@ jffs2_inode_print(const char* msg, struct jffs2_raw_inode* inode)
 #endif
 }
 
-static void
-jffs2_dir_push_head(jffs2_dir** head, jffs2_dir* node)
+static inline uint32_t
+jffs2_index_hash(uint32_t a, uint32_t b)
 {
-  node->next = *head;
-  *head = node;
+  uint32_t h = (a * 0x9e3779b1) ^ b;
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  return h;
 }
 
-static jffs2_dir*
-jffs2_dir_pop_head(jffs2_dir** head)
+static inline uint16_t*
+jffs2_dir_table(jffs2_dir_cache* cache, bool parent)
 {
-  jffs2_dir* node = *head;
-  if (node)
-  {
-    *head = node->next;
-    node->next = NULL;
-  }
-  return node;
+  return parent ? cache->by_pino : cache->by_ino;
+}
+
+static inline uint32_t
+jffs2_dir_key(jffs2_dir_cache* cache, uint16_t node, bool parent)
+{
+  return parent ? cache->nodes[node].pino : cache->nodes[node].ino;
 }
 
 static void
-jffs2_dir_append(jffs2_dir** head, jffs2_dir* node)
+jffs2_dir_table_insert(jffs2_dir_cache* cache, uint16_t node, bool parent)
 {
-  node->next = NULL;
-  if (!*head)
-  {
-    *head = node;
-  }
-  else
-  {
-    jffs2_dir* curr = *head;
-    while (curr->next)
-      curr = curr->next;
-    curr->next = node;
-  }
+  uint16_t* table = jffs2_dir_table(cache, parent);
+  uint32_t  slot = JFFS2_DIR_SLOT(jffs2_dir_key(cache, node, parent));
+
+  while (table[slot] != JFFS2_DIR_SLOT_EMPTY)
+    slot = JFFS2_DIR_SLOT_NEXT(slot);
+
+  table[slot] = node;
 }
 
+/*
+ * Remove a node from a table. The nodes after it in the probe run are moved
+ * back into the hole if their home slot allows it so a lookup does not stop
+ * early.
+ */
 static void
-jffs2_dir_remove(jffs2_dir** head, jffs2_dir* node)
+jffs2_dir_table_remove(jffs2_dir_cache* cache, uint16_t node, bool parent)
 {
-  jffs2_dir*  curr = *head;
-  jffs2_dir** prev = head;
-  while (curr)
+  uint16_t* table = jffs2_dir_table(cache, parent);
+  uint32_t  slot = JFFS2_DIR_SLOT(jffs2_dir_key(cache, node, parent));
+  uint32_t  next;
+
+  while (table[slot] != node)
+  {
+    if (table[slot] == JFFS2_DIR_SLOT_EMPTY)
+      return;
+    slot = JFFS2_DIR_SLOT_NEXT(slot);
+  }
+
+  next = JFFS2_DIR_SLOT_NEXT(slot);
+  while (table[next] != JFFS2_DIR_SLOT_EMPTY)
   {
-    if (curr == node)
+    uint32_t home = JFFS2_DIR_SLOT(jffs2_dir_key(cache, table[next], parent));
+
+    if (((next - home) & (JFFS2_DIR_CACHE_SLOTS - 1)) >=
+        ((next - slot) & (JFFS2_DIR_CACHE_SLOTS - 1)))
     {
-      *prev = node->next;
-      node->next = NULL;
-      break;
+      table[slot] = table[next];
+      slot = next;
     }
-    prev = &curr->next;
-    curr = curr->next;
+
+    next = JFFS2_DIR_SLOT_NEXT(next);
   }
+
+  table[slot] = JFFS2_DIR_SLOT_EMPTY;
 }
 
-static int
-jffs2_dir_count(jffs2_dir* head)
+/*
+ * Find a found directory entry by its inode number or its parent's inode
+ * number.
+ */
+static jffs2_dir*
+jffs2_dir_find(jffs2_dir_cache* cache, uint32_t key, bool parent)
 {
-  int count = 0;
-  while (head)
+  uint16_t* table = jffs2_dir_table(cache, parent);
+  uint32_t  slot = JFFS2_DIR_SLOT(key);
+
+  while (table[slot] != JFFS2_DIR_SLOT_EMPTY)
   {
-    ++count;
-    head = head->next;
+    if (jffs2_dir_key(cache, table[slot], parent) == key)
+      return &cache->nodes[table[slot]];
+    slot = JFFS2_DIR_SLOT_NEXT(slot);
   }
-  return count;
+
+  return NULL;
+}
+
+static void
+jffs2_dir_found_add(jffs2_dir_cache* cache, jffs2_dir* dir)
+{
+  uint16_t node = dir - cache->nodes;
+  jffs2_dir_table_insert(cache, node, false);
+  jffs2_dir_table_insert(cache, node, true);
+  ++cache->found_count;
+}
+
+static void
+jffs2_dir_found_remove(jffs2_dir_cache* cache, jffs2_dir* dir)
+{
+  uint16_t node = dir - cache->nodes;
+  jffs2_dir_table_remove(cache, node, false);
+  jffs2_dir_table_remove(cache, node, true);
+  --cache->found_count;
 }
 
 static size_t
@@ -790,9 +920,11 @@ jffs2_dir_set_path(jffs2_path* jpath, const char* path)
         return JFFS2_PATH_TOO_DEEP;
 
       jpath->parts[n] = path + p;
-      ++n;
+      jpath->lengths[n] = jffs2_dir_length(path + p);
+      jpath->crcs[n] = jffs2_crc32(0, path + p, jpath->lengths[n]);
 
-      p += jffs2_dir_length(path + p);
+      p += jpath->lengths[n];
+      ++n;
     }
   }
 
@@ -803,12 +935,40 @@ static void
 jffs2_dir_cache_init(jffs2_dir_cache* cache)
 {
   size_t n;
-  memset(cache, 0, sizeof(*cache));
-  cache->found = NULL;
-  cache->free = NULL;
-  cache->min_free = JFFS2_DIR_CACHE_NODES;
+  memset(cache->by_ino, 0xff, sizeof(cache->by_ino));
+  memset(cache->by_pino, 0xff, sizeof(cache->by_pino));
   for (n = 0; n < JFFS2_DIR_CACHE_NODES; ++n)
-    jffs2_dir_append(&cache->free, &cache->nodes[n]);
+    cache->free[n] = JFFS2_DIR_CACHE_NODES - 1 - n;
+  cache->free_count = JFFS2_DIR_CACHE_NODES;
+  cache->found_count = 0;
+  cache->min_free = JFFS2_DIR_CACHE_NODES;
+  cache->dropped = false;
+}
+
+static void
+jffs2_dir_cache_free(jffs2_dir_cache* cache, jffs2_dir* dir)
+{
+  cache->free[cache->free_count] = dir - cache->nodes;
+  ++cache->free_count;
+}
+
+/*
+ * Drop all the found entries. They are waiting for a parent and the path
+ * is scanned for again if it is not found.
+ */
+static void
+jffs2_dir_cache_drop(jffs2_dir_cache* cache)
+{
+  size_t s;
+  for (s = 0; s < JFFS2_DIR_CACHE_SLOTS; ++s)
+  {
+    if (cache->by_ino[s] != JFFS2_DIR_SLOT_EMPTY)
+      jffs2_dir_cache_free(cache, &cache->nodes[cache->by_ino[s]]);
+  }
+  memset(cache->by_ino, 0xff, sizeof(cache->by_ino));
+  memset(cache->by_pino, 0xff, sizeof(cache->by_pino));
+  cache->found_count = 0;
+  cache->dropped = true;
 }
 
 static jffs2_dir*
@@ -817,22 +977,22 @@ jffs2_dir_cache_alloc(jffs2_dir_cache*         cache,
                       const char*              name,
                       struct jffs2_raw_dirent* dir)
 {
-  jffs2_dir* cdir = jffs2_dir_pop_head(&cache->free);
-  uint32_t   count;
+  jffs2_dir* cdir;
 
-  if (cdir == NULL)
+  if (cache->free_count == 0)
     return NULL;
 
-  count = jffs2_dir_count(cache->free);
-  if (count < cache->min_free)
-    cache->min_free = count;
+  --cache->free_count;
+  if (cache->free_count < cache->min_free)
+    cache->min_free = cache->free_count;
+
+  cdir = &cache->nodes[cache->free[cache->free_count]];
 
   cdir->offset = offset;
   cdir->name = name;
   cdir->ino = je32_to_cpu(dir->ino);
   cdir->pino = je32_to_cpu(dir->pino);
   cdir->version = je32_to_cpu(dir->version);
-  cdir->next = NULL;
 
   return cdir;
 }
@@ -894,48 +1054,34 @@ jffs2_control_init(jffs2_control* control,
 static void
 jffs2_remove_found_of_parent(jffs2_control* control, uint32_t pino)
 {
-  jffs2_dir* dir;
-  bool       changed = true;
+  jffs2_dir_cache* cache = &control->cache.dir;
+  jffs2_dir*       dir;
 
-  while (changed)
+  while ((dir = jffs2_dir_find(cache, pino, true)) != NULL)
   {
-    changed = false;
-    dir = control->cache.dir.found;
-    while (dir)
-    {
-      if (trace_remove_found)
-        jffs2_print("remove_found: checking: parent=%u ino=%u pino=%u\n",
-                      pino, dir->ino, dir->pino);
+    uint32_t ino = dir->ino;
 
-      if (dir->pino == pino)
-      {
-        if (trace_remove_found)
-          jffs2_print("remove_found: remove: parent=%u ino=%u pino=%u\n",
-                      pino, dir->ino, dir->pino);
-
-        uint32_t ino = dir->ino;
-        if (trace_parent_of)
-          jffs2_dir_print("parent_of", dir);
-        changed = true;
-        jffs2_dir_remove(&control->cache.dir.found, dir);
-        jffs2_dir_push_head(&control->cache.dir.free, dir);
-        jffs2_remove_found_of_parent(control, ino);
-        break;
-      }
-      dir = dir->next;
-    }
+    if (trace_remove_found)
+      jffs2_print("remove_found: remove: parent=%u ino=%u pino=%u\n",
+                  pino, dir->ino, dir->pino);
+    if (trace_parent_of)
+      jffs2_dir_print("parent_of", dir);
+
+    jffs2_dir_found_remove(cache, dir);
+    jffs2_dir_cache_free(cache, dir);
+    jffs2_remove_found_of_parent(control, ino);
   }
 }
 
 static jffs2_error
 jffs2_process_found(jffs2_control* control)
 {
-  const char* part;
-  int         parent_part = -1;
-  uint32_t    pino = 1;
-  jffs2_dir*  dir;
-  bool        updated = true;
-  int         p;
+  jffs2_dir_cache* cache = &control->cache.dir;
+  const char*      part;
+  int              parent_part = -1;
+  uint32_t         pino = 1;
+  jffs2_dir*       dir;
+  int              p;
 
   /*
    * Find the end node of the path found discovered so far.
@@ -959,66 +1105,52 @@ jffs2_process_found(jffs2_control* control)
     return JFFS2_PATH_ALREADY_FOUND;
 
   /*
-   * Search the found list looking for a part that matches the next part of the
-   * path.
+   * Take the found entries that have the end node as their parent.
+   *
+   * If the directory's parent inode number matches the parent part's inode
+   * number we can process the directory entry. If the directory's name
+   * matches the part we have found the directory entry and we can remove
+   * any found directory entries with that parent inode number. If the name
+   * does not match and parent inode numbers match then that node cannot be
+   * the correct one and any nodes that reside under it that may match a
+   * part in the path can also be removed.
    */
-  while (updated && control->cache.dir.found)
+  while ((parent_part + 1) < JFFS2_MAX_PATH_DEPTH)
   {
-    updated = false;
     part = control->path.parts[parent_part + 1];
-    dir = control->cache.dir.found;
-    while (dir)
-    {
-      if (trace_process_found)
-      {
-        jffs2_print("process_found: checking: pino=%u", pino);
-        jffs2_dir_print("", dir);
-      }
-
-      /*
-       * If the directory's parent inode number matches the parent part's inode
-       * number we can process the directory entry. If the directory's name
-       * matches the part we have found the directory entry and we can remove
-       * any found directory entries with that parent inode number. If the name
-       * does not match and parent inode numbers match then that node cannot be
-       * the correct one and any nodes that reside under it that may match a
-       * part in the path can also be removed.
-       */
+    if (part == NULL)
+      break;
 
-      if (dir->pino == pino)
-      {
-        if (trace_process_found)
-          jffs2_dir_print("process_found: matching", dir);
+    dir = jffs2_dir_find(cache, pino, true);
+    if (dir == NULL)
+      break;
 
-        jffs2_dir_remove(&control->cache.dir.found, dir);
+    if (trace_process_found)
+      jffs2_dir_print("process_found: matching", dir);
 
-        if (jffs2_match_name(dir->name, part))
-        {
-          jffs2_remove_found_of_parent(control, pino);
+    jffs2_dir_found_remove(cache, dir);
 
-          /*
-           * Must increment before using.
-           */
-          ++parent_part;
-          control->path.nodes[parent_part] = dir;
-          pino = dir->ino;
+    if (jffs2_match_name(dir->name, part))
+    {
+      jffs2_remove_found_of_parent(control, pino);
 
-          if (trace_process_found)
-          {
-            jffs2_print("process_found: found: parent_part=%d", parent_part);
-            jffs2_dir_print(" ", dir);
-          }
-        }
-        else
-        {
-          jffs2_remove_found_of_parent(control, dir->ino);
-          jffs2_dir_push_head(&control->cache.dir.free, dir);
-        }
+      /*
+       * Must increment before using.
+       */
+      ++parent_part;
+      control->path.nodes[parent_part] = dir;
+      pino = dir->ino;
 
-        updated = true;
-        break;
+      if (trace_process_found)
+      {
+        jffs2_print("process_found: found: parent_part=%d", parent_part);
+        jffs2_dir_print(" ", dir);
       }
-      dir = dir->next;
+    }
+    else
+    {
+      jffs2_remove_found_of_parent(control, dir->ino);
+      jffs2_dir_cache_free(cache, dir);
     }
   }
 
@@ -1030,9 +1162,12 @@ jffs2_process_dir(jffs2_control*           control,
                   size_t                   offset,
                   struct jffs2_raw_dirent* rdir)
 {
-  jffs2_error je;
-  int         parts;
-  int         p;
+  jffs2_dir_cache* cache = &control->cache.dir;
+  const uint32_t   name_crc = je32_to_cpu(rdir->name_crc);
+  bool             name_read = false;
+  jffs2_error      je;
+  int              parts;
+  int              p;
 
   if (trace_process_dir_off)
     jffs2_print("process_dir: offset=0x%08x\n", (uint32_t) offset);
@@ -1046,43 +1181,62 @@ jffs2_process_dir(jffs2_control*           control,
   if (parts >= JFFS2_MAX_PATH_DEPTH)
     return JFFS2_PATH_ALREADY_FOUND;
 
-  /*
-   * The rdir entry has the first character in it. We need to collect the
-   * remaining characters in the name from the buffer. The length is valid
-   * because the node's crc has been validated.
-   */
-  je = jffs2_buffer_read(&control->buffer,
-                         control->cache.scratch,
-                         rdir->nsize);
-  if (je != JFFS2_NO_ERROR)
-    return je;
-  control->cache.scratch[rdir->nsize] = '\0';
-
-  if (trace_dir_name)
-    jffs2_print("process_dir: %3d: %s (%u/%u)\n",
-                rdir->nsize, control->cache.scratch,
-                je32_to_cpu(rdir->ino), je32_to_cpu(rdir->version));
-
   for (p = parts; p < JFFS2_MAX_PATH_DEPTH; ++p)
   {
-
     if (control->path.parts[p] == NULL)
       break;
 
+    /*
+     * The name's CRC and size reject the entry before the name is read.
+     */
+    if ((control->path.lengths[p] != rdir->nsize) ||
+        (control->path.crcs[p] != name_crc))
+      continue;
+
+    /*
+     * The rdir entry has the first character in it. We need to collect the
+     * remaining characters in the name from the buffer. The length is valid
+     * because the node's crc has been validated.
+     */
+    if (!name_read)
+    {
+      je = jffs2_buffer_read(&control->buffer,
+                             control->cache.scratch,
+                             rdir->nsize);
+      if (je != JFFS2_NO_ERROR)
+        return je;
+      control->cache.scratch[rdir->nsize] = '\0';
+      name_read = true;
+
+      if (trace_dir_name)
+        jffs2_print("process_dir: %3d: %s (%u/%u)\n",
+                    rdir->nsize, control->cache.scratch,
+                    je32_to_cpu(rdir->ino), je32_to_cpu(rdir->version));
+    }
+
     if (jffs2_match_name(control->path.parts[p], control->cache.scratch))
     {
       jffs2_dir* dir;
       jffs2_dir* node;
 
       /*
-       * Allocate a cached directory entry.
+       * Allocate a cached directory entry. If the cache is full drop the
+       * found entries. The path is scanned for again if it is not found.
        */
-      dir = jffs2_dir_cache_alloc(&control->cache.dir,
+      dir = jffs2_dir_cache_alloc(cache,
                                   offset,
                                   control->path.parts[p],
                                   rdir);
       if (dir == NULL)
-        return JFFS2_DIR_CACHE_FULL;
+      {
+        jffs2_dir_cache_drop(cache);
+        dir = jffs2_dir_cache_alloc(cache,
+                                    offset,
+                                    control->path.parts[p],
+                                    rdir);
+        if (dir == NULL)
+          return JFFS2_DIR_CACHE_FULL;
+      }
 
       if (trace_process_dir)
         jffs2_dir_print("process_dir: alloc", dir);
@@ -1091,7 +1245,7 @@ jffs2_process_dir(jffs2_control*           control,
        * If the version of the new directory entry is greater than any nodes
        * with the same ino in the path or cache replace it. If the verson is
        * older drop this entry. If the ino does not match any existing nodes
-       * add it to the cache's found list.
+       * add it to the cache's found entries.
        */
 
       for (p = 0; p < JFFS2_MAX_PATH_DEPTH; ++p)
@@ -1105,11 +1259,11 @@ jffs2_process_dir(jffs2_control*           control,
           if (dir->version > node->version)
           {
             control->path.nodes[p] = dir;
-            jffs2_dir_push_head(&control->cache.dir.free, node);
+            jffs2_dir_cache_free(cache, node);
           }
           else
           {
-            jffs2_dir_push_head(&control->cache.dir.free, dir);
+            jffs2_dir_cache_free(cache, dir);
           }
           dir = NULL;
           break;
@@ -1118,26 +1272,18 @@ jffs2_process_dir(jffs2_control*           control,
 
       if (dir)
       {
-        node = control->cache.dir.found;
-        while (node)
+        node = jffs2_dir_find(cache, dir->ino, false);
+        if (node)
         {
-          if (dir->ino == node->ino)
+          if (dir->version > node->version)
           {
-            if (dir->version > node->version)
-            {
-              jffs2_dir_remove(&control->cache.dir.found, node);
-              jffs2_dir_push_head(&control->cache.dir.free, node);
-            }
-            else
-            {
-              jffs2_dir_push_head(&control->cache.dir.free, dir);
-              dir = NULL;
-            }
-            node = NULL;
+            jffs2_dir_found_remove(cache, node);
+            jffs2_dir_cache_free(cache, node);
           }
           else
           {
-            node = node->next;
+            jffs2_dir_cache_free(cache, dir);
+            dir = NULL;
           }
         }
 
@@ -1145,7 +1291,7 @@ jffs2_process_dir(jffs2_control*           control,
         {
           if (trace_process_dir)
             jffs2_dir_print("process_dir: found", dir);
-          jffs2_dir_append(&control->cache.dir.found, dir);
+          jffs2_dir_found_add(cache, dir);
         }
       }
 
@@ -1185,24 +1331,14 @@ jffs2_path_dir_node(jffs2_control* control)
   return control->path.nodes[part];
 }
 
+/*
+ * Scan the whole image for the path's directory entries.
+ */
 static jffs2_error
-jffs2_find_path(jffs2_control* control, const char* path)
+jffs2_find_path_scan(jffs2_control* control)
 {
-  jffs2_error je;
-
-  /*
-   * Reset the cache and set the path.
-   */
   jffs2_buffer_reset(&control->buffer);
-  jffs2_dir_cache_init(&control->cache.dir);
-
-  je = jffs2_dir_set_path(&control->path, path);
-  if (je != JFFS2_NO_ERROR)
-    return je;
 
-  /*
-   * Scan the whole image.
-   */
   while (jffs2_buffer_flash_data_available(&control->buffer))
   {
     struct jffs2_raw_dirent dir;
@@ -1257,46 +1393,667 @@ jffs2_find_path(jffs2_control* control, const char* path)
     jffs2_buffer_set_offset(&control->buffer, offset + len);
   }
 
-  if (trace_find_path)
+  return JFFS2_NO_ERROR;
+}
+
+static int
+jffs2_path_parts_found(jffs2_control* control)
+{
+  int p;
+  for (p = 0; p < JFFS2_MAX_PATH_DEPTH; ++p)
   {
-    jffs2_print("find_path: ");
-    jffs2_print_path(control);
-    jffs2_print(": nodes-used=%zu%% (%zu/%zu)\n",
-                ((JFFS2_DIR_CACHE_NODES - control->cache.dir.min_free) * 100) / JFFS2_DIR_CACHE_NODES,
-                JFFS2_DIR_CACHE_NODES - control->cache.dir.min_free,
-                JFFS2_DIR_CACHE_NODES);
+    if (control->path.nodes[p] == NULL)
+      break;
   }
-
-  return jffs2_path_found(control) ? JFFS2_NO_ERROR : JFFS2_NOT_FOUND;
+  return p;
 }
 
 static jffs2_error
-jffs2_inode_copy(jffs2_control* control, uint32_t ino, uint8_t* buffer, size_t* size)
+jffs2_find_path(jffs2_control* control, const char* path)
 {
-  uint32_t inode_count = 0;
-  uint32_t isize_max = 0;
-  uint32_t csize_total = 0;
-  uint32_t dsize_total = 0;
+  jffs2_error je;
 
-  if (trace_inode_copy)
-    jffs2_print("inodes_copy: ino=%u buffer=%p size=%zu\n",
-                ino, buffer, *size);
+  /*
+   * Reset the cache and set the path.
+   */
+  jffs2_dir_cache_init(&control->cache.dir);
 
-  jffs2_buffer_reset(&control->buffer);
+  je = jffs2_dir_set_path(&control->path, path);
+  if (je != JFFS2_NO_ERROR)
+    return je;
 
   /*
-   * Find the inode.
+   * Scan again if found entries were dropped to make room in the cache and
+   * the scan found more of the path. A scan finds at least the next part of
+   * the path if it exists.
    */
-  while (jffs2_buffer_flash_data_available(&control->buffer))
+  while (true)
   {
-    struct jffs2_raw_inode inode;
-    uint32_t               offset;
-    uint32_t               crc;
-    uint32_t               len;
-    jffs2_error            je;
+    int parts = jffs2_path_parts_found(control);
 
-    /*
-     * Find the next inode. Buffer left pointing to the start of the node.
+    control->cache.dir.dropped = false;
+
+    je = jffs2_find_path_scan(control);
+    if (je != JFFS2_NO_ERROR)
+      return je;
+
+    if (jffs2_path_found(control) || !control->cache.dir.dropped ||
+        (jffs2_path_parts_found(control) == parts))
+      break;
+
+    if (trace_find_path)
+      jffs2_print("find_path: cache full, scanning again\n");
+
+    jffs2_dir_cache_drop(&control->cache.dir);
+  }
+
+  if (trace_find_path)
+  {
+    jffs2_print("find_path: ");
+    jffs2_print_path(control);
+    jffs2_print(": nodes-used=%u%% (%u/%u)\n",
+                ((JFFS2_DIR_CACHE_NODES - control->cache.dir.min_free) * 100) / JFFS2_DIR_CACHE_NODES,
+                JFFS2_DIR_CACHE_NODES - control->cache.dir.min_free,
+                JFFS2_DIR_CACHE_NODES);
+  }
+
+  return jffs2_path_found(control) ? JFFS2_NO_ERROR : JFFS2_NOT_FOUND;
+}
+
+/*
+ * The state of a file copy.
+ */
+typedef struct
+{
+  uint8_t*           buffer;
+  size_t             size;
+  jffs2_data_handler handler;
+  void*              handler_arg;
+  uint32_t           inode_count;
+  uint32_t           isize_max;
+  uint32_t           csize_total;
+  uint32_t           dsize_total;
+  size_t             passed;
+  bool               pass_at_end;
+  bool               pass_again;
+} jffs2_copy;
+
+static void
+jffs2_inode_copy_init(jffs2_copy*        copy,
+                      uint8_t*           buffer,
+                      size_t             size,
+                      jffs2_data_handler handler,
+                      void*              handler_arg)
+{
+  memset(copy, 0, sizeof(*copy));
+  copy->buffer = buffer;
+  copy->size = size;
+  copy->handler = handler;
+  copy->handler_arg = handler_arg;
+}
+
+/*
+ * Copy an inode node's data to the destination. The node's header has been
+ * read and checked and the buffer is at the node's data.
+ */
+static jffs2_error
+jffs2_inode_copy_node(jffs2_control*          control,
+                      jffs2_copy*             copy,
+                      uint32_t                offset,
+                      struct jffs2_raw_inode* inode)
+{
+  const uint32_t isize = je32_to_cpu(inode->isize);
+  const uint32_t icsize = je32_to_cpu(inode->csize);
+  uint32_t       idsize = je32_to_cpu(inode->dsize);
+  const uint32_t ioffset = je32_to_cpu(inode->offset);
+  const uint32_t doffset = jffs2_buffer_offset(&control->buffer);
+  uint8_t*       buffer = copy->buffer;
+  uint32_t       bsize;
+  uint32_t       crc;
+  uLongf         dsize;
+  int            ze;
+  uint64_t       inflate_start;
+  uint64_t       inflate_end;
+  jffs2_error    je;
+
+  ++copy->inode_count;
+  copy->csize_total += icsize;
+  copy->dsize_total += idsize;
+
+  if (trace_inode_copy_inodes)
+  {
+    jffs2_inode_print("copy_inodes", inode);
+    if (trace_inode_copy_inodes_dump)
+      jffs2_dump_memory("inode", offset, inode, sizeof(*inode));
+  }
+
+  if (copy->isize_max < isize)
+    copy->isize_max = isize;
+
+  /*
+   * The user may have requested only part of a file so only return the
+   * part they requested. If the data is outside the buffer requested
+   * there is no need to process the inode.
+   */
+
+  if (ioffset >= copy->size)
+    return JFFS2_NO_ERROR;
+
+  if ((ioffset + idsize) > copy->size)
+    idsize = copy->size - ioffset;
+
+  dsize = idsize;
+
+  switch (inode->compr)
+  {
+    case JFFS2_COMPR_ZLIB:
+    case JFFS2_COMPR_NONE:
+      bsize = inode->compr == JFFS2_COMPR_ZLIB ? icsize : idsize;
+      if (bsize > sizeof(control->cache.scratch))
+      {
+          jffs2_print("inode: bad inode bsize @ 0x%08x : bsize:%u\n",
+                      offset, bsize);
+          jffs2_dump_memory("inode", offset, inode, sizeof(*inode));
+          jffs2_dump_memory("data", doffset, control->cache.scratch, bsize);
+          return JFFS2_INODE_DATA_TOO_BIG;
+      }
+      je = jffs2_buffer_read(&control->buffer,
+                             control->cache.scratch,
+                             bsize);
+      if (je != JFFS2_NO_ERROR)
+        return je;
+      crc = jffs2_crc32(0, control->cache.scratch, bsize);
+      if (crc != je32_to_cpu(inode->data_crc))
+      {
+        if (trace_bad_inode_crc)
+        {
+          jffs2_print("inode: bad inode data crc @ 0x%08x\n", offset);
+          jffs2_dump_memory("inode", offset, inode, sizeof(*inode));
+          jffs2_dump_memory("data", doffset, control->cache.scratch, bsize);
+          return JFFS2_INVALID_CRC;
+        }
+      }
+      break;
+    case JFFS2_COMPR_ZERO:
+    default:
+      break;
+  }
+
+  switch (inode->compr)
+  {
+    case JFFS2_COMPR_ZLIB:
+      if (idsize > sizeof(control->cache.scratch))
+        return JFFS2_INODE_DATA_TOO_BIG;
+      if (trace_inode_copy_inodes_zlib)
+        jffs2_dump_memory("inode zlib", doffset,
+                          control->cache.scratch, icsize);
+      board_timer_get(&inflate_start);
+      ze = uncompress((buffer + ioffset), &dsize,
+                      (uint8_t*) control->cache.scratch, icsize);
+      board_timer_get(&inflate_end);
+      ++control->buffer.inflate_count;
+      control->buffer.inflate_usecs += inflate_end - inflate_start;
+      if (trace_inode_copy_inodes_data)
+        jffs2_dump_memory("inode data", (uintptr_t) (buffer + ioffset),
+                          buffer + ioffset, dsize);
+      if ((ze != Z_OK) && (ze != Z_BUF_ERROR))
+        return JFFS2_ZLIB_ERROR;
+      if (dsize != idsize)
+        return JFFS2_ZLIB_BAD_SIZE;
+      break;
+    case JFFS2_COMPR_NONE:
+      if (idsize > sizeof(control->cache.scratch))
+        return JFFS2_INODE_DATA_TOO_BIG;
+      memcpy(buffer + ioffset, control->cache.scratch, idsize);
+      break;
+    case JFFS2_COMPR_ZERO:
+      if (idsize > sizeof(control->cache.scratch))
+        return JFFS2_INODE_DATA_TOO_BIG;
+      memset(buffer + ioffset, 0, idsize);
+      break;
+    default:
+      return JFFS2_INVALID_COMPR;
+      break;
+  }
+
+  /*
+   * Pass the data to the handler while it is in order. Once a node
+   * is out of order the handler is passed the rest at the end.
+   */
+  if ((copy->handler != NULL) && (idsize != 0))
+  {
+    if (ioffset < copy->passed)
+    {
+      copy->pass_at_end = true;
+      copy->pass_again = true;
+    }
+    else if (ioffset > copy->passed)
+    {
+      copy->pass_at_end = true;
+    }
+    else if (!copy->pass_at_end)
+    {
+      if (copy->handler(copy->handler_arg, copy->passed,
+                        buffer + copy->passed, idsize) != 0)
+        return JFFS2_DATA_HANDLER_ABORT;
+      copy->passed += idsize;
+    }
+  }
+
+  return JFFS2_NO_ERROR;
+}
+
+/*
+ * Finish the copy. The size is set to the file's size and any data not yet
+ * passed to the handler is passed.
+ */
+static jffs2_error
+jffs2_inode_copy_end(jffs2_copy* copy, size_t* size)
+{
+  if (*size > copy->isize_max)
+    *size = copy->isize_max;
+
+  if (copy->handler != NULL)
+  {
+    if (copy->passed > *size)
+      copy->pass_again = true;
+    if (copy->pass_again)
+      copy->passed = 0;
+    if (copy->passed < *size)
+    {
+      if (copy->handler(copy->handler_arg, copy->passed,
+                        copy->buffer + copy->passed,
+                        *size - copy->passed) != 0)
+        return JFFS2_DATA_HANDLER_ABORT;
+    }
+  }
+
+  if (trace_inode_copy_stats)
+    jffs2_print("find_inodes: inodes=%u isize=%u csize=%u compr=%u%%\n",
+                copy->inode_count, copy->isize_max, copy->csize_total,
+                100 - ((copy->csize_total * 100) / copy->dsize_total));
+
+  return JFFS2_NO_ERROR;
+}
+
+/*
+ * Read an inode node's header at the buffer's offset and check it. The
+ * buffer is left at the node's data.
+ */
+static jffs2_error
+jffs2_inode_read(jffs2_control*          control,
+                 uint32_t                offset,
+                 struct jffs2_raw_inode* inode,
+                 bool*                   valid)
+{
+  jffs2_error je;
+  uint32_t    crc;
+
+  je = jffs2_buffer_read(&control->buffer, inode, sizeof(*inode));
+  if (je != JFFS2_NO_ERROR)
+    return je;
+
+  crc = jffs2_crc32(0, inode, sizeof(*inode) - 8);
+
+  *valid = crc == je32_to_cpu(inode->node_crc);
+
+  if (!*valid)
+  {
+    if (trace_bad_inode_crc)
+    {
+      jffs2_print("inode: bad inode crc @ 0x%08x\n", offset);
+      jffs2_dump_memory("inode", offset, inode, sizeof(*inode));
+      return JFFS2_INVALID_CRC;
+    }
+  }
+
+  return JFFS2_NO_ERROR;
+}
+
+/*
+ * The fragment map of a file. The data nodes are sorted by the page of the
+ * file their data is in and by version, the highest first. A node whose
+ * data is covered by higher versions is obsolete and is not read. The live
+ * nodes of a page are copied in version order so a newer node that covers
+ * part of an older node is copied after it. JFFS2 writes a data node
+ * within one page of the file. If a node crosses a page all the nodes are
+ * live and copied in version order.
+ *
+ * A file with more nodes than the map holds is read in passes. A pass maps
+ * the lowest versions from the floor, the version after the highest of the
+ * last pass, and copies them. The later passes only copy higher versions so
+ * the file is still copied in version order.
+ */
+typedef struct
+{
+  jffs2_frag* frags;
+  uint32_t    slots;
+  uint32_t    count;
+  uint32_t    obsolete;
+  uint32_t    isize;
+  uint32_t    version;
+  uint32_t    floor;
+  bool        paged;
+  bool        full;
+} jffs2_frag_map;
+
+typedef bool (*jffs2_frag_order)(const jffs2_frag_map* map,
+                                 const jffs2_frag*     a,
+                                 const jffs2_frag*     b);
+
+static void
+jffs2_frag_init(jffs2_frag_map* map,
+                jffs2_frag*     frags,
+                uint32_t        slots,
+                uint32_t        floor)
+{
+  memset(map, 0, sizeof(*map));
+  map->frags = frags;
+  map->slots = slots;
+  map->floor = floor;
+  map->paged = true;
+}
+
+static inline uint32_t
+jffs2_frag_page(const jffs2_frag_map* map, const jffs2_frag* frag)
+{
+  return map->paged ? frag->ioffset / JFFS2_FRAG_PAGE_SIZE : 0;
+}
+
+static inline bool
+jffs2_frag_before(const jffs2_frag_map* map,
+                  const jffs2_frag*     a,
+                  const jffs2_frag*     b)
+{
+  const uint32_t pa = jffs2_frag_page(map, a);
+  const uint32_t pb = jffs2_frag_page(map, b);
+  if (pa != pb)
+    return pa < pb;
+  return a->version > b->version;
+}
+
+static inline bool
+jffs2_frag_older(const jffs2_frag_map* map,
+                 const jffs2_frag*     a,
+                 const jffs2_frag*     b)
+{
+  (void) map;
+  return a->version < b->version;
+}
+
+static void
+jffs2_frag_sift(jffs2_frag_map*  map,
+                uint32_t         root,
+                uint32_t         count,
+                jffs2_frag_order before)
+{
+  jffs2_frag* frags = map->frags;
+
+  while (true)
+  {
+    uint32_t   child = (root * 2) + 1;
+    jffs2_frag tmp;
+
+    if (child >= count)
+      break;
+    if (((child + 1) < count) &&
+        before(map, &frags[child], &frags[child + 1]))
+      ++child;
+    if (!before(map, &frags[root], &frags[child]))
+      break;
+
+    tmp = frags[root];
+    frags[root] = frags[child];
+    frags[child] = tmp;
+    root = child;
+  }
+}
+
+static void
+jffs2_frag_heap(jffs2_frag_map* map, jffs2_frag_order before)
+{
+  uint32_t n;
+
+  for (n = map->count / 2; n > 0; --n)
+    jffs2_frag_sift(map, n - 1, map->count, before);
+}
+
+/*
+ * Add a data node. The file's size is the size in the highest version.
+ * Nodes below the floor were copied by an earlier pass. A full map
+ * is kept as a heap with the highest version first and a lower version
+ * replaces it. A node with the same version as a mapped node is a copy of
+ * it and is not needed.
+ */
+static jffs2_error
+jffs2_frag_add(jffs2_frag_map* map,
+               uint32_t        offset,
+               uint32_t        version,
+               uint32_t        ioffset,
+               uint32_t        dsize,
+               uint32_t        isize)
+{
+  jffs2_frag* frag;
+
+  if (version < map->floor)
+    return JFFS2_NO_ERROR;
+
+  if (map->count >= map->slots)
+  {
+    if (map->slots == 0)
+      return JFFS2_INDEX_FULL;
+    if (!map->full)
+    {
+      map->full = true;
+      jffs2_frag_heap(map, jffs2_frag_older);
+    }
+    if (version >= map->frags[0].version)
+      return JFFS2_NO_ERROR;
+    frag = &map->frags[0];
+  }
+  else
+  {
+    frag = &map->frags[map->count];
+    ++map->count;
+  }
+
+  frag->offset = offset;
+  frag->version = version;
+  frag->ioffset = ioffset;
+  frag->dsize = dsize;
+  frag->isize = isize;
+
+  if (map->full)
+  {
+    jffs2_frag_sift(map, 0, map->count, jffs2_frag_older);
+    map->version = map->frags[0].version;
+    map->isize = map->frags[0].isize;
+  }
+  else if ((map->count == 1) || (version > map->version))
+  {
+    map->version = version;
+    map->isize = isize;
+  }
+
+  if (((ioffset % JFFS2_FRAG_PAGE_SIZE) + dsize) > JFFS2_FRAG_PAGE_SIZE)
+    map->paged = false;
+
+  return JFFS2_NO_ERROR;
+}
+
+/*
+ * Heap sort the map. It needs no memory and has no worst case.
+ */
+static void
+jffs2_frag_sort(jffs2_frag_map* map)
+{
+  uint32_t n;
+
+  if (map->count < 2)
+    return;
+
+  jffs2_frag_heap(map, jffs2_frag_before);
+
+  for (n = map->count - 1; n > 0; --n)
+  {
+    jffs2_frag tmp = map->frags[0];
+    map->frags[0] = map->frags[n];
+    map->frags[n] = tmp;
+    jffs2_frag_sift(map, 0, n, jffs2_frag_before);
+  }
+}
+
+/*
+ * Set the bits in the page's coverage bitmap. Returns true if any bits were
+ * clear.
+ */
+static bool
+jffs2_frag_cover(uint32_t* bitmap, uint32_t start, uint32_t end)
+{
+  bool uncovered = false;
+
+  while (start < end)
+  {
+    const uint32_t bit = start % 32;
+    const uint32_t bits = (end - start) < (32 - bit) ? (end - start) : (32 - bit);
+    const uint32_t mask = (bits == 32 ? 0xffffffffUL : ((1UL << bits) - 1)) << bit;
+
+    if ((bitmap[start / 32] & mask) != mask)
+      uncovered = true;
+    bitmap[start / 32] |= mask;
+    start += bits;
+  }
+
+  return uncovered;
+}
+
+/*
+ * Mark the obsolete nodes. The nodes of a page are visited highest version
+ * first and a node that covers no bytes not already covered is obsolete.
+ * Data past the end of the file is not live.
+ */
+static void
+jffs2_frag_live(jffs2_control* control, jffs2_frag_map* map)
+{
+  uint32_t* bitmap = (uint32_t*) control->cache.scratch;
+  uint32_t  page = JFFS2_INDEX_NONE;
+  uint32_t  f;
+
+  if (!map->paged)
+    return;
+
+  for (f = 0; f < map->count; ++f)
+  {
+    jffs2_frag* frag = &map->frags[f];
+    uint32_t    start = frag->ioffset;
+    uint32_t    end = frag->ioffset + frag->dsize;
+
+    if (jffs2_frag_page(map, frag) != page)
+    {
+      page = jffs2_frag_page(map, frag);
+      memset(bitmap, 0, JFFS2_FRAG_PAGE_SIZE / 8);
+    }
+
+    if (end > map->isize)
+      end = map->isize;
+
+    if ((start >= end) ||
+        !jffs2_frag_cover(bitmap,
+                          start - (page * JFFS2_FRAG_PAGE_SIZE),
+                          end - (page * JFFS2_FRAG_PAGE_SIZE)))
+    {
+      frag->offset = JFFS2_INDEX_NONE;
+      ++map->obsolete;
+    }
+  }
+}
+
+/*
+ * Copy the live nodes. The pages are copied in order and the nodes of a
+ * page lowest version first.
+ */
+static jffs2_error
+jffs2_frag_copy(jffs2_control*  control,
+                jffs2_frag_map* map,
+                jffs2_copy*     copy,
+                uint32_t        ino)
+{
+  uint32_t first = 0;
+
+  if (trace_inode_copy_frags)
+    jffs2_print("frag_copy: ino=%u nodes=%u obsolete=%u isize=%u paged=%s floor=%u\n",
+                ino, map->count, map->obsolete, map->isize,
+                map->paged ? "yes" : "no", map->floor);
+
+  while (first < map->count)
+  {
+    const uint32_t page = jffs2_frag_page(map, &map->frags[first]);
+    uint32_t       last = first;
+    uint32_t       f;
+
+    while ((last < map->count) &&
+           (jffs2_frag_page(map, &map->frags[last]) == page))
+      ++last;
+
+    for (f = last; f > first; --f)
+    {
+      const jffs2_frag*      frag = &map->frags[f - 1];
+      struct jffs2_raw_inode inode;
+      bool                   valid = false;
+      jffs2_error            je;
+
+      if (frag->offset == JFFS2_INDEX_NONE)
+        continue;
+
+      jffs2_buffer_set_offset(&control->buffer, frag->offset);
+
+      je = jffs2_inode_read(control, frag->offset, &inode, &valid);
+      if (je != JFFS2_NO_ERROR)
+        return je;
+
+      if (valid && (je32_to_cpu(inode.ino) == ino))
+      {
+        je = jffs2_inode_copy_node(control, copy, frag->offset, &inode);
+        if (je != JFFS2_NO_ERROR)
+          return je;
+      }
+    }
+
+    first = last;
+  }
+
+  /*
+   * The file's size is the size in the highest version and not the largest
+   * size of any node.
+   */
+  copy->isize_max = map->isize;
+
+  return JFFS2_NO_ERROR;
+}
+
+/*
+ * Scan the flash for an inode's nodes and add them to the fragment map.
+ */
+static jffs2_error
+jffs2_inode_scan(jffs2_control*  control,
+                 uint32_t        ino,
+                 jffs2_frag_map* map)
+{
+  jffs2_buffer_reset(&control->buffer);
+
+  /*
+   * Find the inode.
+   */
+  while (jffs2_buffer_flash_data_available(&control->buffer))
+  {
+    struct jffs2_raw_inode inode;
+    uint32_t               offset;
+    uint32_t               len;
+    bool                   valid = false;
+    jffs2_error            je;
+
+    /*
+     * Find the next inode. Buffer left pointing to the start of the node.
      */
     je = jffs2_buffer_find_node(&control->buffer, JFFS2_NODETYPE_INODE);
     if (je != JFFS2_NO_ERROR)
@@ -1306,182 +2063,861 @@ jffs2_inode_copy(jffs2_control* control, uint32_t ino, uint8_t* buffer, size_t*
       return je;
     }
 
-    /*
-     * Remember the offset so we can set the position to the offset plus the
-     * aligned (padded) total len in the header. The total length is valid
-     * because the header CRC is valid.
-     */
-    offset = jffs2_buffer_offset(&control->buffer);
+    /*
+     * Remember the offset so we can set the position to the offset plus the
+     * aligned (padded) total len in the header. The total length is valid
+     * because the header CRC is valid.
+     */
+    offset = jffs2_buffer_offset(&control->buffer);
+
+    /*
+     * Get a local copy. This avoids any buffering boundary issues at the cost
+     * of a little stack space being used.
+     */
+    je = jffs2_inode_read(control, offset, &inode, &valid);
+    if (je != JFFS2_NO_ERROR)
+      return je;
+
+    len = PAD_4(je32_to_cpu(inode.totlen));
+
+    if (valid && (je32_to_cpu(inode.ino) == ino))
+    {
+      je = jffs2_frag_add(map, offset,
+                          je32_to_cpu(inode.version),
+                          je32_to_cpu(inode.offset),
+                          je32_to_cpu(inode.dsize),
+                          je32_to_cpu(inode.isize));
+      if (je != JFFS2_NO_ERROR)
+        return je;
+    }
+
+    jffs2_buffer_set_offset(&control->buffer, offset + len);
+  }
+
+  return JFFS2_NO_ERROR;
+}
+
+static jffs2_error
+jffs2_inode_copy(jffs2_control*     control,
+                 uint32_t           ino,
+                 uint8_t*           buffer,
+                 size_t*            size,
+                 jffs2_data_handler handler,
+                 void*              handler_arg)
+{
+  jffs2_frag*    frags = control->index.frags;
+  uint32_t       slots = control->index.frag_slots;
+  jffs2_frag_map map;
+  jffs2_copy     copy;
+  uint32_t       floor = 0;
+  jffs2_error    je;
+
+  if (trace_inode_copy)
+    jffs2_print("inodes_copy: ino=%u buffer=%p size=%zu\n",
+                ino, buffer, *size);
+
+  jffs2_inode_copy_init(&copy, buffer, *size, handler, handler_arg);
+
+  /*
+   * The fragment map uses the caller's memory or the control block's
+   * slots. A file with more nodes than the map holds is scanned and copied
+   * once for each pass.
+   */
+  if (frags == NULL)
+  {
+    frags = control->cache.frags;
+    slots = JFFS2_FRAG_CACHE_SLOTS;
+  }
+
+  do
+  {
+    jffs2_frag_init(&map, frags, slots, floor);
+
+    je = jffs2_inode_scan(control, ino, &map);
+    if (je != JFFS2_NO_ERROR)
+      return je;
+
+    jffs2_frag_sort(&map);
+    jffs2_frag_live(control, &map);
+
+    je = jffs2_frag_copy(control, &map, &copy, ino);
+    if (je != JFFS2_NO_ERROR)
+      return je;
+
+    floor = map.version + 1;
+  } while (map.full);
+
+  return jffs2_inode_copy_end(&copy, size);
+}
+
+static void
+jffs2_index_init(jffs2_index* index, void* memory, uint32_t size)
+{
+  uint8_t* m = memory;
+
+  memset(index, 0, sizeof(*index));
+
+  index->dirent_slots = JFFS2_INDEX_DIRENTS(size);
+  index->inode_slots = JFFS2_INDEX_INODES(size);
+  index->node_slots = JFFS2_INDEX_NODES(size);
+
+  index->dirents = (jffs2_index_dirent*) m;
+  m += index->dirent_slots * sizeof(jffs2_index_dirent);
+  index->inodes = (jffs2_index_inode*) m;
+  m += index->inode_slots * sizeof(jffs2_index_inode);
+  index->nodes = (jffs2_index_node*) m;
+  m += index->node_slots * sizeof(jffs2_index_node);
+  index->frags = (jffs2_frag*) m;
+  index->frag_slots = index->node_slots;
+
+  /*
+   * The node list does not need to be cleared.
+   */
+  memset(index->dirents, 0, index->dirent_slots * sizeof(jffs2_index_dirent));
+  memset(index->inodes, 0, index->inode_slots * sizeof(jffs2_index_inode));
+}
+
+/*
+ * Read an indexed directory entry's name into the buffer.
+ */
+static jffs2_error
+jffs2_index_dirent_name(jffs2_control*            control,
+                        const jffs2_index_dirent* dirent,
+                        char*                     name)
+{
+  jffs2_error je;
+
+  jffs2_buffer_set_offset(&control->buffer,
+                          dirent->offset + sizeof(struct jffs2_raw_dirent));
+
+  je = jffs2_buffer_read(&control->buffer, name, dirent->nsize);
+  if (je != JFFS2_NO_ERROR)
+    return je;
+
+  name[dirent->nsize] = '\0';
+
+  return JFFS2_NO_ERROR;
+}
+
+/*
+ * Add a directory entry. The name is in the scratch buffer. A later version
+ * of a name replaces the entry.
+ */
+static jffs2_error
+jffs2_index_add_dirent(jffs2_control*                 control,
+                       uint32_t                       offset,
+                       const struct jffs2_raw_dirent* rdir)
+{
+  jffs2_index*   index = &control->index;
+  const uint32_t pino = je32_to_cpu(rdir->pino);
+  const uint32_t name_crc = je32_to_cpu(rdir->name_crc);
+  const uint32_t version = je32_to_cpu(rdir->version);
+  char*          name = control->cache.scratch + JFFS2_DIR_MAX_NAME_LEN + 1;
+  uint32_t       slot;
+
+  slot = jffs2_index_hash(pino, name_crc) % index->dirent_slots;
+
+  while (true)
+  {
+    jffs2_index_dirent* dirent = &index->dirents[slot];
+
+    if (dirent->nsize == 0)
+    {
+      if (index->dirent_count >= JFFS2_INDEX_LIMIT(index->dirent_slots))
+        return JFFS2_INDEX_FULL;
+      dirent->pino = pino;
+      dirent->name_crc = name_crc;
+      dirent->ino = je32_to_cpu(rdir->ino);
+      dirent->version = version;
+      dirent->offset = offset;
+      dirent->nsize = rdir->nsize;
+      dirent->type = rdir->type;
+      ++index->dirent_count;
+      return JFFS2_NO_ERROR;
+    }
+
+    if ((dirent->pino == pino) && (dirent->name_crc == name_crc) &&
+        (dirent->nsize == rdir->nsize))
+    {
+      jffs2_error je;
+
+      je = jffs2_index_dirent_name(control, dirent, name);
+      if (je != JFFS2_NO_ERROR)
+        return je;
+
+      if (memcmp(name, control->cache.scratch, rdir->nsize) == 0)
+      {
+        if (version > dirent->version)
+        {
+          dirent->ino = je32_to_cpu(rdir->ino);
+          dirent->version = version;
+          dirent->offset = offset;
+          dirent->type = rdir->type;
+        }
+        return JFFS2_NO_ERROR;
+      }
+    }
+
+    slot = (slot + 1) % index->dirent_slots;
+  }
+}
+
+/*
+ * Add a data node to the inode's list. A node indexed from a summary has no
+ * header and its header is read when the file is.
+ */
+static jffs2_error
+jffs2_index_add_node(jffs2_index*                  index,
+                     uint32_t                      ino,
+                     uint32_t                      offset,
+                     const struct jffs2_raw_inode* rinode)
+{
+  jffs2_index_inode* inode;
+  uint32_t           slot;
+  uint32_t           node;
+
+  if (ino == 0)
+    return JFFS2_NO_ERROR;
+
+  slot = jffs2_index_hash(ino, 0) % index->inode_slots;
+
+  while (true)
+  {
+    inode = &index->inodes[slot];
+    if (inode->ino == ino)
+      break;
+    if (inode->ino == 0)
+    {
+      if (index->inode_count >= JFFS2_INDEX_LIMIT(index->inode_slots))
+        return JFFS2_INDEX_FULL;
+      inode->ino = ino;
+      inode->first = JFFS2_INDEX_NONE;
+      inode->last = JFFS2_INDEX_NONE;
+      inode->count = 0;
+      ++index->inode_count;
+      break;
+    }
+    slot = (slot + 1) % index->inode_slots;
+  }
+
+  if (index->node_count >= index->node_slots)
+    return JFFS2_INDEX_FULL;
+
+  node = index->node_count;
+  ++index->node_count;
+
+  index->nodes[node].offset = offset;
+  index->nodes[node].next = JFFS2_INDEX_NONE;
+
+  if (rinode != NULL)
+  {
+    index->nodes[node].version = je32_to_cpu(rinode->version);
+    index->nodes[node].ioffset = je32_to_cpu(rinode->offset);
+    index->nodes[node].isize = je32_to_cpu(rinode->isize);
+    index->nodes[node].dsize = je32_to_cpu(rinode->dsize);
+  }
+  else
+  {
+    index->nodes[node].dsize = JFFS2_INDEX_NONE;
+  }
+
+  if (inode->first == JFFS2_INDEX_NONE)
+    inode->first = node;
+  else
+    index->nodes[inode->last].next = node;
+  inode->last = node;
+  ++inode->count;
+
+  return JFFS2_NO_ERROR;
+}
+
+static jffs2_index_inode*
+jffs2_index_find_inode(jffs2_index* index, uint32_t ino)
+{
+  uint32_t slot = jffs2_index_hash(ino, 0) % index->inode_slots;
+
+  while (index->inodes[slot].ino != 0)
+  {
+    if (index->inodes[slot].ino == ino)
+      return &index->inodes[slot];
+    slot = (slot + 1) % index->inode_slots;
+  }
+
+  return NULL;
+}
+
+static jffs2_error
+jffs2_index_scan_dirent(jffs2_control* control, uint32_t offset)
+{
+  struct jffs2_raw_dirent dir;
+  jffs2_error             je;
+
+  je = jffs2_buffer_read(&control->buffer, &dir, sizeof(dir));
+  if (je != JFFS2_NO_ERROR)
+    return je;
+
+  if (jffs2_crc32(0, &dir, sizeof(dir) - 8) != je32_to_cpu(dir.node_crc))
+  {
+    if (trace_bad_dir_crc)
+      jffs2_print("index: bad dirent crc @ 0x%08x\n", offset);
+    return JFFS2_NO_ERROR;
+  }
+
+  if (dir.nsize == 0)
+    return JFFS2_NO_ERROR;
+
+  je = jffs2_buffer_read(&control->buffer, control->cache.scratch, dir.nsize);
+  if (je != JFFS2_NO_ERROR)
+    return je;
+
+  /*
+   * The name CRC is the hash key and the node CRC does not cover it.
+   */
+  if (jffs2_crc32(0, control->cache.scratch, dir.nsize) != je32_to_cpu(dir.name_crc))
+  {
+    if (trace_bad_dir_crc)
+      jffs2_print("index: bad dirent name crc @ 0x%08x\n", offset);
+    return JFFS2_NO_ERROR;
+  }
+
+  return jffs2_index_add_dirent(control, offset, &dir);
+}
+
+static jffs2_error
+jffs2_index_scan_inode(jffs2_control* control, uint32_t offset)
+{
+  struct jffs2_raw_inode inode;
+  bool                   valid = false;
+  jffs2_error            je;
+
+  je = jffs2_inode_read(control, offset, &inode, &valid);
+  if (je != JFFS2_NO_ERROR)
+    return je;
+
+  if (!valid)
+    return JFFS2_NO_ERROR;
+
+  return jffs2_index_add_node(&control->index, je32_to_cpu(inode.ino), offset,
+                              &inode);
+}
+
+/*
+ * Walk a block's summary entries. The entries are checked when not adding
+ * so a summary the loader cannot use is found before any entry is indexed.
+ */
+static jffs2_error
+jffs2_index_summary_entries(jffs2_control* control,
+                            uint32_t       block,
+                            uint32_t       start,
+                            uint32_t       end,
+                            uint32_t       count,
+                            bool           add,
+                            bool*          valid)
+{
+  jffs2_buffer* buffer = &control->buffer;
+  uint32_t      pos = start;
+  uint32_t      e;
+
+  *valid = false;
+
+  for (e = 0; e < count; ++e)
+  {
+    union
+    {
+      struct jffs2_sum_inode_flash  i;
+      struct jffs2_sum_dirent_flash d;
+    } entry;
+    uint16_t    ntype;
+    size_t      size;
+    jffs2_error je;
+
+    if ((pos + sizeof(entry.i.nodetype)) > end)
+      return JFFS2_NO_ERROR;
+
+    jffs2_buffer_set_offset(buffer, pos);
+    je = jffs2_buffer_read(buffer, &entry, sizeof(entry.i.nodetype));
+    if (je != JFFS2_NO_ERROR)
+      return je;
+
+    ntype = je16_to_cpu(entry.i.nodetype);
+
+    switch (ntype)
+    {
+      case JFFS2_NODETYPE_INODE:
+        size = sizeof(entry.i);
+        break;
+      case JFFS2_NODETYPE_DIRENT:
+        size = sizeof(entry.d);
+        break;
+      case JFFS2_NODETYPE_XATTR:
+        size = sizeof(struct jffs2_sum_xattr_flash);
+        break;
+      case JFFS2_NODETYPE_XREF:
+        size = sizeof(struct jffs2_sum_xref_flash);
+        break;
+      default:
+        if (trace_index_summary)
+          jffs2_print("index: summary: unknown entry type %04x @ 0x%08x\n",
+                      ntype, pos);
+        return JFFS2_NO_ERROR;
+    }
+
+    if ((pos + size) > end)
+      return JFFS2_NO_ERROR;
+
+    if (ntype == JFFS2_NODETYPE_INODE)
+    {
+      je = jffs2_buffer_read(buffer,
+                             ((uint8_t*) &entry) + sizeof(entry.i.nodetype),
+                             size - sizeof(entry.i.nodetype));
+      if (je != JFFS2_NO_ERROR)
+        return je;
+
+      if (je32_to_cpu(entry.i.offset) >= buffer->erase_sector_size)
+        return JFFS2_NO_ERROR;
+
+      if (add)
+      {
+        je = jffs2_index_add_node(&control->index,
+                                  je32_to_cpu(entry.i.inode),
+                                  block + je32_to_cpu(entry.i.offset),
+                                  NULL);
+        if (je != JFFS2_NO_ERROR)
+          return je;
+      }
+    }
+    else if (ntype == JFFS2_NODETYPE_DIRENT)
+    {
+      je = jffs2_buffer_read(buffer,
+                             ((uint8_t*) &entry) + sizeof(entry.d.nodetype),
+                             size - sizeof(entry.d.nodetype));
+      if (je != JFFS2_NO_ERROR)
+        return je;
+
+      size += entry.d.nsize;
+
+      if (((pos + size) > end) ||
+          (je32_to_cpu(entry.d.offset) >= buffer->erase_sector_size))
+        return JFFS2_NO_ERROR;
+
+      if (add && (entry.d.nsize != 0))
+      {
+        struct jffs2_raw_dirent rdir;
+
+        je = jffs2_buffer_read(buffer, control->cache.scratch, entry.d.nsize);
+        if (je != JFFS2_NO_ERROR)
+          return je;
+
+        /*
+         * The summary holds no name CRC. The summary CRC covers the name.
+         */
+        memset(&rdir, 0, sizeof(rdir));
+        rdir.pino = entry.d.pino;
+        rdir.version = entry.d.version;
+        rdir.ino = entry.d.ino;
+        rdir.nsize = entry.d.nsize;
+        rdir.type = entry.d.type;
+        rdir.name_crc = cpu_to_je32(jffs2_crc32(0,
+                                                control->cache.scratch,
+                                                entry.d.nsize));
+
+        je = jffs2_index_add_dirent(control,
+                                    block + je32_to_cpu(entry.d.offset),
+                                    &rdir);
+        if (je != JFFS2_NO_ERROR)
+          return je;
+      }
+    }
+
+    pos += size;
+  }
+
+  *valid = true;
+
+  return JFFS2_NO_ERROR;
+}
+
+/*
+ * Index an erase block from the summary node at its end. The marker in the
+ * last bytes of the block holds the summary's offset. The block is scanned
+ * if there is no marker or the summary's CRCs or entries are not valid.
+ */
+static jffs2_error
+jffs2_index_summary(jffs2_control* control, uint32_t block, bool* indexed)
+{
+  jffs2_buffer*            buffer = &control->buffer;
+  const uint32_t           block_size = buffer->erase_sector_size;
+  struct jffs2_sum_marker  marker;
+  struct jffs2_raw_summary summary;
+  uint32_t                 sum_offset;
+  uint32_t                 sum_size;
+  uint32_t                 pos;
+  uint32_t                 crc;
+  bool                     valid = false;
+  jffs2_error              je;
+
+  *indexed = false;
+
+  if ((block + block_size) > buffer->size)
+    return JFFS2_NO_ERROR;
+
+  jffs2_buffer_set_offset(buffer, block + block_size - sizeof(marker));
+  je = jffs2_buffer_read(buffer, &marker, sizeof(marker));
+  if (je != JFFS2_NO_ERROR)
+    return je;
+
+  if (je32_to_cpu(marker.magic) != JFFS2_SUM_MAGIC)
+    return JFFS2_NO_ERROR;
+
+  sum_offset = je32_to_cpu(marker.offset);
+  if ((sum_offset & 3) != 0 ||
+      sum_offset > (block_size - sizeof(summary) - sizeof(marker)))
+    return JFFS2_NO_ERROR;
+
+  sum_size = block_size - sum_offset;
+
+  jffs2_buffer_set_offset(buffer, block + sum_offset);
+  je = jffs2_buffer_read(buffer, &summary, sizeof(summary));
+  if (je != JFFS2_NO_ERROR)
+    return je;
+
+  if ((je16_to_cpu(summary.magic) != JFFS2_MAGIC_BITMASK) ||
+      (je16_to_cpu(summary.nodetype) != JFFS2_NODETYPE_SUMMARY) ||
+      (je32_to_cpu(summary.totlen) != sum_size) ||
+      (jffs2_crc32(0, &summary, sizeof(struct jffs2_unknown_node) - 4) !=
+       je32_to_cpu(summary.hdr_crc)) ||
+      (jffs2_crc32(0, &summary, sizeof(summary) - 8) !=
+       je32_to_cpu(summary.node_crc)))
+  {
+    if (trace_index_summary)
+      jffs2_print("index: summary: bad header @ 0x%08x\n", block + sum_offset);
+    return JFFS2_NO_ERROR;
+  }
+
+  /*
+   * The summary CRC covers the entries, the padding and the marker. The CRC
+   * is raw so it is computed in scratch buffer sized parts.
+   */
+  crc = 0;
+  pos = block + sum_offset + sizeof(summary);
+  while (pos < (block + block_size))
+  {
+    size_t length = (block + block_size) - pos;
+
+    if (length > sizeof(control->cache.scratch))
+      length = sizeof(control->cache.scratch);
+
+    je = jffs2_buffer_read(buffer, control->cache.scratch, length);
+    if (je != JFFS2_NO_ERROR)
+      return je;
+
+    crc = jffs2_crc32(crc, control->cache.scratch, length);
+    pos += length;
+  }
+
+  if (crc != je32_to_cpu(summary.sum_crc))
+  {
+    if (trace_index_summary)
+      jffs2_print("index: summary: bad crc @ 0x%08x\n", block + sum_offset);
+    return JFFS2_NO_ERROR;
+  }
+
+  je = jffs2_index_summary_entries(control, block,
+                                   block + sum_offset + sizeof(summary),
+                                   block + block_size - sizeof(marker),
+                                   je32_to_cpu(summary.sum_num),
+                                   false, &valid);
+  if ((je != JFFS2_NO_ERROR) || !valid)
+    return je;
+
+  je = jffs2_index_summary_entries(control, block,
+                                   block + sum_offset + sizeof(summary),
+                                   block + block_size - sizeof(marker),
+                                   je32_to_cpu(summary.sum_num),
+                                   true, &valid);
+  if (je != JFFS2_NO_ERROR)
+    return je;
+
+  if (trace_index_summary)
+    jffs2_print("index: summary: block 0x%08x: %u entries\n",
+                block, je32_to_cpu(summary.sum_num));
+
+  ++control->index.summary_count;
+  *indexed = true;
+
+  return JFFS2_NO_ERROR;
+}
+
+/*
+ * Scan the whole filesystem once indexing the directory entries and inode
+ * nodes. The first node found in an erase block checks the block for a
+ * summary and a block with a valid summary is not scanned.
+ */
+static jffs2_error
+jffs2_index_scan(jffs2_control* control)
+{
+  jffs2_buffer* buffer = &control->buffer;
+  uint32_t      summary_block = JFFS2_INDEX_NONE;
+
+  jffs2_buffer_reset(buffer);
+
+  while (jffs2_buffer_flash_data_available(buffer))
+  {
+    struct jffs2_unknown_node* node;
+    uint32_t                   offset;
+    uint32_t                   block;
+    uint16_t                   ntype;
+    uint32_t                   len;
+    jffs2_error                je;
+
+    je = jffs2_buffer_find_node(buffer, JFFS2_NODETYPE_ANY);
+    if (je != JFFS2_NO_ERROR)
+    {
+      if (je == JFFS2_FLASH_READ_PAST_END)
+        break;
+      return je;
+    }
+
+    offset = jffs2_buffer_offset(buffer);
+    node = jffs2_buffer_data(buffer);
+    ntype = je16_to_cpu(node->nodetype);
+    len = PAD_4(je32_to_cpu(node->totlen));
 
-    /*
-     * Get a local copy. This avoids any buffering boundary issues at the cost
-     * of a little stack space being used.
-     */
-    je = jffs2_buffer_read(&control->buffer, &inode, sizeof(inode));
+    block = offset & ~(buffer->erase_sector_size - 1);
+    if (block != summary_block)
+    {
+      bool indexed = false;
+
+      summary_block = block;
+
+      je = jffs2_index_summary(control, block, &indexed);
+      if (je != JFFS2_NO_ERROR)
+        return je;
+
+      if (indexed)
+      {
+        jffs2_buffer_set_offset(buffer, block + buffer->erase_sector_size);
+        continue;
+      }
+
+      jffs2_buffer_set_offset(buffer, offset);
+    }
+
+    if (ntype == JFFS2_NODETYPE_DIRENT)
+      je = jffs2_index_scan_dirent(control, offset);
+    else
+      je = jffs2_index_scan_inode(control, offset);
     if (je != JFFS2_NO_ERROR)
       return je;
 
-    len = PAD_4(je32_to_cpu(inode.totlen));
+    jffs2_buffer_set_offset(buffer, offset + len);
+  }
 
-    crc = jffs2_crc32(0, &inode, sizeof(inode) - 8);
+  if (trace_index)
+    jffs2_print("index: dirents=%u/%u inodes=%u/%u nodes=%u/%u\n",
+                control->index.dirent_count, control->index.dirent_slots,
+                control->index.inode_count, control->index.inode_slots,
+                control->index.node_count, control->index.node_slots);
 
-    if (crc == je32_to_cpu(inode.node_crc))
-    {
-      const uint32_t nino = je32_to_cpu(inode.ino);
-      if (nino == ino)
-      {
-        const uint32_t isize = je32_to_cpu(inode.isize);
-        const uint32_t icsize = je32_to_cpu(inode.csize);
-        uint32_t       idsize = je32_to_cpu(inode.dsize);
-        const uint32_t ioffset = je32_to_cpu(inode.offset);
-        const uint32_t doffset = jffs2_buffer_offset(&control->buffer);
-        uint32_t       bsize;
-        uLongf         dsize;
-        int            ze;
-
-        ++inode_count;
-        csize_total += icsize;
-        dsize_total += idsize;
-
-        if (trace_inode_copy_inodes)
-        {
-          jffs2_inode_print("copy_inodes", &inode);
-          if (trace_inode_copy_inodes_dump)
-            jffs2_dump_memory("inode", offset, &inode, sizeof(inode));
-        }
+  return JFFS2_NO_ERROR;
+}
 
-        if (isize_max < isize)
-          isize_max = isize;
+/*
+ * Look up a path part in a directory. The name's CRC selects the entries
+ * and only the names of the entries with a matching CRC are read.
+ */
+static jffs2_error
+jffs2_index_lookup(jffs2_control*       control,
+                   uint32_t             pino,
+                   const char*          part,
+                   jffs2_index_dirent** found)
+{
+  jffs2_index*   index = &control->index;
+  const size_t   len = jffs2_dir_length(part);
+  const uint32_t name_crc = jffs2_crc32(0, part, len);
+  uint32_t       slot;
 
-        /*
-         * The user may have requested only part of a file so only return the
-         * part they requested. If the data is outside the buffer requested
-         * there is no need to process the inode.
-         */
+  *found = NULL;
 
-        if (ioffset < *size)
-        {
-          if ((ioffset + idsize) > *size)
-            idsize = *size - ioffset;
+  slot = jffs2_index_hash(pino, name_crc) % index->dirent_slots;
 
-          dsize = idsize;
+  while (index->dirents[slot].nsize != 0)
+  {
+    jffs2_index_dirent* dirent = &index->dirents[slot];
 
-          switch (inode.compr)
-          {
-            case JFFS2_COMPR_ZLIB:
-            case JFFS2_COMPR_NONE:
-              bsize = inode.compr == JFFS2_COMPR_ZLIB ? icsize : idsize;
-              if (bsize > sizeof(control->cache.scratch))
-              {
-                  jffs2_print("inode: bad inode bsize @ 0x%08x : bsize:%u\n",
-                              offset, bsize);
-                  jffs2_dump_memory("inode", offset, &inode, sizeof(inode));
-                  jffs2_dump_memory("data", doffset, control->cache.scratch, bsize);
-                  return JFFS2_INODE_DATA_TOO_BIG;
-              }
-              je = jffs2_buffer_read(&control->buffer,
-                                     control->cache.scratch,
-                                     bsize);
-              if (je != JFFS2_NO_ERROR)
-                return je;
-              crc = jffs2_crc32(0, control->cache.scratch, bsize);
-              if (crc != je32_to_cpu(inode.data_crc))
-              {
-                if (trace_bad_inode_crc)
-                {
-                  jffs2_print("inode: bad inode data crc @ 0x%08x\n", offset);
-                  jffs2_dump_memory("inode", offset, &inode, sizeof(inode));
-                  jffs2_dump_memory("data", doffset, control->cache.scratch, bsize);
-                  return JFFS2_INVALID_CRC;
-                }
-              }
-              break;
-            case JFFS2_COMPR_ZERO:
-            default:
-              break;
-          }
+    if ((dirent->pino == pino) && (dirent->name_crc == name_crc) &&
+        (dirent->nsize == len))
+    {
+      jffs2_error je;
 
-          switch (inode.compr)
-          {
-            case JFFS2_COMPR_ZLIB:
-              if (idsize > sizeof(control->cache.scratch))
-                return JFFS2_INODE_DATA_TOO_BIG;
-              if (trace_inode_copy_inodes_zlib)
-                jffs2_dump_memory("inode zlib", doffset,
-                                  control->cache.scratch, icsize);
-              ze = uncompress((buffer + ioffset), &dsize,
-                              (uint8_t*) control->cache.scratch, icsize);
-              if (trace_inode_copy_inodes_data)
-                jffs2_dump_memory("inode data", (uintptr_t) (buffer + ioffset),
-                                  buffer + ioffset, dsize);
-              if ((ze != Z_OK) && (ze != Z_BUF_ERROR))
-                return JFFS2_ZLIB_ERROR;
-              if (dsize != idsize)
-                return JFFS2_ZLIB_BAD_SIZE;
-              break;
-            case JFFS2_COMPR_NONE:
-              if (idsize > sizeof(control->cache.scratch))
-                return JFFS2_INODE_DATA_TOO_BIG;
-              memcpy(buffer + ioffset, control->cache.scratch, idsize);
-              break;
-            case JFFS2_COMPR_ZERO:
-              if (idsize > sizeof(control->cache.scratch))
-                return JFFS2_INODE_DATA_TOO_BIG;
-              memset(buffer + ioffset, 0, idsize);
-              break;
-            default:
-              return JFFS2_INVALID_COMPR;
-              break;
-          }
-        }
+      je = jffs2_index_dirent_name(control, dirent, control->cache.scratch);
+      if (je != JFFS2_NO_ERROR)
+        return je;
+
+      if (jffs2_match_name(part, control->cache.scratch))
+      {
+        *found = dirent;
+        break;
       }
     }
-    else
+
+    slot = (slot + 1) % index->dirent_slots;
+  }
+
+  return JFFS2_NO_ERROR;
+}
+
+/*
+ * Find the path's directory entries in the index. The path nodes are set so
+ * the path can be printed.
+ */
+static jffs2_error
+jffs2_index_find_path(jffs2_control*       control,
+                      const char*          path,
+                      jffs2_index_dirent** file)
+{
+  jffs2_index_dirent* dirent = NULL;
+  uint32_t            pino = 1;
+  jffs2_error         je;
+  int                 p;
+
+  *file = NULL;
+
+  jffs2_dir_cache_init(&control->cache.dir);
+
+  je = jffs2_dir_set_path(&control->path, path);
+  if (je != JFFS2_NO_ERROR)
+    return je;
+
+  for (p = 0; p < JFFS2_MAX_PATH_DEPTH; ++p)
+  {
+    jffs2_dir* dir;
+
+    if (control->path.parts[p] == NULL)
+      break;
+
+    je = jffs2_index_lookup(control, pino, control->path.parts[p], &dirent);
+    if (je != JFFS2_NO_ERROR)
+      return je;
+
+    if ((dirent == NULL) || (dirent->ino == 0))
+      return JFFS2_NOT_FOUND;
+
+    dir = &control->cache.dir.nodes[p];
+    dir->offset = dirent->offset;
+    dir->name = control->path.parts[p];
+    dir->ino = dirent->ino;
+    dir->pino = dirent->pino;
+    dir->version = dirent->version;
+    control->path.nodes[p] = dir;
+
+    pino = dirent->ino;
+  }
+
+  if (dirent == NULL)
+    return JFFS2_BAD_PATH_NODES;
+
+  *file = dirent;
+
+  return JFFS2_NO_ERROR;
+}
+
+/*
+ * Copy an inode using its indexed data nodes. The nodes' fragment map is
+ * built from the index and only the live nodes are read. The map has a slot
+ * for each indexed node so it is normally read in one pass.
+ */
+static jffs2_error
+jffs2_index_inode_copy(jffs2_control*     control,
+                       uint32_t           ino,
+                       uint8_t*           buffer,
+                       size_t*            size,
+                       jffs2_data_handler handler,
+                       void*              handler_arg)
+{
+  jffs2_index_inode* inode;
+  jffs2_frag_map     map;
+  jffs2_copy         copy;
+  uint32_t           floor = 0;
+  uint32_t           node;
+  jffs2_error        je;
+
+  if (trace_inode_copy)
+    jffs2_print("index_inode_copy: ino=%u buffer=%p size=%zu\n",
+                ino, buffer, *size);
+
+  jffs2_inode_copy_init(&copy, buffer, *size, handler, handler_arg);
+
+  inode = jffs2_index_find_inode(&control->index, ino);
+
+  do
+  {
+    jffs2_frag_init(&map, control->index.frags, control->index.frag_slots,
+                    floor);
+
+    node = inode != NULL ? inode->first : JFFS2_INDEX_NONE;
+
+    while (node != JFFS2_INDEX_NONE)
     {
-      if (trace_bad_inode_crc)
+      const jffs2_index_node* inode_node = &control->index.nodes[node];
+
+      if (inode_node->dsize != JFFS2_INDEX_NONE)
       {
-        jffs2_print("inode: bad inode crc @ 0x%08x\n", offset);
-        jffs2_dump_memory("inode", offset, &inode, sizeof(inode));
-        return JFFS2_INVALID_CRC;
+        je = jffs2_frag_add(&map, inode_node->offset, inode_node->version,
+                            inode_node->ioffset, inode_node->dsize,
+                            inode_node->isize);
       }
+      else
+      {
+        struct jffs2_raw_inode rinode;
+        bool                   valid = false;
+
+        jffs2_buffer_set_offset(&control->buffer, inode_node->offset);
+
+        je = jffs2_inode_read(control, inode_node->offset, &rinode, &valid);
+        if ((je == JFFS2_NO_ERROR) && valid &&
+            (je32_to_cpu(rinode.ino) == ino))
+          je = jffs2_frag_add(&map, inode_node->offset,
+                              je32_to_cpu(rinode.version),
+                              je32_to_cpu(rinode.offset),
+                              je32_to_cpu(rinode.dsize),
+                              je32_to_cpu(rinode.isize));
+      }
+      if (je != JFFS2_NO_ERROR)
+        return je;
+
+      node = inode_node->next;
     }
 
-    jffs2_buffer_set_offset(&control->buffer, offset + len);
-  }
+    jffs2_frag_sort(&map);
+    jffs2_frag_live(control, &map);
 
-  if (*size > isize_max)
-    *size = isize_max;
+    je = jffs2_frag_copy(control, &map, &copy, ino);
+    if (je != JFFS2_NO_ERROR)
+      return je;
 
-  if (trace_inode_copy_stats)
-    jffs2_print("find_inodes: inodes=%u isize=%u csize=%u compr=%u%%\n",
-                inode_count, isize_max, csize_total,
-                100 - ((csize_total * 100) / dsize_total));
+    floor = map.version + 1;
+  } while (map.full);
 
-  return JFFS2_NO_ERROR;
+  return jffs2_inode_copy_end(&copy, size);
 }
 
-jffs2_error
-jffs2_boot_read(jffs2_control* control,
-                uint32_t       flash_base,
-                uint32_t       flash_size,
-                uint32_t       flash_erase_sector_size,
-                uint8_t*       buffer_cache,
-                bool           cache_crc_blocks,
-                const char*    file,
-                void*          dest,
-                size_t*        size)
+/*
+ * Read a file by scanning the flash for the path and then the inode's
+ * nodes.
+ */
+static jffs2_error
+jffs2_scan_read(jffs2_control*     control,
+                const char*        file,
+                void*              dest,
+                size_t*            size,
+                jffs2_data_handler handler,
+                void*              handler_arg)
 {
   jffs2_dir*  dir;
   uint8_t     dt = 0;
   jffs2_error je;
 
-  if (trace_boot_read)
-    jffs2_print("boot_read: file=%s dest=%p size=%zu flash-size=%u\n",
-                file, dest, *size, flash_size);
-
-  jffs2_control_init(control, flash_base, flash_size, flash_erase_sector_size,
-                     buffer_cache, cache_crc_blocks);
-
   je = jffs2_find_path(control, file);
   if (je != JFFS2_NO_ERROR)
     return je;
@@ -1504,15 +2940,100 @@ jffs2_boot_read(jffs2_control* control,
   if (dt != DT_REG)
     return JFFS2_NOT_A_FILE;
 
-  je = jffs2_inode_copy(control, dir->ino, dest, size);
+  return jffs2_inode_copy(control, dir->ino, dest, size, handler, handler_arg);
+}
+
+jffs2_error
+jffs2_boot_mount(jffs2_control* control,
+                 uint32_t       flash_base,
+                 uint32_t       flash_size,
+                 uint32_t       flash_erase_sector_size,
+                 uint8_t*       buffer_cache,
+                 bool           cache_crc_blocks,
+                 void*          index)
+{
+  jffs2_error je;
+
+  jffs2_control_init(control, flash_base, flash_size, flash_erase_sector_size,
+                     buffer_cache, cache_crc_blocks);
+
+  if (index == NULL)
+    return JFFS2_NO_ERROR;
+
+  jffs2_index_init(&control->index, index, flash_size);
+
+  je = jffs2_index_scan(control);
   if (je != JFFS2_NO_ERROR)
     return je;
 
+  control->index.valid = true;
+
+  return JFFS2_NO_ERROR;
+}
+
+jffs2_error
+jffs2_boot_read_file(jffs2_control*     control,
+                     const char*        file,
+                     void*              dest,
+                     size_t*            size,
+                     jffs2_data_handler handler,
+                     void*              handler_arg)
+{
+  jffs2_index_dirent* dirent;
+  jffs2_error         je;
+
   if (trace_boot_read)
+    jffs2_print("boot_read: file=%s dest=%p size=%zu index=%s\n",
+                file, dest, *size, control->index.valid ? "yes" : "no");
+
+  if (!control->index.valid)
+    je = jffs2_scan_read(control, file, dest, size, handler, handler_arg);
+  else
+  {
+    je = jffs2_index_find_path(control, file, &dirent);
+    if (je != JFFS2_NO_ERROR)
+      return je;
+
+    if (dirent->type != DT_REG)
+      return JFFS2_NOT_A_FILE;
+
+    je = jffs2_index_inode_copy(control, dirent->ino, dest, size,
+                                handler, handler_arg);
+  }
+
+  if ((je == JFFS2_NO_ERROR) && trace_boot_read)
     jffs2_print("boot_read: cache: hit:%u miss:%u\n",
                 control->buffer.cache_hit, control->buffer.cache_miss);
 
-  return JFFS2_NO_ERROR;
+  return je;
+}
+
+jffs2_error
+jffs2_boot_read(jffs2_control* control,
+                uint32_t       flash_base,
+                uint32_t       flash_size,
+                uint32_t       flash_erase_sector_size,
+                uint8_t*       buffer_cache,
+                bool           cache_crc_blocks,
+                jffs2_frag*    frags,
+                uint32_t       frag_slots,
+                const char*    file,
+                void*          dest,
+                size_t*        size,
+                jffs2_data_handler handler,
+                void*          handler_arg)
+{
+  if (trace_boot_read)
+    jffs2_print("boot_read: file=%s dest=%p size=%zu flash-size=%u\n",
+                file, dest, *size, flash_size);
+
+  jffs2_control_init(control, flash_base, flash_size, flash_erase_sector_size,
+                     buffer_cache, cache_crc_blocks);
+
+  control->index.frags = frags;
+  control->index.frag_slots = frag_slots;
+
+  return jffs2_boot_read_file(control, file, dest, size, handler, handler_arg);
 }
 
 void
@@ -22,16 +22,33 @@
 #define _JFFS2_BOOT_H_
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #define JFFS2_MAX_PATH_DEPTH    (32)
 #define JFFS2_CONTROL_BUF_SIZE  (2 * 1024)
-#define JFFS2_DIR_CACHE_SIZE    (2 * 1024)
-#define JFFS2_DIR_CACHE_NODES   (JFFS2_DIR_CACHE_SIZE / sizeof(jffs2_dir))
+#define JFFS2_DIR_CACHE_NODES   (128)
+#define JFFS2_DIR_CACHE_SLOTS   (2 * JFFS2_DIR_CACHE_NODES)
 #define JFFS2_INODE_BUF_SIZE    (4 * 1024)
 #define JFFS2_DIR_MAX_NAME_LEN  (254)
 #define JFFS2_CACHE_PAGE_SIZE   (2048)
 
+/*
+ * The fragment map slots in the control block. A read given no fragment map
+ * memory uses them. A file with more nodes is read in version passes.
+ */
+#if !defined(JFFS2_FRAG_CACHE_SLOTS)
+ #define JFFS2_FRAG_CACHE_SLOTS (64)
+#endif
+
+/*
+ * The most cache pages read ahead when the flash is read sequentially.
+ * Zero reads ahead up to the end of the erase block.
+ */
+#if !defined(JFFS2_CACHE_READAHEAD)
+ #define JFFS2_CACHE_READAHEAD  (0)
+#endif
+
 /*
  * A cache of the flags, crcs and image can be provided. This holds the
  * contents of the flash read into memory so far. If you are reading a number
@@ -46,31 +63,39 @@
                                                 JFFS2_BUFFER_CACHE_BITMAP_SIZE(size) + \
                                                 (crc ? JFFS2_BUFFER_CACHE_CRCMAP_SIZE(size) : 0))
 
-struct jffs2_dir_;
-typedef struct jffs2_dir_ jffs2_dir;
-
-struct jffs2_dir_
+typedef struct
 {
   uint32_t    offset;
   const char* name;
   uint32_t    ino;
   uint32_t    pino;
   uint32_t    version;
-  jffs2_dir*  next;
-};
+} jffs2_dir;
 
+/*
+ * The directory entries found while scanning for a path that wait for their
+ * parent to be found. The found entries are held in open addressed hash
+ * tables of node numbers, one keyed by the inode number and one by the
+ * parent inode number.
+ */
 typedef struct
 {
-  jffs2_dir* found;
-  jffs2_dir* free;
-  jffs2_dir  nodes[JFFS2_DIR_CACHE_NODES];
-  uint32_t   min_free;
+  jffs2_dir nodes[JFFS2_DIR_CACHE_NODES];
+  uint16_t  free[JFFS2_DIR_CACHE_NODES];
+  uint16_t  by_ino[JFFS2_DIR_CACHE_SLOTS];
+  uint16_t  by_pino[JFFS2_DIR_CACHE_SLOTS];
+  uint32_t  free_count;
+  uint32_t  found_count;
+  uint32_t  min_free;
+  bool      dropped;
 } jffs2_dir_cache;
 
 typedef struct
 {
   const char* path;
   const char* parts[JFFS2_MAX_PATH_DEPTH];
+  uint32_t    lengths[JFFS2_MAX_PATH_DEPTH];
+  uint32_t    crcs[JFFS2_MAX_PATH_DEPTH];
   jffs2_dir*  nodes[JFFS2_MAX_PATH_DEPTH];
 } jffs2_path;
 
@@ -83,25 +108,112 @@ typedef struct
   uint32_t  offset;
   uint32_t  out;
   uint32_t  level;
-  uint8_t   buffer[JFFS2_CONTROL_BUF_SIZE];
+  uint8_t   buffer[JFFS2_CONTROL_BUF_SIZE]; /* Not used with a cache */
+  uint32_t  next_address;
   uint32_t* cache_bitmap;
   uint32_t* cache_crcmap;
   uint8_t*  cache;
   uint32_t  cache_hit;
   uint32_t  cache_miss;
+  uint32_t  next_page;
+  uint32_t  ahead;
+  uint32_t  nodes_scanned;
+  uint32_t  flash_reads;
+  uint64_t  flash_bytes;
+  uint32_t  inflate_count;
+  uint64_t  inflate_usecs;
 } jffs2_buffer;
 
+/*
+ * A data node in a file's fragment map. The map is sorted by the page of
+ * the file the data is in and then by version, the highest first.
+ */
+typedef struct
+{
+  uint32_t offset;   /* The inode node, 0xffffffff if it is obsolete */
+  uint32_t version;
+  uint32_t ioffset;
+  uint32_t dsize;
+  uint32_t isize;
+} jffs2_frag;
+
 typedef struct
 {
   jffs2_dir_cache dir;
   char            scratch[JFFS2_INODE_BUF_SIZE];
+  jffs2_frag      frags[JFFS2_FRAG_CACHE_SLOTS]; /* Used if no map memory */
 } jffs2_cache;
 
+/*
+ * The mount index. One scan of the filesystem records the latest directory
+ * entry for each name keyed by the parent inode and the name's CRC, and the
+ * data nodes of each inode in flash order. File reads then go straight to
+ * the nodes they need. The index memory is provided by the caller and this
+ * macro computes the amount needed for a filesystem. If the filesystem has
+ * more entries or nodes than the index holds the reads scan the flash. The
+ * memory also holds the fragment map of the file being read.
+ */
+#define JFFS2_INDEX_DIRENTS(size) (((size) * 1UL) / 2048)
+#define JFFS2_INDEX_INODES(size)  (((size) * 1UL) / 2048)
+#define JFFS2_INDEX_NODES(size)   (((size) * 1UL) / 256)
+#define JFFS2_INDEX_SIZE(size)    ((JFFS2_INDEX_DIRENTS(size) * sizeof(jffs2_index_dirent)) + \
+                                   (JFFS2_INDEX_INODES(size) * sizeof(jffs2_index_inode)) + \
+                                   (JFFS2_INDEX_NODES(size) * sizeof(jffs2_index_node)) + \
+                                   (JFFS2_INDEX_NODES(size) * sizeof(jffs2_frag)))
+
+typedef struct
+{
+  uint32_t pino;
+  uint32_t name_crc;
+  uint32_t ino;      /* Zero if the name is unlinked */
+  uint32_t version;
+  uint32_t offset;   /* The directory entry node */
+  uint8_t  nsize;    /* Zero if the slot is free */
+  uint8_t  type;
+  uint16_t unused;
+} jffs2_index_dirent;
+
+typedef struct
+{
+  uint32_t ino;      /* Zero if the slot is free */
+  uint32_t first;
+  uint32_t last;
+  uint32_t count;
+} jffs2_index_inode;
+
+typedef struct
+{
+  uint32_t offset;
+  uint32_t next;
+  uint32_t version;
+  uint32_t ioffset;
+  uint32_t isize;
+  uint32_t dsize;    /* 0xffffffff if only the summary has been read */
+} jffs2_index_node;
+
+typedef struct
+{
+  bool                valid;
+  jffs2_index_dirent* dirents;
+  jffs2_index_inode*  inodes;
+  jffs2_index_node*   nodes;
+  jffs2_frag*         frags;
+  uint32_t            dirent_slots;
+  uint32_t            inode_slots;
+  uint32_t            node_slots;
+  uint32_t            frag_slots;
+  uint32_t            dirent_count;
+  uint32_t            inode_count;
+  uint32_t            node_count;
+  uint32_t            summary_count; /* Blocks indexed from their summary. */
+} jffs2_index;
+
 typedef struct
 {
   jffs2_path   path;
   jffs2_cache  cache;
   jffs2_buffer buffer;
+  jffs2_index  index;
 } jffs2_control;
 
 typedef enum
@@ -122,18 +234,63 @@ typedef enum
   JFFS2_ZLIB_BAD_SIZE,
   JFFS2_FILL_TOO_BIG,
   JFFS2_FLASH_READ_ERROR,
-  JFFS2_FLASH_READ_PAST_END
+  JFFS2_FLASH_READ_PAST_END,
+  JFFS2_DATA_HANDLER_ABORT,
+  JFFS2_INDEX_FULL
 } jffs2_error;
 
+/*
+ * A data handler is passed the file's data in file order as it is copied to
+ * the destination. Data found out of order is passed once the read has
+ * finished. If data already passed is rewritten by a later node the whole
+ * file is passed again from offset 0. A non-zero return aborts the read.
+ */
+typedef int (*jffs2_data_handler)(void*          arg,
+                                  size_t         offset,
+                                  const uint8_t* data,
+                                  size_t         size);
+
+/*
+ * Read a file by scanning the flash. The fragment map memory holds the
+ * file's data nodes. A NULL map uses the control block's slots.
+ */
 jffs2_error jffs2_boot_read(jffs2_control* control,
                             uint32_t       flash_base,
                             uint32_t       flash_size,
                             uint32_t       flash_erase_sector_size,
                             uint8_t*       buffer_cache,
                             bool           cache_crc_blocks,
+                            jffs2_frag*    frags,
+                            uint32_t       frag_slots,
                             const char*    file,
                             void*          dest,
-                            size_t*        size);
+                            size_t*        size,
+                            jffs2_data_handler handler,
+                            void*          handler_arg);
+
+/*
+ * Mount the filesystem and scan it once to build the index. The control
+ * block is kept for the reads. A NULL index reads by scanning the flash.
+ * JFFS2_INDEX_FULL is returned if the index is too small, the filesystem is
+ * mounted and reads scan the flash.
+ */
+jffs2_error jffs2_boot_mount(jffs2_control* control,
+                             uint32_t       flash_base,
+                             uint32_t       flash_size,
+                             uint32_t       flash_erase_sector_size,
+                             uint8_t*       buffer_cache,
+                             bool           cache_crc_blocks,
+                             void*          index);
+
+/*
+ * Read a file from a mounted filesystem.
+ */
+jffs2_error jffs2_boot_read_file(jffs2_control*     control,
+                                 const char*        file,
+                                 void*              dest,
+                                 size_t*            size,
+                                 jffs2_data_handler handler,
+                                 void*              handler_arg);
 
 void jffs2_print_path(jffs2_control* control);
 
@@ -18,6 +18,7 @@
  * Some brain dead versions of libc functions we need.
  */
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
 
@@ -30,31 +31,135 @@ strlen(const char *s)
   return c;
 }
 
-void*
-memcpy(void *dst, const void *src, size_t len)
+#if !SIZE_OVER_SPEED
+#if defined(__aarch64__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define LIBC_NEON 1
+#else
+#define LIBC_NEON 0
+#endif
+
+/*
+ * Large moves are done in 64 byte blocks of 16 byte vector registers, LDP
+ * and STP of Q registers on aarch64 and VLD1 and VST1 on the A9. The
+ * destination is aligned and the source may not be. Unaligned loads and
+ * DC ZVA fault on device memory so the block paths are only used when the
+ * MMU and data cache are on. The Zynq7000 MMU table is cleared before the
+ * MMU is enabled and uses the word path.
+ */
+#define LIBC_BLOCK     (64)
+#define LIBC_ALIGN     (16)
+#define LIBC_MIN_BLOCK (2 * LIBC_BLOCK)
+
+#define UNALIGNED(X, Y) \
+  (((uintptr_t)X & (sizeof (uintptr_t) - 1)) | ((uintptr_t)Y & (sizeof (uintptr_t) - 1)))
+#define BIGBLOCKSIZE    (sizeof (uint32_t) << 2)
+#define LITTLEBLOCKSIZE (sizeof (uint32_t))
+#define TOO_SMALL(LEN)  ((LEN) < BIGBLOCKSIZE)
+
+typedef uintptr_t __attribute__((__may_alias__)) libc_word;
+typedef uintptr_t __attribute__((__may_alias__, __aligned__(1))) libc_uword;
+
+static inline bool
+libc_normal_memory(void)
 {
-#if SIZE_OVER_SPEED
-  volatile uint8_t* ud = dst;
-  volatile const uint8_t* us = src;
-  while (len--)
-    *ud++ = *us++;
-  return dst;
+#if defined(__aarch64__)
+  uint64_t el;
+  uint64_t sctlr;
+  __asm__ volatile ("mrs %0, CurrentEL" : "=r" (el));
+  switch ((el >> 2) & 3)
+  {
+    case 3:
+      __asm__ volatile ("mrs %0, sctlr_el3" : "=r" (sctlr));
+      break;
+    case 2:
+      __asm__ volatile ("mrs %0, sctlr_el2" : "=r" (sctlr));
+      break;
+    default:
+      __asm__ volatile ("mrs %0, sctlr_el1" : "=r" (sctlr));
+      break;
+  }
+  /* M and C */
+  return (sctlr & 0x5) == 0x5;
+#elif defined(__arm__)
+  uint32_t sctlr;
+  __asm__ volatile ("mrc p15, 0, %0, c1, c0, 0" : "=r" (sctlr));
+  /* M and C */
+  return (sctlr & 0x5) == 0x5;
 #else
-  #define UNALIGNED(X, Y) \
-    (((uintptr_t)X & (sizeof (uintptr_t) - 1)) | ((uintptr_t)Y & (sizeof (uintptr_t) - 1)))
-  #define BIGBLOCKSIZE    (sizeof (uint32_t) << 2)
-  #define LITTLEBLOCKSIZE (sizeof (uint32_t))
-  #define TOO_SMALL(LEN)  ((LEN) < BIGBLOCKSIZE)
+  return true;
+#endif
+}
 
-  volatile uint8_t* ud = dst;
-  volatile const uint8_t* us = src;
-  volatile uint32_t* ad;
-  volatile const uint32_t* as;
+#if defined(__aarch64__)
+/*
+ * DC ZVA zeros a block of DCZID_EL0 bytes without reading it. Returns 0
+ * if it is prohibited.
+ */
+static inline size_t
+libc_zva_size(void)
+{
+  uint64_t dczid;
+  __asm__ volatile ("mrs %0, dczid_el0" : "=r" (dczid));
+  if ((dczid & (1 << 4)) != 0)
+    return 0;
+  return 4UL << (dczid & 0xf);
+}
+#endif
+
+static inline void
+libc_block_copy(uint8_t* d, const uint8_t* s)
+{
+#if LIBC_NEON
+  uint8x16_t b0 = vld1q_u8(s);
+  uint8x16_t b1 = vld1q_u8(s + 16);
+  uint8x16_t b2 = vld1q_u8(s + 32);
+  uint8x16_t b3 = vld1q_u8(s + 48);
+  vst1q_u8(d, b0);
+  vst1q_u8(d + 16, b1);
+  vst1q_u8(d + 32, b2);
+  vst1q_u8(d + 48, b3);
+#else
+  const libc_uword* ws = (const libc_uword*) s;
+  libc_word* wd = (libc_word*) d;
+  libc_word t[LIBC_BLOCK / sizeof(libc_word)];
+  size_t w;
+  for (w = 0; w < (LIBC_BLOCK / sizeof(libc_word)); ++w)
+    t[w] = ws[w];
+  for (w = 0; w < (LIBC_BLOCK / sizeof(libc_word)); ++w)
+    wd[w] = t[w];
+#endif
+}
 
-  if (!TOO_SMALL(len) && !UNALIGNED (us, ud))
+static void
+libc_copy_forward(uint8_t* ud, const uint8_t* us, size_t len)
+{
+  if (len >= LIBC_MIN_BLOCK && libc_normal_memory())
+  {
+    while (((uintptr_t) ud & (LIBC_ALIGN - 1)) != 0)
+    {
+      *ud++ = *us++;
+      --len;
+    }
+    while (len >= LIBC_BLOCK)
+    {
+      libc_block_copy(ud, us);
+      ud += LIBC_BLOCK;
+      us += LIBC_BLOCK;
+      len -= LIBC_BLOCK;
+    }
+    while (len >= sizeof(libc_word))
+    {
+      *((libc_word*) ud) = *((const libc_uword*) us);
+      ud += sizeof(libc_word);
+      us += sizeof(libc_word);
+      len -= sizeof(libc_word);
+    }
+  }
+  else if (!TOO_SMALL(len) && !UNALIGNED (us, ud))
   {
-    ad = (uint32_t*) ud;
-    as = (uint32_t*) us;
+    volatile uint32_t* ad = (uint32_t*) ud;
+    volatile const uint32_t* as = (const uint32_t*) us;
 
     while (len >= BIGBLOCKSIZE)
     {
@@ -72,12 +177,61 @@ memcpy(void *dst, const void *src, size_t len)
     }
 
     ud = (uint8_t*) ad;
-    us = (uint8_t*) as;
+    us = (const uint8_t*) as;
+  }
+
+  {
+    volatile uint8_t* vd = ud;
+    volatile const uint8_t* vs = us;
+    while (len--)
+      *vd++ = *vs++;
+  }
+}
+
+/*
+ * Copy down from the end. Each block is loaded before it is stored so an
+ * overlap with the destination above the source is safe.
+ */
+static void
+libc_copy_backward(uint8_t* ud, const uint8_t* us, size_t len)
+{
+  ud += len;
+  us += len;
+  if (len >= LIBC_MIN_BLOCK && libc_normal_memory())
+  {
+    while (((uintptr_t) ud & (LIBC_ALIGN - 1)) != 0)
+    {
+      *--ud = *--us;
+      --len;
+    }
+    while (len >= LIBC_BLOCK)
+    {
+      ud -= LIBC_BLOCK;
+      us -= LIBC_BLOCK;
+      len -= LIBC_BLOCK;
+      libc_block_copy(ud, us);
+    }
+  }
+  {
+    volatile uint8_t* vd = ud;
+    volatile const uint8_t* vs = us;
+    while (len--)
+      *--vd = *--vs;
   }
+}
+#endif
 
+void*
+memcpy(void *dst, const void *src, size_t len)
+{
+#if SIZE_OVER_SPEED
+  volatile uint8_t* ud = dst;
+  volatile const uint8_t* us = src;
   while (len--)
     *ud++ = *us++;
-
+  return dst;
+#else
+  libc_copy_forward(dst, src, len);
   return dst;
 #endif
 }
@@ -85,6 +239,7 @@ memcpy(void *dst, const void *src, size_t len)
 void*
 memmove(void *dst, const void *src, size_t len)
 {
+#if SIZE_OVER_SPEED
   volatile uint8_t* ud = dst;
   volatile const uint8_t* us = src;
   if ((us < ud) && (ud < (us + len)))
@@ -100,15 +255,83 @@ memmove(void *dst, const void *src, size_t len)
       *ud++ = *us++;
   }
   return dst;
+#else
+  const uint8_t* us = src;
+  uint8_t* ud = dst;
+  if ((us < ud) && (ud < (us + len)))
+    libc_copy_backward(ud, us, len);
+  else
+    libc_copy_forward(ud, us, len);
+  return dst;
+#endif
 }
 
 void*
 memset(void *dst, int c, size_t len)
 {
+#if SIZE_OVER_SPEED
   volatile uint8_t* ud = dst;
   while (len--)
     *ud++ = c;
   return dst;
+#else
+  uint8_t* ud = dst;
+  if (len >= LIBC_MIN_BLOCK && libc_normal_memory())
+  {
+#if LIBC_NEON
+    uint8x16_t v = vdupq_n_u8((uint8_t) c);
+#else
+    libc_word v = ((uint8_t) c) * (~((libc_word) 0) / 0xff);
+    size_t w;
+#endif
+    while (((uintptr_t) ud & (LIBC_ALIGN - 1)) != 0)
+    {
+      *ud++ = c;
+      --len;
+    }
+#if defined(__aarch64__)
+    if ((uint8_t) c == 0)
+    {
+      size_t zva = libc_zva_size();
+      if (zva >= LIBC_ALIGN && len >= (2 * zva))
+      {
+        while (((uintptr_t) ud & (zva - 1)) != 0)
+        {
+          vst1q_u8(ud, v);
+          ud += LIBC_ALIGN;
+          len -= LIBC_ALIGN;
+        }
+        while (len >= zva)
+        {
+          __asm__ volatile ("dc zva, %0" : : "r" (ud) : "memory");
+          ud += zva;
+          len -= zva;
+        }
+      }
+    }
+#endif
+    while (len >= LIBC_BLOCK)
+    {
+#if LIBC_NEON
+      vst1q_u8(ud, v);
+      vst1q_u8(ud + 16, v);
+      vst1q_u8(ud + 32, v);
+      vst1q_u8(ud + 48, v);
+#else
+      for (w = 0; w < (LIBC_BLOCK / sizeof(libc_word)); ++w)
+        ((libc_word*) ud)[w] = v;
+#endif
+      ud += LIBC_BLOCK;
+      len -= LIBC_BLOCK;
+    }
+  }
+  {
+    volatile uint8_t* vd = ud;
+    while (len--)
+      *vd++ = c;
+  }
+  return dst;
+#endif
 }
 
 int
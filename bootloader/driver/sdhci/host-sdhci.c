@@ -0,0 +1,133 @@
+/*
+ * Copyright 2026 Contemporary Software
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+/*
+ * Host SDHCI. The card is an image file mapped into memory.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <board.h>
+
+#include "sdhci.h"
+
+#define HOST_SDHCI_CTLRS (2)
+
+typedef struct {
+    const uint8_t* image;
+    size_t         size;
+    bool           initialised;
+    uint32_t       reads;
+    uint64_t       bytes;
+} host_sdhci;
+
+static host_sdhci cards[HOST_SDHCI_CTLRS];
+
+int host_sdhci_attach(int controller, const char* path) {
+    struct stat sb;
+    void*       data;
+    int         fd;
+
+    if (controller < 0 || controller >= HOST_SDHCI_CTLRS) {
+        return EINVAL;
+    }
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return errno;
+    }
+    if (fstat(fd, &sb) < 0) {
+        int err = errno;
+        close(fd);
+        return err;
+    }
+    if (sb.st_size < SDHCI_BLK_SIZE) {
+        close(fd);
+        return EINVAL;
+    }
+    data = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return errno;
+    }
+    cards[controller].image = data;
+    cards[controller].size = sb.st_size;
+    return 0;
+}
+
+sdhci_error sdhci_open(int controller) {
+    if (controller < 0 || controller >= HOST_SDHCI_CTLRS ||
+        cards[controller].image == NULL) {
+        return SDHCI_CARD_NOT_PRESENT;
+    }
+    cards[controller].initialised = true;
+    return SDHCI_NO_ERROR;
+}
+
+sdhci_error sdhci_close(int controller) {
+    if (controller >= 0 && controller < HOST_SDHCI_CTLRS) {
+        cards[controller].initialised = false;
+    }
+    return SDHCI_NO_ERROR;
+}
+
+bool sdhci_initialised(int controller) {
+    if (controller < 0 || controller >= HOST_SDHCI_CTLRS) {
+        return false;
+    }
+    return cards[controller].initialised;
+}
+
+sdhci_error sdhci_read(int controller, uint32_t sector, uint32_t count,
+    char* buffer) {
+    size_t offset = ((size_t) sector) * SDHCI_BLK_SIZE;
+    size_t length = ((size_t) count) * SDHCI_BLK_SIZE;
+    host_sdhci* card;
+
+    if (!sdhci_initialised(controller)) {
+        return SDHCI_CARD_NOT_PRESENT;
+    }
+    card = &cards[controller];
+    if (offset > card->size || length > (card->size - offset)) {
+        return SDHCI_TRANSFER_FAILED;
+    }
+    memcpy(buffer, card->image + offset, length);
+    ++card->reads;
+    card->bytes += length;
+    return SDHCI_NO_ERROR;
+}
+
+void host_sdhci_stats(int controller, uint32_t* reads, uint64_t* bytes,
+    bool reset) {
+    host_sdhci* card;
+
+    if (controller < 0 || controller >= HOST_SDHCI_CTLRS) {
+        *reads = 0;
+        *bytes = 0;
+        return;
+    }
+    card = &cards[controller];
+    *reads = card->reads;
+    *bytes = card->bytes;
+    if (reset) {
+        card->reads = 0;
+        card->bytes = 0;
+    }
+}
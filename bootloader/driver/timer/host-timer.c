@@ -0,0 +1,45 @@
+/*
+ * Copyright 2026 Contemporary Software
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+/*
+ * Host Timer.
+ */
+
+#include <time.h>
+
+#include "board-timer.h"
+
+static uint64_t base;
+
+static uint64_t
+host_timer_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (((uint64_t) ts.tv_sec) * 1000000ULL) + (ts.tv_nsec / 1000);
+}
+
+void
+board_timer_get(uint64_t* time)
+{
+  *time = host_timer_now() - base;
+}
+
+void
+board_timer_reset(void)
+{
+  base = host_timer_now();
+}
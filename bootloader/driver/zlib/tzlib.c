@@ -78,4 +78,69 @@ uncompress (Bytef*       dest,
     return tinfl_result(status);
 }
 
+/*
+ * The decompressor state is large so the single incremental stream is held
+ * statically rather than on the stack.
+ */
+static struct
+{
+    tinfl_decompressor decomp;
+    tinfl_status       status;
+    mz_uint8*          dest;
+    size_t             size;
+    size_t             out;
+} inflate_stream;
+
+int
+raw_inflate_begin (Bytef* dest, uLongf destLen)
+{
+    tinfl_init(&inflate_stream.decomp);
+    inflate_stream.status = TINFL_STATUS_NEEDS_MORE_INPUT;
+    inflate_stream.dest = (mz_uint8*) dest;
+    inflate_stream.size = (size_t) destLen;
+    inflate_stream.out = 0;
+    return Z_OK;
+}
+
+int
+raw_inflate (const Bytef* source, uLongf sourceLen)
+{
+    /*
+     * The output is the complete destination so there is no need to wrap;
+     * tinfl references back into the bytes already written.
+     */
+    while ((sourceLen > 0) &&
+           (inflate_stream.status == TINFL_STATUS_NEEDS_MORE_INPUT))
+    {
+        size_t inLen = (size_t) sourceLen;
+        size_t outLen = inflate_stream.size - inflate_stream.out;
+        inflate_stream.status =
+            tinfl_decompress(&inflate_stream.decomp,
+                             (const mz_uint8*) source,
+                             &inLen,
+                             inflate_stream.dest,
+                             inflate_stream.dest + inflate_stream.out,
+                             &outLen,
+                             TINFL_FLAG_HAS_MORE_INPUT | \
+                             TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF);
+        inflate_stream.out += outLen;
+        if (inLen == 0)
+            break;
+        source += inLen;
+        sourceLen -= inLen;
+    }
+    if (inflate_stream.status == TINFL_STATUS_NEEDS_MORE_INPUT)
+        return Z_OK;
+    if (inflate_stream.status == TINFL_STATUS_DONE)
+        return Z_STREAM_END;
+    return tinfl_result(inflate_stream.status);
+}
+
+int
+raw_inflate_end (uLongf* destLen)
+{
+    *destLen = inflate_stream.out;
+    return tinfl_result(inflate_stream.status);
+}
+
 #endif
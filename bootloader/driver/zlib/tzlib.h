@@ -36,5 +36,21 @@ int uncompress (Bytef*       dest,
                 uLongf*      destLen,
                 const Bytef* source,
                 uLongf       sourceLen);
+
+/*
+ * Incremental raw inflate. The destination holds the whole decompressed
+ * stream and the source can be passed in pieces of any size as it
+ * arrives. Only one stream can be active at a time.
+ *
+ * raw_inflate() returns Z_OK if more input is needed, Z_STREAM_END when the
+ * end of the stream has been decompressed, or an error. Input after the
+ * end of the stream is ignored. raw_inflate_end() returns the size of the
+ * decompressed data and Z_OK if the stream is complete.
+ */
+int raw_inflate_begin (Bytef* dest, uLongf destLen);
+
+int raw_inflate (const Bytef* source, uLongf sourceLen);
+
+int raw_inflate_end (uLongf* destLen);
 #endif
 #endif
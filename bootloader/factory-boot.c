@@ -79,6 +79,8 @@ platform_factory_booter(uint8_t* header, size_t header_size)
     uint32_t        flash_offset;
     uint32_t        entry_point;
     size_t          size;
+    size_t          offset;
+    size_t          read_max = flash_device_read_max();
     flash_error     fe;
     CRC32           crc;
     int             i;
@@ -104,15 +106,27 @@ platform_factory_booter(uint8_t* header, size_t header_size)
         return;
     }
 
-    fe = flash_read(flash_offset, (uint8_t*)FLARE_IMAGE_STAGE_ADDR, size);
-    if (fe != FLASH_NO_ERROR)
+    /*
+     * Read the image in pieces of the largest single flash read and update
+     * the CRC after each piece while its data is in the cache.
+     */
+    crc32_clear(&crc);
+
+    for (offset = 0; offset < size; offset += read_max)
     {
-        printf("error: load factory image: %d\n", fe);
-        return;
+        uint8_t* data = (uint8_t*)FLARE_IMAGE_STAGE_ADDR + offset;
+        size_t   length = size - offset;
+        if (length > read_max)
+            length = read_max;
+        fe = flash_read(flash_offset + offset, data, length);
+        if (fe != FLASH_NO_ERROR)
+        {
+            printf("error: load factory image: %d\n", fe);
+            return;
+        }
+        crc32_update(&crc, data, length);
     }
 
-    crc32_clear(&crc);
-    crc32_update(&crc, (const void*)FLARE_IMAGE_STAGE_ADDR, size);
     crc32_str(&crc, checksum);
 
     printf("         CRC32: ");
@@ -23,11 +23,25 @@
 
 #include <stdbool.h>
 
+#include <board.h>
+
 #include <fs/boot-filesystem.h>
+#include <fs/jffs2-filesystem.h>
 
+/*
+ * The DDR memory map, in physical addresses. The datasafe is at the bottom
+ * of the DDR. The JFFS2 region holds the flash page cache and the mount
+ * index and ends where the stage area starts. Executables are read into the
+ * stage area, the highest region, so the loader needs the DDR up to its end.
+ * An executable is not loaded over the JFFS2 region.
+ */
 #define FLARE_EXECUTABLE_SIZE (128UL * 1024UL * 1024UL)
 
-#define FLARE_IMAGE_STAGE_ADDR 0x30000000
+#define FLARE_IMAGE_STAGE_ADDRESS (0x30000000UL)
+#define FLARE_IMAGE_STAGE_ADDR    BOARD_MEMORY(FLARE_IMAGE_STAGE_ADDRESS)
+
+#define FLARE_JFFS2_REGION_ADDRESS FLARE_JFFS2_CACHE_ADDRESS
+#define FLARE_JFFS2_REGION_SIZE    (FLARE_IMAGE_STAGE_ADDRESS - FLARE_JFFS2_REGION_ADDRESS)
 
 #define FLARE_STAGE_FUNC_MAX 4
 
@@ -34,16 +34,35 @@ int flare_filesystem_mount(flare_fs fs) {
     return 0;
 }
 
-int flare_read_file(
-    flare_fs fs, const char* name, void* const buffer, uint32_t* size) {
+int flare_read_file(flare_fs fs, const char* name, void* const buffer,
+    uint32_t* size, flare_file_sink* sink) {
     if (fs == FILESYSTEM_QSPI_JFFS2) {
-        return jffs2_read_file(name, buffer, size);
+        return jffs2_read_file(name, buffer, size, sink);
     } else if (fs == FILESYSTEM_SD_FATFS || fs == FILESYSTEM_EMMC_FATFS) {
-        return fatfs_read_file(name, buffer, size);
+        return fatfs_read_file(name, buffer, size, sink);
     }
     return 0;
 }
 
+int flare_file_sink_data(
+    flare_file_sink* sink, size_t offset, const uint8_t* data, size_t size) {
+    if (sink == NULL || size == 0) {
+        return 0;
+    }
+    if (sink->crc != NULL) {
+        boot_profile_resume(sink->crc_phase);
+        if (offset == 0) {
+            crc32_clear(sink->crc);
+        }
+        crc32_update(sink->crc, data, size);
+        boot_profile_pause(sink->crc_phase);
+    }
+    if (sink->handler == NULL) {
+        return 0;
+    }
+    return sink->handler(sink, offset, data, size);
+}
+
 int flare_chdir(flare_fs fs, const char* path) {
     if (fs == FILESYSTEM_QSPI_JFFS2) {
         return jffs2_chdir(path);
@@ -25,22 +25,55 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <boot-profile.h>
+
+#include <driver/crc/crc.h>
+
 typedef enum {
     FILESYSTEM_QSPI_JFFS2,
     FILESYSTEM_SD_FATFS,
     FILESYSTEM_EMMC_FATFS,
 } flare_fs;
 
+/*
+ * File data sink. A filesystem hands the file's data to the sink in file
+ * order as it is read into the buffer so the data can be processed while
+ * the rest of the file is being read. If a filesystem finds data it has
+ * handed over is stale it hands the whole file over again from offset
+ * 0. A non-zero return from the handler aborts the read.
+ *
+ * The handler and the CRC are optional. The CRC is a running digest of the
+ * data passed to the sink and is updated before the handler is called. The
+ * CRC time is recorded in the profile phase, -1 for no phase.
+ */
+struct flare_file_sink_;
+typedef struct flare_file_sink_ flare_file_sink;
+
+typedef int (*flare_file_sink_handler)(
+    flare_file_sink* sink, size_t offset, const uint8_t* data, size_t size);
+
+struct flare_file_sink_ {
+    flare_file_sink_handler handler;
+    CRC32*                  crc;
+    boot_profile_id         crc_phase;
+};
+
 /*
  * Mount the file system.
  */
 int flare_filesystem_mount(flare_fs fs);
 
 /*
- * Read the file.
+ * Read the file. The sink is optional.
+ */
+int flare_read_file(flare_fs fs, const char* name, void* const buffer,
+    uint32_t* size, flare_file_sink* sink);
+
+/*
+ * Pass file data to a sink. Used by the filesystems.
  */
-int flare_read_file(
-    flare_fs fs, const char* name, void* const buffer, uint32_t* size);
+int flare_file_sink_data(
+    flare_file_sink* sink, size_t offset, const uint8_t* data, size_t size);
 
 /*
  * Change directory.
@@ -23,6 +23,14 @@
 
 #include <driver/fatfs/ff.h>
 
+#include <fs/fatfs-filesystem.h>
+
+/*
+ * Read files in pieces of this size when there is a sink so the sink can
+ * process the data while it is still in the cache.
+ */
+#define FATFS_SINK_READ_SIZE (128 * 1024)
+
 FATFS fs;
 
 int fatfs_filesystem_mount() {
@@ -34,19 +42,47 @@ int fatfs_filesystem_mount() {
     return 0;
 }
 
-int fatfs_read_file(const char* name, void* const buffer, uint32_t* size) {
+int fatfs_read_file(const char* name, void* const buffer, uint32_t* size,
+    flare_file_sink* sink) {
     FIL file;
     FRESULT fr;
+    uint8_t* data = buffer;
     uint32_t len = *size;
+    uint32_t offset = 0;
+    int rc;
 
     fr = f_open(&file, name, FA_READ);
     if (fr != FR_OK) {
         return fr;
     }
 
-    fr = f_read(&file, buffer, len, size);
-    if (fr != FR_OK) {
-        return fr;
+    if (sink == NULL) {
+        fr = f_read(&file, buffer, len, size);
+        if (fr != FR_OK) {
+            return fr;
+        }
+    } else {
+        while (offset < len) {
+            UINT request = len - offset;
+            UINT br = 0;
+            if (request > FATFS_SINK_READ_SIZE) {
+                request = FATFS_SINK_READ_SIZE;
+            }
+            fr = f_read(&file, data + offset, request, &br);
+            if (fr != FR_OK) {
+                return fr;
+            }
+            rc = flare_file_sink_data(sink, offset, data + offset, br);
+            if (rc != 0) {
+                f_close(&file);
+                return rc;
+            }
+            offset += br;
+            if (br < request) {
+                break;
+            }
+        }
+        *size = offset;
     }
 
     f_close(&file);
@@ -25,6 +25,8 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <fs/boot-filesystem.h>
+
 /*
  * Mount the file system.
  */
@@ -33,7 +35,8 @@ int fatfs_filesystem_mount();
 /*
  * Read the file.
  */
-int fatfs_read_file(const char* name, void* const buffer, uint32_t* size);
+int fatfs_read_file(const char* name, void* const buffer, uint32_t* size,
+    flare_file_sink* sink);
 
 /*
  * Change directory.
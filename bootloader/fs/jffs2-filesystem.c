@@ -22,23 +22,16 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <board.h>
 #include <datasafe.h>
+#include <flare-boot.h>
 #include <flash-map.h>
 #include <fs/boot-filesystem.h>
+#include <fs/jffs2-filesystem.h>
 
 #include <driver/flash/flash.h>
 #include <driver/jffs2/jffs2-boot.h>
 
-/*
- * Cache header.
- */
-#define FLARE_JFFS2_CACHE_HEADER_MARKER_1 (0)
-#define FLARE_JFFS2_CACHE_HEADER_VERSION  (1)
-#define FLARE_JFFS2_CACHE_HEADER_FLAGS    (2)
-#define FLARE_JFFS2_CACHE_HEADER_MARKER_2 (3)
-#define FLARE_JFFS2_CACHE_HEADER_CACHE    (4)
-#define FLARE_JFFS2_CACHE_HEADER_SIZE     (4 * sizeof(uint32_t))
-
 /*
  * Cache Marker.
  */
@@ -47,26 +40,70 @@
 /*
  * Cache Flags.
  */
-#define FLARE_JFFS2_CACHE_FLAGS_MASK 0x00000001  /* unused bits must be clear */
-#define FLARE_JFFS2_CACHE_FLAGS_CRC  (1 << 0)
+#define FLARE_JFFS2_CACHE_FLAGS_MASK    0x00000003  /* unused bits must be clear */
+#define FLARE_JFFS2_CACHE_FLAGS_CRC     (1 << 0)
+#define FLARE_JFFS2_CACHE_FLAGS_PERSIST (1 << 1)
 
 /*
  * The location of the cache. The bitmap section of the cache must be cleared
  * only once.
  */
-#define FLARE_JFFS2_CACHE_VERSION (2)
+#define FLARE_JFFS2_CACHE_VERSION (3)
 #define FLARE_JFFS2_USE_CACHE_CRC false
-#define FLARE_JFFS2_CACHE_BASE    ((uint8_t*) (320UL * 1024UL * 1024UL))
+#define FLARE_JFFS2_CACHE_BASE    ((uint8_t*) BOARD_MEMORY(FLARE_JFFS2_CACHE_ADDRESS))
 #define FLARE_JFFS2_CACHE_SIZE    (FLARE_JFFS2_CACHE_HEADER_SIZE + \
                                    JFFS2_BUFFER_CACHE_SIZE(FLARE_FLASH_FILESYSTEM_SIZE, \
                                                            FLARE_JFFS2_USE_CACHE_CRC))
 
+/*
+ * The mount index follows the cache. It is built by each mount. The cache
+ * and the index must fit in the JFFS2 region of the memory map.
+ */
+#define FLARE_JFFS2_INDEX_OFFSET  ((FLARE_JFFS2_CACHE_SIZE + 63) & ~63UL)
+#define FLARE_JFFS2_INDEX_BASE    (FLARE_JFFS2_CACHE_BASE + FLARE_JFFS2_INDEX_OFFSET)
+#define FLARE_JFFS2_INDEX_END     (FLARE_JFFS2_INDEX_OFFSET + \
+                                   JFFS2_INDEX_SIZE(FLARE_FLASH_FILESYSTEM_SIZE))
+
+_Static_assert((FLARE_DS_ADDRESS + sizeof(flare_datasafe)) <= FLARE_JFFS2_REGION_ADDRESS,
+               "the datasafe overlaps the JFFS2 region");
+_Static_assert(FLARE_JFFS2_REGION_ADDRESS < FLARE_IMAGE_STAGE_ADDRESS,
+               "the JFFS2 region overlaps the stage area");
+
+/*
+ * Keep a valid cache across a software or watchdog reset.
+ */
+#if !defined(FLARE_JFFS2_CACHE_PERSIST)
+#define FLARE_JFFS2_CACHE_PERSIST true
+#endif
+
 static jffs2_control jffs2;
+static bool          jffs2_mounted;
 static char          cwd[128];
 static char          scratch[256];
 
+/*
+ * A read without a mount uses the index memory for the file's fragment map.
+ * It is bounded by the JFFS2 region and the control block's slots are used
+ * if there is no room.
+ */
+static uint32_t
+flare_jffs2_frag_slots(void)
+{
+    uint32_t slots = JFFS2_INDEX_NODES(FLARE_FLASH_FILESYSTEM_SIZE);
+    uint32_t room;
+
+    if (FLARE_JFFS2_INDEX_OFFSET >= FLARE_JFFS2_REGION_SIZE)
+        return 0;
+
+    room = (FLARE_JFFS2_REGION_SIZE - FLARE_JFFS2_INDEX_OFFSET) / sizeof(jffs2_frag);
+    if (slots > room)
+        slots = room;
+
+    return slots;
+}
+
 static void
-flare_Jffs2Cache_Setup(void)
+flare_Jffs2Cache_Setup(uint32_t stamp, uint32_t sequence)
 {
     uint32_t* cache = (uint32_t*) FLARE_JFFS2_CACHE_BASE;
     memset(FLARE_JFFS2_CACHE_BASE, 0, FLARE_JFFS2_CACHE_SIZE);
@@ -75,9 +112,48 @@ flare_Jffs2Cache_Setup(void)
     cache[FLARE_JFFS2_CACHE_HEADER_FLAGS] = 0;
     if (FLARE_JFFS2_USE_CACHE_CRC)
         cache[FLARE_JFFS2_CACHE_HEADER_FLAGS] |= FLARE_JFFS2_CACHE_FLAGS_CRC;
+    if (FLARE_JFFS2_CACHE_PERSIST)
+        cache[FLARE_JFFS2_CACHE_HEADER_FLAGS] |= FLARE_JFFS2_CACHE_FLAGS_PERSIST;
+    cache[FLARE_JFFS2_CACHE_HEADER_STAMP] = stamp;
+    cache[FLARE_JFFS2_CACHE_HEADER_SEQUENCE] = sequence;
+    cache[FLARE_JFFS2_CACHE_HEADER_APP_SEQUENCE] = 0;
     cache[FLARE_JFFS2_CACHE_HEADER_MARKER_2] = FLARE_JFFS2_CACHE_HEADER_MARKER;
 }
 
+/*
+ * The cache stamp. A CRC of the filesystem's geometry so a loader built for
+ * a different flash layout does not use the cache. The flash is not read,
+ * the application's copy of the sequence number says the filesystem has
+ * not been written.
+ */
+static uint32_t
+flare_jffs2_cache_stamp(void)
+{
+    const uint32_t base = FLARE_FLASH_FILESYSTEM_BASE;
+    const uint32_t size = FLARE_FLASH_FILESYSTEM_SIZE;
+    const uint32_t block_size = FLARE_FLASH_BLOCK_SIZE;
+    CRC32          crc = 0;
+
+    crc32_update(&crc, (const uint8_t*) &base, sizeof(base));
+    crc32_update(&crc, (const uint8_t*) &size, sizeof(size));
+    crc32_update(&crc, (const uint8_t*) &block_size, sizeof(block_size));
+
+    return crc;
+}
+
+/*
+ * The sequence number of this boot. It is never zero so an application
+ * sequence number that was not written does not match it.
+ */
+static uint32_t
+flare_jffs2_cache_sequence(uint32_t sequence)
+{
+    ++sequence;
+    if (sequence == 0)
+        ++sequence;
+    return sequence;
+}
+
 static uint8_t*
 flare_jffs2_cache_valid(void)
 {
@@ -105,20 +181,138 @@ flare_jffs2_cache_flag(uint32_t flag)
     return valid;
 }
 
+/*
+ * Is the cache still valid after the reset? The DDR is only kept across a
+ * software or watchdog reset and the application must have copied the last
+ * boot's sequence number to the application sequence number. An
+ * application that does not know about the cache leaves it zero and the
+ * cache is cleared.
+ */
+static bool
+flare_jffs2_cache_persisted(uint32_t stamp)
+{
+    const uint32_t reset = flare_datasafe_reset_reason();
+    uint32_t*      header = (uint32_t*) FLARE_JFFS2_CACHE_BASE;
+
+    if ((reset & (FLARE_DS_RESET_SWR | FLARE_DS_RESET_WDT)) == 0)
+        return false;
+
+    if (!flare_jffs2_cache_flag(FLARE_JFFS2_CACHE_FLAGS_PERSIST))
+        return false;
+
+    if (flare_jffs2_cache_flag(FLARE_JFFS2_CACHE_FLAGS_CRC) !=
+        FLARE_JFFS2_USE_CACHE_CRC)
+        return false;
+
+    return (header[FLARE_JFFS2_CACHE_HEADER_STAMP] == stamp) &&
+        (header[FLARE_JFFS2_CACHE_HEADER_SEQUENCE] != 0) &&
+        (header[FLARE_JFFS2_CACHE_HEADER_SEQUENCE] ==
+         header[FLARE_JFFS2_CACHE_HEADER_APP_SEQUENCE]);
+}
+
+/*
+ * Scan the filesystem once to build the index the file reads use. A
+ * filesystem too big for the index is read by scanning the flash.
+ */
+static jffs2_error
+jffs2_filesystem_index(void)
+{
+    uint8_t*    cache_base = flare_jffs2_cache_valid();
+    bool        cache_crc = false;
+    void*       index = NULL;
+    jffs2_error je;
+
+    if (cache_base != NULL)
+        cache_crc = flare_jffs2_cache_flag(FLARE_JFFS2_CACHE_FLAGS_CRC);
+
+    if (FLARE_JFFS2_INDEX_END <= FLARE_JFFS2_REGION_SIZE)
+        index = (void*) FLARE_JFFS2_INDEX_BASE;
+    else
+        printf(" JFFS2 Index: no memory, reads scan the flash\n");
+
+    je = jffs2_boot_mount(&jffs2,
+                          FLARE_FLASH_FILESYSTEM_BASE,
+                          FLARE_FLASH_FILESYSTEM_SIZE,
+                          FLARE_FLASH_BLOCK_SIZE,
+                          cache_base, cache_crc,
+                          index);
+    if (je == JFFS2_INDEX_FULL)
+    {
+        printf(" JFFS2 Index: full, reads scan the flash\n");
+        je = JFFS2_NO_ERROR;
+    }
+    else if ((je == JFFS2_NO_ERROR) && (index != NULL))
+    {
+        printf(" JFFS2 Index: %u entries, %u nodes, %u summaries\n",
+               jffs2.index.dirent_count, jffs2.index.node_count,
+               jffs2.index.summary_count);
+    }
+
+    jffs2_mounted = je == JFFS2_NO_ERROR;
+
+    return je;
+}
+
 int
 jffs2_filesystem_mount(bool setup_cache)
 {
+    jffs2_error je;
+
     cwd[0] = '\0';
 
-    if (setup_cache)
-      flare_Jffs2Cache_Setup();
+    if (setup_cache && (FLARE_JFFS2_CACHE_SIZE > FLARE_JFFS2_REGION_SIZE))
+    {
+        uint32_t* header = (uint32_t*) FLARE_JFFS2_CACHE_BASE;
+        header[FLARE_JFFS2_CACHE_HEADER_MARKER_1] = 0;
+        header[FLARE_JFFS2_CACHE_HEADER_MARKER_2] = 0;
+        printf(" JFFS2 Cache: no memory, not used\n");
+    }
+    else if (setup_cache)
+    {
+        uint32_t* header = (uint32_t*) FLARE_JFFS2_CACHE_BASE;
+        uint32_t  stamp = flare_jffs2_cache_stamp();
+        uint32_t  sequence;
+        bool      persisted = false;
+
+        if (FLARE_JFFS2_CACHE_PERSIST)
+            persisted = flare_jffs2_cache_persisted(stamp);
+
+        /*
+         * A new sequence number each boot. The application has to copy it
+         * again for the next boot to keep the cache.
+         */
+        sequence = flare_jffs2_cache_sequence(header[FLARE_JFFS2_CACHE_HEADER_SEQUENCE]);
+
+        if (!persisted)
+            flare_Jffs2Cache_Setup(stamp, sequence);
+        else
+        {
+            header[FLARE_JFFS2_CACHE_HEADER_SEQUENCE] = sequence;
+            header[FLARE_JFFS2_CACHE_HEADER_APP_SEQUENCE] = 0;
+        }
+
+        printf(" JFFS2 Cache: %s\n", persisted ? "kept" : "cleared");
+    }
+
+    je = jffs2_filesystem_index();
+    if (je != JFFS2_NO_ERROR)
+        return je;
 
     return 0;
 }
 
-int jffs2_read_file(const char* name, void* const buffer, uint32_t* size) {
+static int
+jffs2_file_sink(void* arg, size_t offset, const uint8_t* data, size_t size)
+{
+    return flare_file_sink_data((flare_file_sink*) arg, offset, data, size);
+}
+
+int jffs2_read_file(const char* name, void* const buffer, uint32_t* size,
+    flare_file_sink* sink) {
     uint8_t*    cache_base = NULL;
     bool        cache_crc = false;
+    jffs2_frag* frags = NULL;
+    uint32_t    frag_slots;
     jffs2_error je;
     size_t      ssize = *size;
     size_t      i = 0;
@@ -144,18 +338,32 @@ int jffs2_read_file(const char* name, void* const buffer, uint32_t* size) {
 
     scratch[i] = '\0';
 
-    cache_base = flare_jffs2_cache_valid();
-    if (cache_base != NULL)
+    if (jffs2_mounted)
     {
-        cache_crc = flare_jffs2_cache_flag(FLARE_JFFS2_CACHE_FLAGS_CRC);
+        je = jffs2_boot_read_file(&jffs2, scratch, buffer, &ssize,
+                                  sink != NULL ? jffs2_file_sink : NULL, sink);
     }
+    else
+    {
+        cache_base = flare_jffs2_cache_valid();
+        if (cache_base != NULL)
+        {
+            cache_crc = flare_jffs2_cache_flag(FLARE_JFFS2_CACHE_FLAGS_CRC);
+        }
 
-    je = jffs2_boot_read(&jffs2,
-                         FLARE_FLASH_FILESYSTEM_BASE,
-                         FLARE_FLASH_FILESYSTEM_SIZE,
-                         FLARE_FLASH_BLOCK_SIZE,
-                         cache_base, cache_crc,
-                         scratch, buffer, &ssize);
+        frag_slots = flare_jffs2_frag_slots();
+        if (frag_slots != 0)
+            frags = (jffs2_frag*) FLARE_JFFS2_INDEX_BASE;
+
+        je = jffs2_boot_read(&jffs2,
+                             FLARE_FLASH_FILESYSTEM_BASE,
+                             FLARE_FLASH_FILESYSTEM_SIZE,
+                             FLARE_FLASH_BLOCK_SIZE,
+                             cache_base, cache_crc,
+                             frags, frag_slots,
+                             scratch, buffer, &ssize,
+                             sink != NULL ? jffs2_file_sink : NULL, sink);
+    }
     *size = ssize;
     if (je != JFFS2_NO_ERROR)
       return je;
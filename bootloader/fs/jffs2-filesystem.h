@@ -25,6 +25,35 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <fs/boot-filesystem.h>
+
+/*
+ * The DDR page cache can be kept across a software or watchdog reset. Each
+ * boot the loader writes a new non-zero sequence number to the cache header
+ * and clears the application sequence number. The cache is only kept if
+ * the application copies the sequence number to the application sequence
+ * number, and an application that does not know about the cache leaves it
+ * clear. An application that writes to the JFFS2 filesystem, or rewrites
+ * the flash, must clear the application sequence number before the write
+ * so the next boot does not read stale pages from the cache. The loader
+ * does not read the flash to see if it has changed. The stamp only holds
+ * the filesystem's geometry.
+ *
+ * The address is physical and the header words are 32 bits.
+ */
+#define FLARE_JFFS2_CACHE_ADDRESS (320UL * 1024UL * 1024UL)
+
+#define FLARE_JFFS2_CACHE_HEADER_MARKER_1     (0)
+#define FLARE_JFFS2_CACHE_HEADER_VERSION      (1)
+#define FLARE_JFFS2_CACHE_HEADER_FLAGS        (2)
+#define FLARE_JFFS2_CACHE_HEADER_STAMP        (3)
+#define FLARE_JFFS2_CACHE_HEADER_SEQUENCE     (4)
+#define FLARE_JFFS2_CACHE_HEADER_APP_SEQUENCE (5)
+#define FLARE_JFFS2_CACHE_HEADER_RESERVED     (6)
+#define FLARE_JFFS2_CACHE_HEADER_MARKER_2     (7)
+#define FLARE_JFFS2_CACHE_HEADER_CACHE        (8)
+#define FLARE_JFFS2_CACHE_HEADER_SIZE         (8 * sizeof(uint32_t))
+
 /*
  * Mount the file system.
  */
@@ -33,7 +62,8 @@ int jffs2_filesystem_mount(bool setup_cache);
 /*
  * Read the file.
  */
-int jffs2_read_file(const char* name, void* const buffer, uint32_t* size);
+int jffs2_read_file(const char* name, void* const buffer, uint32_t* size,
+    flare_file_sink* sink);
 
 /*
  * Change directory.
@@ -25,6 +25,7 @@
 #include <board.h>
 #include <boot-factory-config.h>
 #include <boot-load.h>
+#include <boot-profile.h>
 #include <boot-script.h>
 #include <cache.h>
 #include <datasafe.h>
@@ -55,6 +56,41 @@ flare_boot_board_requests(void)
     }
 }
 
+#if FLASH_CLOCK_CALIBRATE
+/*
+ * Use the QSPI clock setting saved in the datasafe for this flash if the ID
+ * reads back at it, else calibrate the clock and save the setting so warm
+ * boots skip the sweep.
+ */
+static void
+flash_clock(void)
+{
+    uint32_t manufacture_code;
+    uint32_t mem_iface_type;
+    uint32_t density;
+    uint32_t flash_id;
+    uint32_t setting;
+
+    if (flash_read_id(&manufacture_code, &mem_iface_type, &density) != FLASH_NO_ERROR) {
+        return;
+    }
+
+    flash_id = (manufacture_code << 16) | (mem_iface_type << 8) | density;
+
+    if (!flare_datasafe_qspi_clock(flash_id, &setting)
+        || (flash_restore_clock(setting) != FLASH_NO_ERROR)) {
+        if (flash_calibrate(&setting) != FLASH_NO_ERROR) {
+            printf("  QSPI Clock: calibration failed\n");
+            return;
+        }
+        flare_datasafe_set_qspi_clock(flash_id, setting);
+    }
+
+    printf("  QSPI Clock: divisor %d delay %d\n",
+           (int) FLASH_CLOCK_DIVISOR(setting), (int) FLASH_CLOCK_DELAY(setting));
+}
+#endif
+
 static void boot_failure() {
     led_failure();
     factory_boot();
@@ -69,10 +105,13 @@ int main(void) {
     boot_script script;
     uint32_t entry_point = 0;
     int status = 0;
+    boot_profile_id stage;
 
     board_hardware_setup();
     board_timer_reset();
 
+    stage = boot_profile_begin("setup", NULL);
+
     printf("\nFlare Apache 2.0 Licensed FSBL\n");
     printf("    Build ID: %s\n", flare_build_id());
 
@@ -86,11 +125,26 @@ int main(void) {
 
     flare_datasafe_init();
 
+    boot_profile_end(stage);
+
+    stage = boot_profile_begin("flash-open", NULL);
     flash_error err = flash_open(&label);
+    boot_profile_end(stage);
     if (err == FLASH_NO_ERROR) {
         printf("       Flash: %s\n", label);
+#if FLASH_DMA_READ_CHECK
+        err = flash_dma_check();
+        printf("   Flash DMA: %s (%d)\n", err == FLASH_NO_ERROR ? "pass" : "FAIL", err);
+#endif
+#if FLASH_CLOCK_CALIBRATE
+        stage = boot_profile_begin("flash-clock", NULL);
+        flash_clock();
+        boot_profile_end(stage);
+#endif
     }
+    stage = boot_profile_begin("factory-config", NULL);
     factory_config_load();
+    boot_profile_end(stage);
     flare_boot_board_requests();
 
     flare_get_boot_plan(&bp);
@@ -100,7 +154,9 @@ int main(void) {
             break;
         }
 
+        stage = boot_profile_begin("open", bp.opens_name[i]);
         status = (*bp.opens[i])();
+        boot_profile_end(stage);
         if (status) {
             printf("Open failure: %s: %d\n", bp.opens_name[i], status);
             boot_failure();
@@ -112,24 +168,32 @@ int main(void) {
             break;
         }
 
+        stage = boot_profile_begin("mount", bp.mounts_name[i]);
         status = (*bp.mounts[i])();
+        boot_profile_end(stage);
         if (status) {
             printf("Mount failure: %s: %d\n", bp.mounts_name[i], status);
             boot_failure();
         }
     }
 
+    stage = boot_profile_begin("boot-script", bp.bs_name);
     status = boot_script_load(bp.boot_fs, bp.bs_name, &script);
+    boot_profile_end(stage);
     if (status) {
         printf("Invalid boot script: %d\n", status);
         boot_failure();
     }
 
+    stage = boot_profile_begin("load-exe", script.executable);
     status = load_exe(&script, &entry_point);
+    boot_profile_end(stage);
     if (status) {
         printf("Invalid executable: %d\n", status);
     }
 
+    boot_profile_print();
+
     flare_datasafe_set_boot(script.path, script.executable);
     wdog_control(true);
     cache_flush_invalidate();
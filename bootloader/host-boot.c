@@ -0,0 +1,210 @@
+/*
+ * Copyright 2026 Contemporary Software
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+/*
+ * Flare host boot. Runs the FSBL's boot path on the host with the flash and
+ * SD card as image files:
+ *
+ *  flare_host --flash jffs2.img
+ *  flare_host --boot sd --sd fat.img
+ *
+ * The loaded executable is left in the memory arena and the entry point
+ * is printed. There is no handoff.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <board.h>
+#include <boot-factory-config.h>
+#include <boot-load.h>
+#include <boot-profile.h>
+#include <boot-script.h>
+#include <datasafe.h>
+#include <flare-boot.h>
+#include <flare-build-id.h>
+#include <fs/boot-filesystem.h>
+
+#include <driver/flash/flash.h>
+#include <driver/sdhci/sdhci.h>
+#include <driver/timer/board-timer.h>
+
+static const struct option options[] = {
+    { "flash", required_argument, NULL, 'f' },
+    { "erase-size", required_argument, NULL, 'E' },
+    { "sd", required_argument, NULL, 's' },
+    { "emmc", required_argument, NULL, 'e' },
+    { "boot", required_argument, NULL, 'b' },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+};
+
+static void usage(const char* argv0) {
+    printf("usage: %s [options]\n", argv0);
+    printf(" -f, --flash FILE       QSPI flash image\n");
+    printf(" -E, --erase-size SIZE  flash erase block size (default %lu)\n",
+        HOST_FLASH_ERASE_SIZE);
+    printf(" -s, --sd FILE          SD card image\n");
+    printf(" -e, --emmc FILE        EMMC image\n");
+    printf(" -b, --boot MODE        boot mode: qspi, sd or emmc (default qspi)\n");
+    printf(" -h, --help             this help\n");
+}
+
+static int attach(const char* what, const char* path, int err) {
+    if (err != 0) {
+        printf("error: %s: %s: %s\n", what, path, strerror(err));
+    }
+    return err;
+}
+
+int main(int argc, char* argv[]) {
+    flare_boot_plan bp;
+    const char* flash = NULL;
+    const char* label;
+    size_t erase_size = HOST_FLASH_ERASE_SIZE;
+    boot_script script;
+    uint32_t entry_point = 0;
+    int status = 0;
+    boot_profile_id stage;
+    int opt;
+
+    board_hardware_setup();
+
+    while ((opt = getopt_long(argc, argv, "f:E:s:e:b:h", options, NULL)) != -1) {
+        switch (opt) {
+        case 'f':
+            flash = optarg;
+            break;
+        case 'E':
+            erase_size = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            if (attach("sd", optarg,
+                    host_sdhci_attach(SDHCI_CTLR_SD, optarg)) != 0) {
+                return 1;
+            }
+            break;
+        case 'e':
+            if (attach("emmc", optarg,
+                    host_sdhci_attach(SDHCI_CTLR_EMMC, optarg)) != 0) {
+                return 1;
+            }
+            break;
+        case 'b':
+            if (strcmp(optarg, "qspi") == 0) {
+                host_set_bootmode(FLARE_DS_BOOTMODE_QSPI);
+            } else if (strcmp(optarg, "sd") == 0) {
+                host_set_bootmode(FLARE_DS_BOOTMODE_SD_CARD);
+            } else if (strcmp(optarg, "emmc") == 0) {
+                host_set_bootmode(FLARE_DS_BOOTMODE_EMMC);
+            } else {
+                printf("error: invalid boot mode: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (flash != NULL) {
+        if (attach("flash", flash, host_flash_attach(flash, erase_size)) != 0) {
+            return 1;
+        }
+    }
+
+    board_timer_reset();
+
+    stage = boot_profile_begin("setup", NULL);
+
+    printf("\nFlare Apache 2.0 Licensed FSBL (host)\n");
+    printf("    Build ID: %s\n", flare_build_id());
+
+    flare_datasafe_init();
+
+    boot_profile_end(stage);
+
+    stage = boot_profile_begin("flash-open", NULL);
+    flash_error err = flash_open(&label);
+    boot_profile_end(stage);
+    if (err == FLASH_NO_ERROR) {
+        printf("       Flash: %s\n", label);
+        stage = boot_profile_begin("factory-config", NULL);
+        factory_config_load();
+        boot_profile_end(stage);
+    }
+
+    flare_get_boot_plan(&bp);
+
+    for (int i = 0; i < FLARE_STAGE_FUNC_MAX; i++) {
+        if (bp.opens[i] == NULL) {
+            break;
+        }
+
+        stage = boot_profile_begin("open", bp.opens_name[i]);
+        status = (*bp.opens[i])();
+        boot_profile_end(stage);
+        if (status) {
+            printf("Open failure: %s: %d\n", bp.opens_name[i], status);
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < FLARE_STAGE_FUNC_MAX; i++) {
+        if (bp.mounts[i] == NULL) {
+            break;
+        }
+
+        stage = boot_profile_begin("mount", bp.mounts_name[i]);
+        status = (*bp.mounts[i])();
+        boot_profile_end(stage);
+        if (status) {
+            printf("Mount failure: %s: %d\n", bp.mounts_name[i], status);
+            return 1;
+        }
+    }
+
+    stage = boot_profile_begin("boot-script", bp.bs_name);
+    status = boot_script_load(bp.boot_fs, bp.bs_name, &script);
+    boot_profile_end(stage);
+    if (status) {
+        printf("Invalid boot script: %d\n", status);
+        return 1;
+    }
+
+    stage = boot_profile_begin("load-exe", script.executable);
+    status = load_exe(&script, &entry_point);
+    boot_profile_end(stage);
+
+    boot_profile_print();
+
+    if (!status) {
+        printf("Invalid executable\n");
+        return 1;
+    }
+
+    flare_datasafe_set_boot(script.path, script.executable);
+
+    printf(" Entry point: 0x%08x\n", entry_point);
+
+    return 0;
+}
@@ -0,0 +1,30 @@
+/*
+ * Copyright 2025 Contemporary Software
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+/*
+ * Header file for generated file containing the git hash and unix time of
+ * build as an ID.
+ */
+
+#include <flare-build-id.h>
+
+const char* flare_build_id() {
+    return "95f6de56-m-6ad2e9dd";
+}
+
+size_t flare_build_id_length() {
+    return 0x13;
+}
\ No newline at end of file
@@ -23,7 +23,7 @@ def options(opt):
     copts.add_option('--board',
                      default=None,
                      dest='flare_board',
-                     help='Compiler prefix')
+                     help='Board (versal, zynqmp, zynq7000 or host)')
     copts.add_option('--xsa',
                      default=None,
                      dest='flare_xsa',
@@ -35,19 +35,22 @@ def options(opt):
 
 
 def configure(conf):
-    tools_prefix = conf.options.flare_compiler_prefix
-    if tools_prefix == None:
-        conf.fatal('No compiler prefix found')
-
     board = conf.options.flare_board
     if board == None:
         conf.fatal('No board specified')
     else:
         conf.env.FLARE_BOARD = board
 
+    tools_prefix = conf.options.flare_compiler_prefix
+    if tools_prefix == None:
+        if board == 'host':
+            tools_prefix = ''
+        else:
+            conf.fatal('No compiler prefix found')
+
     tool_path_list = []
     if conf.options.flare_tools_path == None:
-        tool_path_list = os.environ['PATH']
+        tool_path_list = os.environ['PATH'].split(os.pathsep)
     else:
         if os.path.exists(os.path.join(conf.options.flare_tools_path, 'bin')):
             tool_path_list = os.path.join(conf.options.flare_tools_path, 'bin')
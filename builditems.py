@@ -5,10 +5,11 @@
 #
 
 defines = {
-    'default': ['FLARE=1', 'FLARE_DATASAFE_FORMAT=1'],
+    'default': ['FLARE=1', 'FLARE_DATASAFE_FORMAT=2'],
     'versal': ['FLARE_VERSAL'],
     'zynqmp': ['FLARE_ZYNQMP'],
-    'zynq7000': ['FLARE_ZYNQ7000']
+    'zynq7000': ['FLARE_ZYNQ7000'],
+    'host': ['FLARE_HOST']
 }
 
 includes = {
@@ -17,12 +18,13 @@ includes = {
     ],
     'versal': [],
     'zynqmp': [],
-    'zynq7000': []
+    'zynq7000': [],
+    'host': []
 }
 
 cflags = {
     'default': ['-ffreestanding', '-g', '-O2', '-fPIE', '-Wall'],
-    'versal': [],
+    'versal': ['-mcpu=cortex-a72'],
     'zynqmp': [
         '-mcpu=cortex-a53', '-mfix-cortex-a53-835769',
         '-mfix-cortex-a53-843419', '-mlittle-endian', '-DEL2=1',
@@ -36,47 +38,43 @@ cflags = {
         '-mfloat-abi=hard',
         '-mtune=cortex-a9',
         '-mlittle-endian',
-    ]
+    ],
+    'host': []
 }
 
 
 def get_items(bld, items):
     vals = []
     vals += items['default']
-    for board in items:
-        if board == bld.env.FLARE_BOARD:
-            vals += items[board]
+    vals += items.get(bld.env.FLARE_BOARD, [])
     return vals
 
 
 def get_defines(bld, items):
+    board = bld.env.FLARE_BOARD
     vals = []
     vals += items['default']
     vals += defines['default']
-    for board in items:
-        if board == bld.env.FLARE_BOARD:
-            vals += items[board]
-            vals += defines[board]
+    vals += items.get(board, [])
+    vals += defines.get(board, [])
     return vals
 
 
 def get_includes(bld, items):
+    board = bld.env.FLARE_BOARD
     vals = []
     vals += [str(bld.path.find_node(i)) for i in items['default']]
     vals += [str(bld.path.find_node(i)) for i in includes['default']]
-    for board in items:
-        if board == bld.env.FLARE_BOARD:
-            vals += [str(bld.path.find_node(i)) for i in items[board]]
-            vals += [str(bld.path.find_node(i)) for i in includes[board]]
+    vals += [str(bld.path.find_node(i)) for i in items.get(board, [])]
+    vals += [str(bld.path.find_node(i)) for i in includes.get(board, [])]
     return vals
 
 
 def get_cflags(bld, items):
+    board = bld.env.FLARE_BOARD
     vals = []
     vals += items['default']
     vals += cflags['default']
-    for board in items:
-        if board == bld.env.FLARE_BOARD:
-            vals += items[board]
-            vals += cflags[board]
+    vals += items.get(board, [])
+    vals += cflags.get(board, [])
     return vals
@@ -6,7 +6,8 @@ outputs = {
     'default': ['bootloader/flare-build-id.c'],
     'versal': [],
     'zynqmp': [],
-    'zynq7000': []
+    'zynq7000': [],
+    'host': []
 }
 
 flare_build_ver_template = [
@@ -0,0 +1,563 @@
+#! /usr/bin/env python
+# encoding: utf-8
+#
+# Flare Test Image Generator
+#
+# Creates the flash and SD card images the host board boots and the boot
+# benchmark reads:
+#
+#  JFFS2 flash image: the filesystem followed by the factory data erase block
+#  FAT16 SD card image: a single volume with no partition table
+#
+# The executable is wrapped in a U-Boot legacy header and a boot script is
+# created with bootscripter's format. Filler files take the filesystem to a
+# fill level and the executable can be placed in a deep directory tree.
+#
+# The images are created with mkfs.jffs2, or mkfs.vfat and mtools, when they
+# are installed and the image can be expressed with them. The built in
+# writers are used otherwise. Zero compressed pages, obsoleted versions and
+# erase block summaries always use the built in JFFS2 writer.
+#
+
+import argparse
+import os
+import random
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+import zlib
+
+JFFS2_MAGIC = 0x1985
+JFFS2_NODETYPE_DIRENT = 0xe001
+JFFS2_NODETYPE_INODE = 0xe002
+JFFS2_NODETYPE_CLEANMARKER = 0x2003
+JFFS2_NODETYPE_SUMMARY = 0x2006
+JFFS2_SUM_MAGIC = 0x02851885
+JFFS2_COMPR_NONE = 0x00
+JFFS2_COMPR_ZERO = 0x01
+JFFS2_COMPR_ZLIB = 0x06
+JFFS2_PAGE_SIZE = 4096
+JFFS2_ROOT_INO = 1
+
+DT_DIR = 4
+DT_REG = 8
+S_IFDIR = 0o040000
+S_IFREG = 0o100000
+
+UBOOT_MAGIC = 0x27051956
+
+
+def jffs2_crc(data):
+    ''' JFFS2 CRCs are the raw CRC32 with no inversion. '''
+    return zlib.crc32(data, 0xffffffff) ^ 0xffffffff
+
+
+def pad4(data):
+    return data + b'\xff' * ((4 - (len(data) % 4)) % 4)
+
+
+def uboot_image(data, load_addr, entry, name, compress):
+    if compress:
+        payload = gzip_compress(data)
+        comp = 1
+    else:
+        payload = data
+        comp = 0
+    name = name.encode()[:32].ljust(32, b'\0')
+    header = struct.pack('>IIIIIIIBBBB32s', UBOOT_MAGIC, 0, int(time.time()),
+                         len(payload), load_addr, entry,
+                         zlib.crc32(payload), 5, 2, 2, comp, name)
+    hcrc = zlib.crc32(header)
+    header = header[:4] + struct.pack('>I', hcrc) + header[8:]
+    return header + payload
+
+
+def gzip_compress(data):
+    co = zlib.compressobj(9, zlib.DEFLATED, -15)
+    raw = co.compress(data) + co.flush()
+    header = struct.pack('<BBBBIBB', 0x1f, 0x8b, 8, 0, 0, 2, 3)
+    trailer = struct.pack('<II', zlib.crc32(data), len(data) & 0xffffffff)
+    return header + raw + trailer
+
+
+def boot_script(path, exe_name, exe):
+    bs = path + '\n' + exe_name + ',' + '{:08x}'.format(zlib.crc32(exe)) + '\n'
+    return (bs + '{:08x}'.format(zlib.crc32(bs.encode())) + '\n').encode()
+
+
+class jffs2_image:
+
+    def __init__(self, erase_size, compress=True, zero=False,
+                 cleanmarkers=True, summary=False):
+        self.erase_size = erase_size
+        self.compress = compress
+        self.zero = zero
+        self.cleanmarkers = cleanmarkers
+        self.summary = summary
+        self.blocks = []
+        self.block = None
+        self.sums = []
+        self.next_ino = JFFS2_ROOT_INO + 1
+        self.dirs = {'': JFFS2_ROOT_INO}
+        self.versions = {}
+        self.nodes = 0
+        self.mtime = int(time.time())
+
+    def _new_block(self):
+        if self.block is not None:
+            self._summary()
+            self.blocks.append(self.block)
+        self.block = bytearray()
+        self.sums = []
+        if self.cleanmarkers:
+            self.block += struct.pack('<HHI', JFFS2_MAGIC,
+                                      JFFS2_NODETYPE_CLEANMARKER, 12)
+            self.block += struct.pack('<I', jffs2_crc(self.block[-8:]))
+
+    def _summary_entry(self, node, offset):
+        ''' The summary entry of a node at an offset in the block. '''
+        ntype, totlen = struct.unpack_from('<HI', node, 2)
+        if ntype == JFFS2_NODETYPE_INODE:
+            ino, version = struct.unpack_from('<II', node, 12)
+            return struct.pack('<HIIII', ntype, ino, version, offset, totlen)
+        pino, version, ino = struct.unpack_from('<III', node, 12)
+        nsize, dtype = struct.unpack_from('<BB', node, 28)
+        return struct.pack('<HIIIIIBB', ntype, totlen, offset, pino, version,
+                           ino, nsize, dtype) + bytes(node[40:40 + nsize])
+
+    def _summary_size(self, entries):
+        if not self.summary:
+            return 0
+        return 32 + sum([len(e) for e in entries]) + 8
+
+    def _summary(self):
+        ''' Write the summary node after the block's last node. The summary
+        ends with the marker in the last 8 bytes of the erase block. '''
+        if not self.summary or len(self.sums) == 0:
+            return
+        offset = len(self.block)
+        size = self.erase_size - offset
+        data = b''.join(self.sums)
+        data += b'\xff' * (size - self._summary_size(self.sums))
+        data += struct.pack('<II', offset, JFFS2_SUM_MAGIC)
+        node = struct.pack('<HHI', JFFS2_MAGIC, JFFS2_NODETYPE_SUMMARY, size)
+        node += struct.pack('<I', jffs2_crc(node))
+        node += struct.pack('<IIII', len(self.sums),
+                            12 if self.cleanmarkers else 0, 0,
+                            jffs2_crc(data))
+        node += struct.pack('<I', jffs2_crc(node[:24]))
+        self.block += node + data
+
+    def _write(self, node):
+        node = pad4(node)
+        if len(node) + self._summary_size([]) > self.erase_size:
+            raise RuntimeError('node larger than an erase block')
+        need = len(node)
+        if self.summary:
+            need += len(self._summary_entry(node, 0))
+        if self.block is None or \
+           len(self.block) + need + self._summary_size(self.sums) > \
+           self.erase_size:
+            self._new_block()
+        if self.summary:
+            self.sums += [self._summary_entry(node, len(self.block))]
+        self.block += node
+        self.nodes += 1
+
+    def _version(self, ino):
+        self.versions[ino] = self.versions.get(ino, 0) + 1
+        return self.versions[ino]
+
+    def _dirent(self, pino, ino, name, dtype):
+        name = name.encode()
+        node = struct.pack('<HHII', JFFS2_MAGIC, JFFS2_NODETYPE_DIRENT,
+                           40 + len(name), 0)
+        node = node[:8] + struct.pack('<I', jffs2_crc(node[:8]))
+        node += struct.pack('<IIIIBBH', pino, self._version(pino), ino,
+                            self.mtime, len(name), dtype, 0)
+        node += struct.pack('<II', jffs2_crc(node[:32]), jffs2_crc(name))
+        self._write(node + name)
+
+    def _inode(self, ino, mode, isize, offset, data):
+        compr = JFFS2_COMPR_NONE
+        cdata = data
+        if self.zero and len(data) > 0 and data.count(0) == len(data):
+            compr = JFFS2_COMPR_ZERO
+            cdata = b''
+        elif self.compress and len(data) > 0:
+            z = zlib.compress(data, 9)
+            if len(z) < len(data):
+                compr = JFFS2_COMPR_ZLIB
+                cdata = z
+        node = struct.pack('<HHII', JFFS2_MAGIC, JFFS2_NODETYPE_INODE,
+                           68 + len(cdata), 0)
+        node = node[:8] + struct.pack('<I', jffs2_crc(node[:8]))
+        node += struct.pack('<IIIHHIIIIIIIBBH', ino, self._version(ino), mode,
+                            0, 0, isize, self.mtime, self.mtime, self.mtime,
+                            offset, len(cdata), len(data), compr, 0, 0)
+        node += struct.pack('<I', jffs2_crc(cdata))
+        node += struct.pack('<I', jffs2_crc(node[:60]))
+        self._write(node + cdata)
+
+    def _dir(self, path):
+        path = path.strip('/')
+        if path in self.dirs:
+            return self.dirs[path]
+        parent, name = os.path.split(path)
+        pino = self._dir(parent)
+        ino = self.next_ino
+        self.next_ino += 1
+        self._inode(ino, S_IFDIR | 0o755, 0, 0, b'')
+        self._dirent(pino, ino, name, DT_DIR)
+        self.dirs[path] = ino
+        return ino
+
+    def add_file(self, path, data, ino=None):
+        ''' Add a file. Adding the same path again with the inode number
+        returned writes a new version and obsoletes the old nodes. '''
+        parent, name = os.path.split(path.strip('/'))
+        pino = self._dir(parent)
+        new = ino is None
+        if new:
+            ino = self.next_ino
+            self.next_ino += 1
+        for offset in range(0, max(len(data), 1), JFFS2_PAGE_SIZE):
+            self._inode(ino, S_IFREG | 0o644, len(data), offset,
+                        data[offset:offset + JFFS2_PAGE_SIZE])
+        if new:
+            self._dirent(pino, ino, name, DT_REG)
+        return ino
+
+    def used(self):
+        return len(self.blocks) * self.erase_size + \
+            (len(self.block) if self.block is not None else 0)
+
+    def image(self, size=None):
+        self._summary()
+        blocks = self.blocks + [self.block]
+        data = b''.join([bytes(b).ljust(self.erase_size, b'\xff')
+                         for b in blocks])
+        if size is not None:
+            if len(data) > size:
+                raise RuntimeError('filesystem too big for the flash')
+            data = data.ljust(size, b'\xff')
+        # factory data erase block
+        return data + b'\xff' * self.erase_size
+
+
+class fat16_image:
+    ''' A FAT16 volume with no partition table. Directories other than the
+    root and long file names are not supported. '''
+
+    def __init__(self, size, cluster_size=4096):
+        self.bps = 512
+        self.spc = cluster_size // self.bps
+        self.sectors = size // self.bps
+        self.reserved = 1
+        self.root_entries = 512
+        self.root_sectors = (self.root_entries * 32) // self.bps
+        clusters = self.sectors // self.spc
+        self.fat_sectors = ((clusters + 2) * 2 + self.bps - 1) // self.bps
+        self.data_start = self.reserved + 2 * self.fat_sectors + \
+            self.root_sectors
+        self.clusters = (self.sectors - self.data_start) // self.spc
+        if self.clusters < 4085 or self.clusters > 65524:
+            raise RuntimeError('image size is not FAT16')
+        self.fat = [0xfff8, 0xffff]
+        self.root = []
+        self.data = bytearray()
+
+    def add_file(self, name, data):
+        base, ext = os.path.splitext(name.upper())
+        sfn = base[:8].ljust(8).encode() + ext[1:4].ljust(3).encode()
+        cluster_bytes = self.spc * self.bps
+        first = 0
+        if len(data) > 0:
+            first = len(self.fat)
+            count = (len(data) + cluster_bytes - 1) // cluster_bytes
+            for c in range(count - 1):
+                self.fat.append(first + c + 1)
+            self.fat.append(0xffff)
+            self.data += data.ljust(count * cluster_bytes, b'\0')
+        if len(self.fat) - 2 > self.clusters:
+            raise RuntimeError('FAT image full')
+        self.root.append(struct.pack('<11sBBBHHHHHHHI', sfn, 0x20, 0, 0, 0, 0,
+                                     0, 0, 0, 0, first, len(data)))
+
+    def used(self):
+        return self.data_start * self.bps + len(self.data)
+
+    def image(self):
+        bs = struct.pack('<3s8sHBHBHHBHHHII', b'\xeb\x3c\x90', b'FLARE   ',
+                         self.bps, self.spc, self.reserved, 2,
+                         self.root_entries,
+                         self.sectors if self.sectors < 0x10000 else 0, 0xf8,
+                         self.fat_sectors, 63, 255, 0,
+                         self.sectors if self.sectors >= 0x10000 else 0)
+        bs += struct.pack('<BBBI11s8s', 0x80, 0, 0x29, 0x20260101,
+                          b'FLARE      ', b'FAT16   ')
+        bs = bs.ljust(510, b'\0') + b'\x55\xaa'
+        fat = b''.join([struct.pack('<H', e) for e in self.fat])
+        fat = fat.ljust(self.fat_sectors * self.bps, b'\0')
+        root = b''.join(self.root).ljust(self.root_sectors * self.bps, b'\0')
+        img = bs.ljust(self.reserved * self.bps, b'\0') + fat + fat + root
+        img += bytes(self.data)
+        return img.ljust(self.sectors * self.bps, b'\0')
+
+
+def have_tools(*tools):
+    for t in tools:
+        if shutil.which(t) is None:
+            return False
+    return True
+
+
+def make_exe(rand, size, zero):
+    ''' Compressible but not trivial data. A percentage of the pages are
+    zero filled in runs. '''
+    words = [rand.getrandbits(32).to_bytes(4, 'little') for i in range(256)]
+    exe = bytearray(b''.join([words[rand.randrange(len(words))]
+                              for i in range(size // 4)]))
+    pages = size // JFFS2_PAGE_SIZE
+    zeros = (pages * zero) // 100
+    run = 8
+    while zeros > 0:
+        page = rand.randrange(pages)
+        count = min(run, zeros, pages - page)
+        start = page * JFFS2_PAGE_SIZE
+        end = start + count * JFFS2_PAGE_SIZE
+        if exe[start:end].count(0) != end - start:
+            exe[start:end] = bytes(end - start)
+            zeros -= count
+    return bytes(exe)
+
+
+def make_filler(rand, size):
+    ''' Filler data compresses about as well as an executable. '''
+    return make_exe(rand, size, 0)
+
+
+def tree_dirs(opts):
+    ''' The boot directory and the directories that fill the tree. '''
+    boot = opts.path.rstrip('/')
+    for d in range(opts.depth):
+        boot += '/d%02d' % (d)
+    dirs = ['/dir%03d' % (d) for d in range(opts.dirs)]
+    return (boot if len(boot) else '/'), dirs
+
+
+def make_files(opts, rand, fs_size):
+    ''' Returns the files in the order they are written. A file can appear
+    more than once and the last is the current version. '''
+    if opts.exe is None:
+        exe = make_exe(rand, opts.exe_size, opts.zero)
+    else:
+        with open(opts.exe, 'rb') as f:
+            exe = f.read()
+
+    img = uboot_image(exe, opts.load_addr, opts.load_addr, opts.name,
+                      opts.gzip)
+    boot, dirs = tree_dirs(opts)
+    bs = boot_script(boot, opts.name, img)
+    exe_path = os.path.join(boot, opts.name)
+
+    files = []
+    for d in dirs:
+        files += [(os.path.join(d, 'file'), make_filler(rand, 1024))]
+    for i in range(opts.obsolete):
+        old = bytearray(img)
+        old[-1] ^= 0xff
+        files += [(exe_path, bytes(old))]
+    files += [(exe_path, img), ('/flare-0', bs)]
+
+    # The fill level is the uncompressed size. The filesystem's compression
+    # ratio decides how full it ends up.
+    fill = (fs_size * opts.fill) // 100
+    used = sum([len(d) for p, d in files])
+    n = 0
+    while used + opts.filler_size <= fill:
+        files.insert(n % len(files),
+                     ('/f%05d.bin' % (n), make_filler(rand,
+                                                      opts.filler_size)))
+        used += opts.filler_size
+        n += 1
+    return files, exe_path
+
+
+def jffs2_builtin(opts, files, fs_size):
+    fs = jffs2_image(opts.erase_size,
+                     compress=opts.compression == 'zlib',
+                     zero=opts.zero > 0, summary=opts.summary)
+    inos = {}
+    for path, data in files:
+        inos[path] = fs.add_file(path, data, inos.get(path))
+    if fs.used() > fs_size:
+        raise RuntimeError('filesystem too big for the flash: %d' %
+                           (fs.used()))
+    return fs.image(fs_size), fs.nodes
+
+
+def stage_files(stage, files):
+    for path, data in files:
+        name = os.path.join(stage, path.lstrip('/'))
+        os.makedirs(os.path.dirname(name), exist_ok=True)
+        with open(name, 'wb') as f:
+            f.write(data)
+
+
+def jffs2_mkfs(opts, files, fs_size):
+    cmd = ['mkfs.jffs2', '-l', '-q', '-e', str(opts.erase_size),
+           '-p', str(fs_size)]
+    # Only zlib is supported by the loader.
+    listing = subprocess.run(['mkfs.jffs2', '-L'], capture_output=True,
+                             text=True).stdout
+    for line in listing.splitlines():
+        fields = line.split()
+        if len(fields) > 1 and fields[1] in ['zlib', 'rtime', 'lzo']:
+            if fields[1] != 'zlib' or opts.compression == 'none':
+                cmd += ['-x', fields[1]]
+    if opts.compression == 'none':
+        cmd += ['-m', 'none']
+    with tempfile.TemporaryDirectory() as tmp:
+        stage = os.path.join(tmp, 'root')
+        out = os.path.join(tmp, 'jffs2.img')
+        stage_files(stage, files)
+        subprocess.run(cmd + ['-r', stage, '-o', out], check=True)
+        with open(out, 'rb') as f:
+            data = f.read()
+    if len(data) > fs_size:
+        raise RuntimeError('filesystem too big for the flash: %d' % (len(data)))
+    # factory data erase block
+    return data.ljust(fs_size, b'\xff') + b'\xff' * opts.erase_size, None
+
+
+def fat_builtin(opts, files):
+    fs = fat16_image(opts.size)
+    for path, data in files:
+        if os.path.dirname(path) != '/':
+            raise RuntimeError('FAT images only support the root directory')
+        fs.add_file(os.path.basename(path), data)
+    return fs.image()
+
+
+def fat_mkfs(opts, files):
+    with tempfile.TemporaryDirectory() as tmp:
+        out = os.path.join(tmp, 'fat.img')
+        subprocess.run(['mkfs.vfat', '-C', out, str(opts.size // 1024)],
+                       check=True, capture_output=True)
+        made = set()
+        for path, data in files:
+            d = os.path.dirname(path).lstrip('/')
+            parts = [p for p in d.split('/') if len(p)]
+            for i in range(len(parts)):
+                sub = '/'.join(parts[:i + 1])
+                if sub not in made:
+                    subprocess.run(['mmd', '-i', out, '::' + sub], check=True)
+                    made.add(sub)
+            name = os.path.join(tmp, 'file')
+            with open(name, 'wb') as f:
+                f.write(data)
+            subprocess.run(['mcopy', '-o', '-i', out, name,
+                            '::' + path.lstrip('/')], check=True)
+        with open(out, 'rb') as f:
+            return f.read()
+
+
+def generate(opts):
+    ''' Generate the image. Returns the path of the executable in the
+    image. '''
+    rand = random.Random(opts.seed)
+    if opts.type == 'jffs2':
+        fs_size = opts.size - opts.erase_size
+        files, exe_path = make_files(opts, rand, fs_size)
+        use_mkfs = opts.tools != 'builtin' and \
+            opts.zero == 0 and opts.obsolete == 0 and not opts.summary and \
+            have_tools('mkfs.jffs2')
+        if opts.tools == 'mkfs' and not use_mkfs:
+            raise RuntimeError('mkfs.jffs2 cannot create the image')
+        if use_mkfs:
+            data, nodes = jffs2_mkfs(opts, files, fs_size)
+            tool = 'mkfs.jffs2'
+        else:
+            data, nodes = jffs2_builtin(opts, files, fs_size)
+            tool = 'builtin'
+        print('jffs2: %s: %s: nodes: %s size: %d' %
+              (opts.output, tool, nodes, len(data)))
+    else:
+        files, exe_path = make_files(opts, rand, opts.size)
+        use_mkfs = opts.tools != 'builtin' and \
+            have_tools('mkfs.vfat', 'mcopy', 'mmd')
+        if opts.tools == 'mkfs' and not use_mkfs:
+            raise RuntimeError('mkfs.vfat and mtools are not installed')
+        if use_mkfs:
+            data = fat_mkfs(opts, files)
+            tool = 'mkfs.vfat'
+        else:
+            data = fat_builtin(opts, files)
+            tool = 'builtin'
+        print('fat: %s: %s: size: %d' % (opts.output, tool, len(data)))
+
+    with open(opts.output, 'wb') as f:
+        f.write(data)
+
+    return exe_path
+
+
+def arguments():
+    argsp = argparse.ArgumentParser(prog='flareimage',
+                                    description='Flare test image generator')
+    argsp.add_argument('--type', choices=['jffs2', 'fat'], default='jffs2',
+                       help='Image type (default: %(default)s)')
+    argsp.add_argument('--output', required=True, help='Output image')
+    argsp.add_argument('--exe', default=None,
+                       help='Executable, random data if not set')
+    argsp.add_argument('--exe-size', type=int, default=8 * 1024 * 1024,
+                       help='Random executable size (default: %(default)s)')
+    argsp.add_argument('--name', default='app.img', help='Executable name')
+    argsp.add_argument('--path', default='/', help='Boot path')
+    argsp.add_argument('--gzip', action='store_true',
+                       help='Compress the U-Boot image')
+    argsp.add_argument('--load-addr', type=lambda x: int(x, 0),
+                       default=0x10000000, help='U-Boot load address')
+    argsp.add_argument('--size', type=lambda x: int(x, 0),
+                       default=64 * 1024 * 1024,
+                       help='Image size (default: %(default)s)')
+    argsp.add_argument('--erase-size', type=lambda x: int(x, 0),
+                       default=64 * 1024,
+                       help='JFFS2 erase block size (default: %(default)s)')
+    argsp.add_argument('--compression', choices=['zlib', 'none'],
+                       default='zlib',
+                       help='JFFS2 node compression (default: %(default)s)')
+    argsp.add_argument('--zero', type=int, default=0,
+                       help='Percentage of the executable\'s pages that are '
+                       'zero, JFFS2 writes them as zero compressed nodes')
+    argsp.add_argument('--obsolete', type=int, default=0,
+                       help='Older versions of the executable written first')
+    argsp.add_argument('--summary', action='store_true',
+                       help='Write a JFFS2 summary node in each erase block')
+    argsp.add_argument('--depth', type=int, default=0,
+                       help='Directories below the boot path the executable '
+                       'is in')
+    argsp.add_argument('--dirs', type=int, default=0,
+                       help='Directories with a file in the root')
+    argsp.add_argument('--fill', type=int, default=0,
+                       help='Percentage of the image filled with files')
+    argsp.add_argument('--filler-size', type=int, default=256 * 1024,
+                       help='Filler file size (default: %(default)s)')
+    argsp.add_argument('--tools', choices=['auto', 'mkfs', 'builtin'],
+                       default='auto',
+                       help='Image tools (default: %(default)s)')
+    argsp.add_argument('--seed', type=int, default=1, help='Random seed')
+    return argsp
+
+
+def run(args=sys.argv):
+    opts = arguments().parse_args(args[1:])
+    generate(opts)
+
+
+if __name__ == "__main__":
+    sys.exit(run())
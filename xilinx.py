@@ -10,7 +10,8 @@ outputs = {
     ],
     'zynq7000': [
         'xilinx/ps7_init.c',
-    ]
+    ],
+    'host': []
 }
 
 
@@ -50,6 +51,8 @@ def build(bld):
         run_str = (unzip_xsa, copy_ps_init)
 
     board = bld.env.FLARE_BOARD
+    if not outputs[board]:
+        return
     outs = [bld.path.find_or_declare(file) for file in outputs[board]]
 
     xilinx_init_tsk = xilinx_init(env=bld.env)